@@ -3,56 +3,163 @@
 #include <array>
 #include <chrono>
 #include <shared_mutex>
-#include <unordered_map>
 #include "Size.h"
+#include "Stats.h"
+#include "MetaArena.h"
+#include "PageMap.h"
 #include <cstddef>
+#include <cstdint>
 using std::size_t;
 
+class PageCache;
+namespace mpool
+{
+	class Heap;
+}
+
+// How a size class keeps track of its free blocks.
+//   FreeList: intrusive next pointers inside the free blocks (default)
+//   Bitmap:   per-span occupancy bitmap in the tracker; frees flip bits and an
+//             empty span is noticed in O(1) without scanning any block
+enum class SpanLayout : uint8_t
+{
+	FreeList,
+	Bitmap,
+};
+
 struct SpanTracker
 {
 	void *spanAddr{nullptr};
 	size_t numPages{0};
 	size_t blockCount{0};
+	size_t blockSize{0};
+	size_t carvedCount{0}; // blocks [0, carvedCount) have been handed out at least once
+	size_t color{0};	   // cache coloring: block 0 starts this many bytes into the span
+	bool zeroed{false};	   // span came zeroed from PageCache: uncarved blocks are all zero
+	bool prewarmed{false}; // carved by prewarm: not reclaimed while its bucket's prewarmedBlocks_ is non-zero
+
+	// Bitmap layout only: bit set = block free; spans with free blocks are
+	// linked into their bucket's partial_ or empty_ list
+	uint64_t *freeBits{nullptr};
+	size_t freeCount{0};
+	SpanTracker *prev{nullptr};
+	SpanTracker *next{nullptr};
 
-	void init(void *addr, size_t pages, size_t blocks)
+	// scratch for tryReclaimSpans: free blocks seen, next touched tracker
+	size_t reclaimCount{0};
+	SpanTracker *reclaimNext{nullptr};
+
+	void init(void *addr, size_t pages, size_t blocks, size_t size, size_t offset = 0)
 	{
 		spanAddr = addr;
 		numPages = pages;
 		blockCount = blocks;
+		blockSize = size;
+		carvedCount = 0;
+		color = offset;
+		prewarmed = false;
+	}
+
+	char *blocks() const
+	{
+		return static_cast<char *>(spanAddr) + color;
 	}
 };
 
 struct alignas(64) FreeListBucket
 {
 	void *freelist_;
+	SpanTracker *carving_; // span still being carved lazily, if any
+	SpanTracker *partial_; // Bitmap layout: spans with some blocks free
+	SpanTracker *empty_;   // Bitmap layout: spans with every block free
+	SpanLayout layout_;
+	size_t nextColor_; // color of the next span fetched, when coloring is on
+	// FreeList layout: blocks prewarm carved that the bucket has not handed
+	// out as many of yet; until then reclaim leaves prewarmed spans alone
+	size_t prewarmedBlocks_;
 	std::atomic_flag splk;
+	// a real-time thread missed splk and has not had it since; tryReclaimSpans
+	// gives way while set
+	std::atomic<bool> realTimeWaiting_;
 	size_t delayCounts_;
 	std::chrono::steady_clock::time_point latestRetTime_;
+
+	// statistics; everything but lockContended_ is only written while splk is held
+	std::atomic<size_t> lockAcquires_;
+	std::atomic<size_t> lockContended_;
+	std::atomic<size_t> freeBlocks_;
+	std::atomic<size_t> heldBlocks_;
+	std::atomic<size_t> refills_;
+	std::atomic<size_t> drains_;
 };
 
 class CentralCache
 {
 public:
 	static CentralCache &getInstance();
-	void *allocateBatch(size_t index);
-	void deallocateBatch(void *ptr, void *tail, size_t numReturn, size_t index);
+	// zeroed, if given, is set when the batch was freshly carved from a zero
+	// span: every block is zero apart from its next pointer.
+	void *allocateBatch(size_t index, bool *zeroed = nullptr);
+	// False only on a real-time thread that could not get the bucket lock in
+	// time; the blocks are then still the caller's.
+	bool deallocateBatch(void *ptr, void *tail, size_t numReturn, size_t index);
+	void collectStats(PoolStats &stats) const;
+	void collectClassStats(ClassStats (&classes)[Size::FREE_LIST_SIZE]) const;
+	// block size of the span owning ptr, or 0 if ptr is not the start of a pool block
+	size_t blockSizeOf(const void *ptr);
+	// Only possible while the size class owns no span; returns false otherwise.
+	bool setSpanLayout(size_t index, SpanLayout layout);
+	// Gives every span whose blocks are all back in a bucket to PageCache.
+	// Used by the maintenance thread. Bitmap classes are reclaimed one span
+	// per bucket lock hold; free-list scans give way to real-time threads.
+	void reclaimAll();
+	// While on, deallocateBatch leaves time-based reclaim to reclaimAll and
+	// skips its clock read.
+	void setBackgroundReclaim(bool on);
+	// Cache coloring: spans fetched while on start their blocks at a rotating
+	// multiple of CACHE_LINE bytes (see fetchSpan). Spans already carved keep
+	// their offset.
+	void setCacheColoring(bool on);
+	// Pre-faults metadata for spans covering numPages (worst case: every
+	// span one page, each with a bitmap), so fetching them needs no system call.
+	bool reserveMetadata(size_t numPages);
+	// Carves spans into the bucket until it holds at least numBlocks free
+	// blocks, kept from reclaim until the class has handed out as many
+	// blocks. Returns the free blocks it holds afterwards.
+	size_t prewarm(size_t index, size_t numBlocks);
 
 private:
-	CentralCache();
-	void *fetchFromPageCache(size_t);
-	void returnSpan(SpanTracker *, size_t freeCount, size_t index);
+	friend class mpool::Heap;
+	explicit CentralCache(PageCache &pageCache);
+	~CentralCache() = default;
+	void *fetchFromPageCache(size_t, bool *zeroed);
+	SpanTracker *fetchSpan(size_t index);
+	void *carveBlocks(SpanTracker &tracker, size_t maxBlocks, size_t &count);
+	void releaseSpan(SpanTracker *tracker);
+
+	void *allocateFromBitmap(FreeListBucket &bucket, size_t index, size_t numBlocks);
+	void deallocateToBitmap(FreeListBucket &bucket, void *ptr, size_t numReturn);
+	void releaseBitmapSpan(SpanTracker *tracker);
+	bool initBitmap(FreeListBucket &bucket, SpanTracker *tracker);
 
 	// page map: shared across ALL buckets, needs its own lock.
 	// lock ordering: locks_[i] -> pageMapMutex_ -> PageCache::mutex_
 
 	mutable std::shared_mutex pageMapMutex_;
+	PageCache &pageCache_;
 
 	// delayed return heuristic
 	static const size_t MAX_DELAY_COUNT{48};
 	static const std::chrono::milliseconds MAX_DELAY_DURATION;
 
-	std::unordered_map<size_t, SpanTracker *> pageMap_;
-	std::unordered_map<uintptr_t, SpanTracker> spanStore_;
+	// span trackers, bitmaps and page-map nodes; declared before pageMap_,
+	// which allocates from it
+	MetaArena arena_;
+	PageMap<SpanTracker> pageMap_{arena_};
+	std::atomic<size_t> spanBytes_{0};	  // written under unique pageMapMutex_
+	std::atomic<size_t> spansReleased_{0}; // written under unique pageMapMutex_
+	std::atomic<bool> backgroundReclaim_{false};
+	std::atomic<bool> cacheColoring_{false};
 
 	// per-bucket free lists and locks
 	std::array<FreeListBucket, Size::FREE_LIST_SIZE> freeListBuckets_;
@@ -62,7 +169,8 @@ private:
 	// std::array<std::chrono::steady_clock::time_point, Size::FREE_LIST_SIZE> latestReturnTimes_;
 
 	bool shouldReturn(size_t index, size_t currentCount, std::chrono::steady_clock::time_point currentTime);
-	void tryReclaimSpans(size_t index);
+	SpanTracker *tryReclaimSpans(size_t index); // caller holds the bucket lock
+	void releaseSpans(SpanTracker *returned);
 	SpanTracker *getSpanTracker(void *blockAddr); // caller holds shared lock
 	void unregisterSpan(SpanTracker &tracker);		// caller holds unique lock
 	size_t PageToCentralStrategy(size_t index);
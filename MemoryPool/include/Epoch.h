@@ -0,0 +1,76 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+using std::size_t;
+
+// Epoch-based reclamation for lock-free structures built on the pool. Readers
+// bracket every access to shared nodes with enter()/exit() (or an
+// mpool::EpochGuard); a writer that unlinks a node hands it to retire()
+// instead of deallocating it. Retired blocks are staged per thread, tagged
+// with the global epoch, and go back to the pool once the epoch has advanced
+// twice, i.e. once every reader that could still see them has left.
+//
+// The epoch only advances when every thread inside a critical section has
+// seen the current one, so a reader that never exits holds back every
+// retired block. Where the OS offers a process-wide barrier (membarrier on
+// Linux, FlushProcessWriteBuffers on Windows) the reclaimer issues it, and
+// enter() is a thread-local store behind a compiler barrier; otherwise
+// enter() also needs a full fence.
+namespace Epoch
+{
+	struct alignas(64) ThreadRecord
+	{
+		std::atomic<uint64_t> epoch{0}; // 0 while outside any critical section
+		std::atomic<bool> inUse{false};
+		ThreadRecord *next = nullptr;
+	};
+
+	inline std::atomic<uint64_t> globalEpoch{1};
+	inline std::atomic<bool> asymmetricFence{false};
+	inline thread_local ThreadRecord *record = nullptr;
+	inline thread_local unsigned depth = 0;
+
+	ThreadRecord *registerThread();
+
+	// Critical sections nest; only the outermost one announces an epoch.
+	inline void enter()
+	{
+		if (depth++ != 0)
+			return;
+		ThreadRecord *rec = record ? record : registerThread();
+		rec->epoch.store(globalEpoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		// the announcement must be visible before any shared pointer is read
+		if (asymmetricFence.load(std::memory_order_relaxed))
+			std::atomic_signal_fence(std::memory_order_seq_cst);
+		else
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+	}
+
+	inline void exit()
+	{
+		if (--depth == 0)
+			record->epoch.store(0, std::memory_order_release);
+	}
+
+	// Frees ptr (allocated from MemoryPool with this size) once no reader can
+	// hold it any more. May be called inside or outside a critical section.
+	void retire(void *ptr, size_t size);
+
+	// Advances the epoch as far as current readers allow and frees what is
+	// safe, including blocks left behind by exited threads. Call outside a
+	// critical section. Returns the blocks still waiting.
+	size_t flush();
+}
+
+namespace mpool
+{
+	class EpochGuard
+	{
+	public:
+		EpochGuard() { Epoch::enter(); }
+		~EpochGuard() { Epoch::exit(); }
+		EpochGuard(const EpochGuard &) = delete;
+		EpochGuard &operator=(const EpochGuard &) = delete;
+	};
+}
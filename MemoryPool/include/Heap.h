@@ -0,0 +1,66 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "CentralCache.h"
+#include "Stats.h"
+using std::size_t;
+
+class PageCache;
+class ThreadCache;
+
+namespace mpool
+{
+	// An allocator instance with its own CentralCache and PageCache, so a
+	// tenant or subsystem can be isolated, tuned (span layouts) and thrown away
+	// as a whole. Each thread gets its own ThreadCache per heap. MemoryPool
+	// keeps using the process-wide default tiers.
+	//
+	// allocate/deallocate may be called from any number of threads. Objects
+	// above Size::MAX_ALLOC_SIZE come straight from the heap's PageCache rather
+	// than malloc, so destroy() covers them too. Heap allocations are not
+	// sampled by HeapProfiler.
+	class Heap
+	{
+	public:
+		Heap();
+		~Heap();
+		Heap(const Heap &) = delete;
+		Heap &operator=(const Heap &) = delete;
+
+		void *allocate(size_t size);
+		void deallocate(void *ptr, size_t size);
+
+		// Unmaps every span of the heap at once, without per-object frees, and
+		// leaves it empty and usable. Every block it handed out becomes invalid.
+		// Other threads must have stopped using the heap before the call (the
+		// destructor's too); they may use it again afterwards. Their thread
+		// caches for the old heap are never touched again, and freed the next
+		// time such a thread creates a cache for a heap, or when it exits.
+		void destroy();
+
+		bool setSpanLayout(size_t size, SpanLayout layout);
+		// See MemoryPool::setSpanCache.
+		void setSpanCache(bool enabled);
+		// See MemoryPool::setCacheColoring.
+		void setCacheColoring(bool enabled);
+		// Hands the pages of the heap's free spans back to the OS, like the
+		// maintenance pass does for the default tiers. Returns the pages released.
+		size_t releaseToOS();
+		// Reclaims the free spans of every heap in the process and releases
+		// their pages, as memory limit flushes do. Returns the pages released.
+		static size_t releaseAll();
+		PoolStats getStats() const;
+		// Thread caches of every heap in the process, stale ones not freed yet
+		// included (see destroy).
+		static size_t threadCaches();
+
+	private:
+		ThreadCache &threadCache();
+		void create();
+		void release();
+
+		uint64_t id_; // never reused, so stale thread caches cannot match
+		PageCache *pageCache_;
+		CentralCache *centralCache_;
+	};
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+using std::size_t;
+
+// Heap-debugging layer, compiled in with -DMPOOL_HEAP_DEBUG=ON; release builds
+// do not contain any of it.
+//
+// Each block carries a header (size, state, allocation and free sites) and red
+// zones on both sides of the user region. Freed blocks are poisoned and held
+// in a FIFO quarantine before they go back to the ThreadCache, so writes after
+// free are caught when the block leaves quarantine. Pool blocks are also
+// checked against CentralCache span metadata on free.
+#ifdef MPOOL_HEAP_DEBUG
+namespace HeapDebug
+{
+	enum class Error
+	{
+		DoubleFree,
+		InvalidPointer,
+		WrongSizeClass,
+		SizeMismatch,
+		BufferUnderflow,
+		BufferOverflow,
+		UseAfterFree,
+	};
+
+	// Called after the report is printed. The default handler aborts; if a
+	// handler returns, the offending block is dropped (never reused).
+	using ErrorHandler = void (*)(Error error, void *ptr, size_t size);
+
+	void *allocate(size_t size);
+	void deallocate(void *ptr, size_t size);
+	// The requested size of a live block: debug blocks have no slack, the red
+	// zone starts right after it.
+	size_t usableSize(const void *ptr);
+
+	void setErrorHandler(ErrorHandler handler);
+	const char *errorName(Error error);
+
+	// Release every quarantined block, verifying its poison first.
+	void flushQuarantine();
+}
+#endif
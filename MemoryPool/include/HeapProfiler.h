@@ -0,0 +1,45 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+using std::size_t;
+
+// Sampled heap profiler (tcmalloc style). With a sample rate of R bytes, on
+// average one allocation per R allocated bytes is sampled: the interval
+// between samples is drawn from an exponential distribution, so every byte
+// has the same chance of being picked regardless of object size.
+//
+// A sampled object gets its own page in a dedicated virtual region, with its
+// stack trace stored in the page's tail, so the side table needs no malloc
+// and ThreadCache::deallocate recognises a sampled pointer with one range
+// check. Objects larger than Size::MAX_ALLOC_SIZE (served by malloc) are not
+// sampled.
+namespace HeapProfiler
+{
+	// 0 disables sampling (the default).
+	void setSampleRate(size_t bytes);
+	size_t sampleRate();
+
+	// Bytes until the next sample for the calling thread; while sampling is
+	// disabled this is a long fixed interval so the countdown rarely fires.
+	std::ptrdiff_t nextSampleInterval();
+
+	// nullptr if sampling is off or the sample region is full; the caller
+	// then serves the allocation normally.
+	void *allocateSampled(size_t size);
+	void deallocateSampled(void *ptr);
+	// Size the sampled object at ptr was allocated with.
+	size_t sampledSize(const void *ptr);
+
+	// Live sampled objects in pprof's legacy heap format (heap_v2).
+	bool dumpHeapProfile(const char *path);
+
+	inline std::atomic<uintptr_t> regionBase{0};
+	inline std::atomic<uintptr_t> regionSize{0};
+
+	inline bool isSampled(const void *ptr)
+	{
+		return reinterpret_cast<uintptr_t>(ptr) - regionBase.load(std::memory_order_relaxed) <
+			   regionSize.load(std::memory_order_relaxed);
+	}
+}
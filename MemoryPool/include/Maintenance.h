@@ -0,0 +1,33 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// Opt-in background thread doing the time-based work the allocation paths
+// would otherwise do (or never do, if frees stop arriving): each period it
+// reclaims fully free spans from every CentralCache bucket, asks thread caches
+// to shrink on their next call, frees retired blocks (Epoch.h) whose grace
+// period is over, and gives free PageCache spans back to the OS.
+class Maintenance
+{
+public:
+	static Maintenance &getInstance();
+	// Starts the thread, or changes the period of a running one.
+	void start(std::chrono::milliseconds period);
+	void stop();
+	bool running();
+	// One maintenance pass on the calling thread.
+	void runOnce();
+
+private:
+	Maintenance();
+	~Maintenance();
+	void loop();
+
+	std::mutex mutex_;
+	std::condition_variable wake_;
+	std::thread thread_;
+	std::chrono::milliseconds period_{1000};
+	bool stopping_ = false;
+};
@@ -0,0 +1,70 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+using std::size_t;
+
+// Memory budget for the pool. The footprint counted against it is what every
+// PageCache has mapped from the OS, minus free pages released back with
+// releaseToOS while they stay unused. Objects above Size::MAX_ALLOC_SIZE come
+// from malloc and are not counted.
+//
+// Soft limit: growing past it requests a flush of every tier (what
+// MemoryPool::trim does, plus the free spans of every mpool::Heap), run by the
+// next thread that refills from CentralCache, outside all pool locks. While
+// the footprint stays above the limit, another flush is requested each time
+// it grows by a sixteenth of the limit; each flush that leaves it above the
+// limit doubles that step (and makes it at least a sixteenth of the
+// footprint), so live data beyond the limit does not flush on every refill.
+//
+// Hard limit: PageCache refuses to map pages, or reuse released ones, beyond
+// it. The refilling thread flushes and retries once, then asks the handler
+// (setHandler) and retries while it returns true; without a handler it calls
+// std::new_handler like operator new does, and without one of those either
+// the allocation returns nullptr.
+//
+// Pressure watching polls a cgroup v2 directory from a background thread and
+// flushes when memory.pressure's "some avg10" or memory.current reaches its
+// threshold, so idle memory goes back before the kernel reclaims or OOM-kills.
+namespace MemoryLimit
+{
+	// 0 removes the limit (the default).
+	void setSoftLimit(size_t bytes);
+	void setHardLimit(size_t bytes);
+	size_t softLimit();
+	size_t hardLimit();
+	size_t footprint();
+	// Flushes run for the soft limit, the hard limit or memory pressure.
+	size_t flushes();
+
+	// Called with the bytes PageCache was refused; return true to retry the
+	// allocation (after freeing memory or raising the limit), false to fail it.
+	using Handler = bool (*)(size_t bytes);
+	void setHandler(Handler handler);
+
+	// Starts (or reconfigures) the watcher on `cgroupDir`, or on the calling
+	// process's own cgroup if it is null. A threshold of 0 is not checked.
+	// After a flush the watcher waits ten periods before the next one. False
+	// if the directory has neither file.
+	bool watchPressure(const char *cgroupDir, double someAvg10, size_t currentBytes,
+		std::chrono::milliseconds period = std::chrono::milliseconds(100));
+	void stopWatchingPressure();
+
+	// PageCache accounting: tryGrow refuses what the hard limit does not
+	// allow; grow never refuses.
+	bool tryGrow(size_t bytes);
+	void grow(size_t bytes);
+	void shrink(size_t bytes);
+
+	// For ThreadCache's refill path, which holds no pool lock.
+	inline std::atomic<bool> flushRequested{false};
+	void flush();
+	inline void flushIfRequested()
+	{
+		if (flushRequested.load(std::memory_order_relaxed))
+			flush();
+	}
+	// After a failed refill: true if it should be retried. `attempt` counts
+	// from 0 for each allocation.
+	bool recover(unsigned attempt);
+}
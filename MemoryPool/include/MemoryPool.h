@@ -1,16 +1,264 @@
 ﻿#pragma once
 #include"ThreadCache.h"
+#include"CentralCache.h"
+#include"PageCache.h"
+#include"Stats.h"
+#include"HeapDebug.h"
+#include"HeapProfiler.h"
+#include"Maintenance.h"
+#include"Heap.h"
+#include"Epoch.h"
+#include"MemoryLimit.h"
+#include"RealTime.h"
+#include"StatsPage.h"
+#include<cstring>
+
+// Result of MemoryPool::allocateAtLeast, after C++23 std::allocation_result:
+// `size` is at least the requested size and all of it may be used.
+struct AllocationResult
+{
+    void* ptr;
+    size_t size;
+};
 
 class MemoryPool
 {
 public:
     static void* allocate(size_t size)
     {
+#ifdef MPOOL_HEAP_DEBUG
+        return HeapDebug::allocate(size);
+#else
         return ThreadCache::getInstance().allocate(size);
+#endif
+    }
+
+    // Like allocate, but the memory is zero (calloc). Blocks carved from
+    // pages fresh from the OS are not cleared again; only recycled ones are.
+    static void* allocateZeroed(size_t size)
+    {
+#ifdef MPOOL_HEAP_DEBUG
+        void* ptr = HeapDebug::allocate(size);
+        if (ptr)
+            std::memset(ptr, 0, size);
+        return ptr;
+#else
+        return ThreadCache::getInstance().allocateZeroed(size);
+#endif
     }
 
     static void deallocate(void* ptr, size_t size)
     {
+#ifdef MPOOL_HEAP_DEBUG
+        HeapDebug::deallocate(ptr, size);
+#else
         ThreadCache::getInstance().deallocate(ptr, size);
+#endif
+    }
+
+    // Like allocate, but also reports the block's real size: a request is
+    // rounded up to its size class (130 B gets 160 B), and containers can
+    // take that slack as capacity instead of reallocating early. The block
+    // may be freed with any size from the requested one to `size`. Objects
+    // above Size::MAX_ALLOC_SIZE, and every block in heap-debug builds, get
+    // exactly what they asked for. {nullptr, 0} on failure.
+    static AllocationResult allocateAtLeast(size_t size)
+    {
+#ifdef MPOOL_HEAP_DEBUG
+        void* ptr = HeapDebug::allocate(size);
+#else
+        size = Size::classSize(size);
+        void* ptr = ThreadCache::getInstance().allocate(size);
+#endif
+        return { ptr, ptr ? size : 0 };
+    }
+
+    // Usable bytes of a live block from allocate/allocateAtLeast, read from
+    // its span's metadata (a sampled block's from its profile record). 0 for
+    // objects above Size::MAX_ALLOC_SIZE, which the pool leaves to malloc and
+    // does not track, and for pointers it did not hand out.
+    static size_t usableSize(const void* ptr)
+    {
+        if (ptr == nullptr)
+            return 0;
+#ifdef MPOOL_HEAP_DEBUG
+        return HeapDebug::usableSize(ptr);
+#else
+        if (HeapProfiler::isSampled(ptr))
+            return Size::classSize(HeapProfiler::sampledSize(ptr));
+        return CentralCache::getInstance().blockSizeOf(ptr);
+#endif
+    }
+
+    // Deferred free for lock-free structures: ptr goes back to the pool once
+    // every reader that entered a critical section (mpool::EpochGuard) before
+    // it was retired has left. See Epoch.h.
+    static void retire(void* ptr, size_t size)
+    {
+        Epoch::retire(ptr, size);
+    }
+
+    // Frees every retired block no reader can still hold, advancing the epoch
+    // as far as readers allow. Returns the blocks still waiting.
+    static size_t flushRetired()
+    {
+        return Epoch::flush();
+    }
+
+    // Chooses free-list or bitmap bookkeeping for the size class serving
+    // `size`. Call before that class is first used; returns false afterwards.
+    static bool setSpanLayout(size_t size, SpanLayout layout)
+    {
+        if (size == 0 || size > Size::MAX_ALLOC_SIZE)
+            return false;
+        return CentralCache::getInstance().setSpanLayout(Size::sizeToIndex(size), layout);
+    }
+
+    // Turns PageCache's per-CPU span cache on (the default) or off. Off, every
+    // span request and free takes the PageCache mutex.
+    static void setSpanCache(bool enabled)
+    {
+        PageCache::getInstance().setSpanCache(enabled);
+    }
+
+    // Cache coloring (off by default): each new span of a size class starts
+    // its blocks at the next multiple of 64 bytes its tail slack allows, so
+    // objects at the same index in different spans fall into different L1
+    // sets. Classes that fill their spans exactly give up one block per span
+    // for it. Blocks are then only guaranteed 64-byte alignment.
+    static void setCacheColoring(bool enabled)
+    {
+        CentralCache::getInstance().setCacheColoring(enabled);
+    }
+
+    // Maps at least `bytes` up front as free pages, so spans are later carved
+    // without an mmap call; `populate` also faults the pages in now
+    // (MAP_POPULATE). Returns false if the memory cannot be mapped.
+    static bool reserve(size_t bytes, bool populate = false)
+    {
+        size_t numPages = (bytes + Size::PAGE_SIZE - 1) / Size::PAGE_SIZE;
+        return numPages == 0 || PageCache::getInstance().reserve(numPages, populate);
+    }
+
+    // Carves spans for the size class serving `size` until CentralCache holds
+    // at least `count` free blocks of it, touching every block. With
+    // `fillThreadCache` the calling thread's cache is filled from them too
+    // (up to the size its list is allowed to grow to). Returns the free
+    // blocks of the class in CentralCache and the calling thread's cache.
+    static size_t prewarm(size_t size, size_t count, bool fillThreadCache = false)
+    {
+        if (size == 0 || size > Size::MAX_ALLOC_SIZE)
+            return 0;
+        size_t index = Size::sizeToIndex(size);
+        size_t available = CentralCache::getInstance().prewarm(index, count);
+        if (fillThreadCache)
+        {
+            size_t cached = ThreadCache::getInstance().prewarm(index, count);
+            available = CentralCache::getInstance().prewarm(index, 0) + cached;
+        }
+        return available;
+    }
+
+    // Starts a background thread that every `period` reclaims free spans from
+    // CentralCache, asks thread caches to shrink and releases free pages to
+    // the OS. Calling it again while running changes the period.
+    static void startMaintenance(std::chrono::milliseconds period = std::chrono::milliseconds(1000))
+    {
+        Maintenance::getInstance().start(period);
+    }
+
+    static void stopMaintenance()
+    {
+        Maintenance::getInstance().stop();
+    }
+
+    // One maintenance pass on the calling thread, whether or not the
+    // background thread is running.
+    static void trim()
+    {
+        Maintenance::getInstance().runOnce();
+    }
+
+    // Soft and hard limits on the pool's mapped memory, 0 for none (see
+    // MemoryLimit.h). Past the soft limit the pool trims itself; past the
+    // hard limit allocations fail unless the handler makes room.
+    static void setMemoryLimits(size_t softBytes, size_t hardBytes)
+    {
+        MemoryLimit::setSoftLimit(softBytes);
+        MemoryLimit::setHardLimit(hardBytes);
+    }
+
+    static void setMemoryLimitHandler(MemoryLimit::Handler handler)
+    {
+        MemoryLimit::setHandler(handler);
+    }
+
+    // Trims the pool when the cgroup's memory.pressure "some avg10" or
+    // memory.current reaches its threshold (0 skips one). A null `cgroupDir`
+    // watches the process's own cgroup. False if there is nothing to watch.
+    static bool watchMemoryPressure(const char* cgroupDir, double someAvg10, size_t currentBytes = 0)
+    {
+        return MemoryLimit::watchPressure(cgroupDir, someAvg10, currentBytes);
+    }
+
+    static void stopWatchingMemoryPressure()
+    {
+        MemoryLimit::stopWatchingPressure();
+    }
+
+    // Real-time mode (see RealTime.h): reserves and pre-faults `reserveBytes`
+    // and stops the pool from growing. Call once, before the pool is used,
+    // then mark each latency-critical thread with enterRealTimeThread(); run
+    // startMaintenance() so reclamation happens off those threads.
+    static bool startRealTime(size_t reserveBytes)
+    {
+        return RealTime::start(reserveBytes);
+    }
+
+    static void enterRealTimeThread()
+    {
+        RealTime::enterThread();
+    }
+
+    static void leaveRealTimeThread()
+    {
+        RealTime::leaveThread();
+    }
+
+    // Samples roughly one allocation per `bytes` allocated bytes for the heap
+    // profile; 0 turns sampling off (the default). Threads pick up a new rate
+    // within about 1 MB of allocation.
+    static void setProfileSampleRate(size_t bytes)
+    {
+        HeapProfiler::setSampleRate(bytes);
+    }
+
+    // Writes the live sampled allocations to `path` in pprof's heap format
+    // (`pprof <binary> <path>`). Returns false if the file cannot be written.
+    static bool dumpHeapProfile(const char* path)
+    {
+        return HeapProfiler::dumpHeapProfile(path);
+    }
+
+    // Publishes getStats() and the per-class counters every `period` in a
+    // shared-memory page that `mpooltop <pid>` reads from another process
+    // (see StatsPage.h). False if the page cannot be created.
+    static bool publishStats(std::chrono::milliseconds period = std::chrono::milliseconds(100))
+    {
+        return StatsPage::publish(period);
+    }
+
+    static void stopPublishingStats()
+    {
+        StatsPage::stopPublishing();
+    }
+
+    // Counters accumulated since process start (see Stats.h).
+    static PoolStats getStats()
+    {
+        PoolStats stats;
+        CentralCache::getInstance().collectStats(stats);
+        PageCache::getInstance().collectStats(stats);
+        return stats;
     }
 };
\ No newline at end of file
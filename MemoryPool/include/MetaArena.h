@@ -0,0 +1,66 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <new>
+using std::size_t;
+
+// Memory for the pool's own bookkeeping (span records, page-map nodes, span
+// bitmaps), carved from mmap'ed chunks so the allocator never calls the
+// system malloc. Requests up to MAX_SMALL bytes are rounded to GRAIN and
+// recycled through per-size free lists; larger ones (page-map nodes) live
+// until the arena is destroyed, which unmaps everything at once.
+class MetaArena
+{
+public:
+	MetaArena() = default;
+	~MetaArena();
+	MetaArena(const MetaArena &) = delete;
+	MetaArena &operator=(const MetaArena &) = delete;
+
+	// Zero-filled; nullptr if the OS refuses more memory. Thread-safe.
+	void *allocate(size_t bytes);
+	void deallocate(void *ptr, size_t bytes);
+	// Maps and faults in room for `bytes` more of fresh allocations up front,
+	// so they need no system call. False if the OS refuses.
+	bool reserve(size_t bytes);
+
+	template <typename T>
+	T *create()
+	{
+		void *ptr = allocate(sizeof(T));
+		return ptr ? new (ptr) T : nullptr; // memory is already zeroed
+	}
+
+	template <typename T>
+	void destroy(T *obj)
+	{
+		obj->~T();
+		deallocate(obj, sizeof(T));
+	}
+
+	size_t mappedBytes() const { return mappedBytes_.load(std::memory_order_relaxed); }
+
+private:
+	static constexpr size_t GRAIN = 64;
+	static constexpr size_t MAX_SMALL = 4096;
+	static constexpr size_t CHUNK_SIZE = size_t(1) << 20;
+
+	struct FreeBlock
+	{
+		FreeBlock *next;
+	};
+	struct Chunk
+	{
+		Chunk *next;
+		size_t size;
+	};
+
+	std::atomic_flag lock_ = ATOMIC_FLAG_INIT;
+	FreeBlock *freeLists_[MAX_SMALL / GRAIN] = {};
+	Chunk *chunks_ = nullptr;
+	char *bump_ = nullptr;
+	char *bumpEnd_ = nullptr;
+	std::atomic<size_t> mappedBytes_{0};
+
+	Chunk *mapChunk(size_t bytes, bool populate = false);
+};
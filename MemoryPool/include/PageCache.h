@@ -1,59 +1,119 @@
 #pragma once
 #include <atomic>
 #include <array>
-#include <map>
-#include <unordered_map>
 #include <mutex>
+#include "Stats.h"
+#include "MetaArena.h"
+#include "PageMap.h"
+
+namespace mpool
+{
+	class Heap;
+}
 
 class PageCache
 {
 public:
 	static PageCache &getInstance()
 	{
-		static PageCache instance;
-		return instance;
+		// never destroyed: pool blocks may still be freed during static
+		// destruction, and destroying a PageCache unmaps its memory
+		static PageCache *instance = new PageCache;
+		return *instance;
 	}
-	void *allocateSpan(size_t numPages);
+	// zeroed, if given, is set when every byte of the span is known to be
+	// zero (fresh from the OS or released with releaseToOS since last use).
+	void *allocateSpan(size_t numPages, bool *zeroed = nullptr);
 	void deallocateSpan(void *spanAddr, size_t numPages);
+	void collectStats(PoolStats &stats) const;
+	// Hands the pages of every free span back to the OS (the address range
+	// stays mapped and is refaulted on next use), the span cache's included.
+	// Returns the pages released.
+	size_t releaseToOS();
+	// Moves every span parked in the per-CPU span cache back to the free
+	// lists, coalescing them. Returns the pages moved.
+	size_t flushSpanCache();
+	// The span cache is on by default; turning it off flushes it.
+	void setSpanCache(bool enabled);
+	// Maps numPages up front as one free span, faulting them in if populate
+	// is set, so later span requests are served without mmap.
+	bool reserve(size_t numPages, bool populate);
+	// Growth is on by default. Off, no page is mapped (reserve included) or
+	// released to the OS any more: span requests the free pages cannot serve
+	// fail, and releaseToOS does nothing. Used by real-time mode.
+	void setGrowth(bool enabled);
+	// Pre-faults metadata for spans covering numPages (worst case: every
+	// span one page), so splitting them allocates no memory from the OS.
+	bool reserveMetadata(size_t numPages);
 
 private:
+	friend class mpool::Heap;
 	PageCache() = default;
+	// Unmaps every region obtained from the OS (heaps only, see getInstance).
+	~PageCache();
 	struct Span
 	{
 		void *addr;
 		size_t numPages;
 		Span *next;
+		bool released; // free span whose pages were given back with releaseToOS
+		bool zeroed;   // free span never written since it was mapped or released
+	};
+	struct Region
+	{
+		void *addr;
+		size_t numPages;
+		Region *next;
 	};
-	void *systemAlloc(size_t numPages);
-	std::map<size_t, Span *> freeSpans_;
-	std::unordered_map<void *, Span *> spanMap_;
-	std::unordered_map<void *, Span *> endMap_;
+	void *systemAlloc(size_t numPages, bool populate = false);
+	Span *mapSpan(size_t numPages, bool populate);
+	void systemFree(void *ptr, size_t numPages);
+
+	// span records, regions and page-map nodes; declared before the maps
+	MetaArena arena_;
+	Region *regions_ = nullptr; // everything systemAlloc returned
+	// free spans: one list per length below LARGE_PAGES, longer ones in the last
+	static constexpr size_t LARGE_PAGES = 128;
+	std::array<Span *, LARGE_PAGES + 1> freeSpans_{};
+	PageMap<Span> spanMap_{arena_}; // first page of every span
+	PageMap<Span> endMap_{arena_};	// page just past each free span
+	void pushFreeSpan(Span *span);
+	Span *takeFreeSpan(size_t numPages);
 	bool removeFromFreeList(Span *target);
 	std::mutex mutexLock;
+	// maxSpins, if not 0, bounds the try-locks; check owns_lock()
+	std::unique_lock<std::mutex> lockPageCache(size_t maxSpins = 0);
+	void releaseSpan(void *spanAddr);
 
-	static constexpr size_t MAX_SPANS = 4096;
-	Span spanPool_[MAX_SPANS];
-	Span *spanFreeList_ = nullptr;
-	size_t spanPoolUsed_ = 0;
-
-	Span *allocSpanMeta()
+	// Per-CPU cache of spans up to SPAN_CACHE_PAGES long, in front of
+	// mutexLock: a freed span is parked in the slot of the CPU it was freed
+	// on and handed out again for the same length. Each slot has its own spin
+	// lock and holds at most SPAN_CACHE_SLOT_PAGES pages; what does not fit,
+	// misses and coalescing go through mutexLock. Cached spans stay in-use in
+	// spanMap_, so neighbours never merge into them.
+	static constexpr size_t SPAN_CACHE_PAGES = 16;
+	static constexpr size_t SPAN_CACHE_DEPTH = 4;
+	static constexpr size_t SPAN_CACHE_SLOT_PAGES = 128;
+	static constexpr size_t SPAN_CACHE_SLOTS = 64;
+	struct alignas(64) SpanSlot
 	{
-		if (spanFreeList_)
-		{
-			Span *s = spanFreeList_;
-			spanFreeList_ = s->next;
-			return s;
-		}
-		if (spanPoolUsed_ < MAX_SPANS)
-		{
-			return &spanPool_[spanPoolUsed_++];
-		}
-		return new Span; // fallback, should rarely happen
-	}
+		std::atomic_flag lock;
+		// written under lock, read racily by collectStats
+		std::atomic<size_t> pages{0};
+		std::atomic<size_t> hits{0};
+		unsigned char count[SPAN_CACHE_PAGES] = {};
+		void *spans[SPAN_CACHE_PAGES][SPAN_CACHE_DEPTH] = {};
+	};
+	std::array<SpanSlot, SPAN_CACHE_SLOTS> spanSlots_;
+	std::atomic<bool> spanCacheEnabled_{true};
+	std::atomic<bool> growth_{true};
+	void *popCachedSpan(size_t numPages);
+	bool pushCachedSpan(void *spanAddr, size_t numPages);
 
-	void freeSpanMeta(Span *s)
-	{
-		s->next = spanFreeList_;
-		spanFreeList_ = s;
-	}
+	// statistics; all but lockContended_ are only written while mutexLock is held
+	std::atomic<size_t> lockAcquires_{0};
+	std::atomic<size_t> lockContended_{0};
+	std::atomic<size_t> mappedPages_{0};
+	std::atomic<size_t> freePages_{0};
+	std::atomic<size_t> releasedPages_{0};
 };
@@ -0,0 +1,70 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "MetaArena.h"
+
+// Page number -> T* as a three-level radix tree over 36-bit page numbers
+// (48-bit addresses with 4 KB pages). Nodes come from a MetaArena, so lookups
+// are three dependent loads and updates never call malloc. Not synchronized:
+// callers use the same locks as for the structure it indexes.
+template <typename T>
+class PageMap
+{
+public:
+	explicit PageMap(MetaArena &arena) : arena_(arena) {}
+
+	T *get(uintptr_t page) const
+	{
+		if (page >> (3 * BITS))
+			return nullptr;
+		Mid *mid = root_[page >> (2 * BITS)];
+		if (!mid)
+			return nullptr;
+		Leaf *leaf = mid->leaves[(page >> BITS) & MASK];
+		return leaf ? leaf->values[page & MASK] : nullptr;
+	}
+
+	// false if the page is out of range or a node could not be allocated
+	bool set(uintptr_t page, T *value)
+	{
+		if (page >> (3 * BITS))
+			return false;
+		Mid *&mid = root_[page >> (2 * BITS)];
+		if (!mid && !(mid = arena_.create<Mid>()))
+			return false;
+		Leaf *&leaf = mid->leaves[(page >> BITS) & MASK];
+		if (!leaf && !(leaf = arena_.create<Leaf>()))
+			return false;
+		leaf->values[page & MASK] = value;
+		return true;
+	}
+
+	// Upper bound on the node bytes set() allocates for `numPages` pages.
+	static constexpr size_t nodeBytes(size_t numPages)
+	{
+		return (numPages / FANOUT + 2) * (sizeof(Leaf) + sizeof(Mid));
+	}
+
+	void clear(uintptr_t page)
+	{
+		if (get(page))
+			root_[page >> (2 * BITS)]->leaves[(page >> BITS) & MASK]->values[page & MASK] = nullptr;
+	}
+
+private:
+	static constexpr unsigned BITS = 12;
+	static constexpr size_t FANOUT = size_t(1) << BITS;
+	static constexpr uintptr_t MASK = FANOUT - 1;
+
+	struct Leaf
+	{
+		T *values[FANOUT];
+	};
+	struct Mid
+	{
+		Leaf *leaves[FANOUT];
+	};
+
+	MetaArena &arena_;
+	Mid *root_[FANOUT] = {};
+};
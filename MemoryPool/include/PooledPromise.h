@@ -0,0 +1,34 @@
+#pragma once
+#include <cstddef>
+#include <new>
+#include "MemoryPool.h"
+using std::size_t;
+
+namespace mpool
+{
+	// Base for a coroutine promise_type that puts the coroutine frames in the
+	// pool instead of global operator new:
+	//
+	//   struct promise_type : mpool::pooled_promise { ... };
+	//
+	// The compiler looks operator new/delete up in the promise type first and
+	// passes the frame size to the sized delete, so a frame takes the same
+	// path as MemoryPool::allocate/deallocate: the calling thread's cache for
+	// frames up to Size::MAX_ALLOC_SIZE, the large-object tier above that.
+	// A frame may be destroyed on another thread than the one that created it.
+	struct pooled_promise
+	{
+		static void *operator new(size_t size)
+		{
+			void *frame = MemoryPool::allocate(size);
+			if (!frame)
+				throw std::bad_alloc();
+			return frame;
+		}
+
+		static void operator delete(void *frame, size_t size) noexcept
+		{
+			MemoryPool::deallocate(frame, size);
+		}
+	};
+}
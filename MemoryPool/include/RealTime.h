@@ -0,0 +1,75 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+using std::size_t;
+
+// Real-time mode: allocation and free on a thread marked with enterThread()
+// take a bounded number of steps and make no system call.
+//
+// start() sets the pool up for it, once, before the pool is first used:
+//   - the heap and its metadata are reserved and pre-faulted up front (the
+//     metadata for the worst case of one-page spans, about 6% of the heap),
+//     and PageCache never maps another page nor releases one to the OS, so
+//     running out of the reserve makes allocations return nullptr instead of
+//     growing;
+//   - every size class uses the bitmap span layout, whose allocation, free
+//     and reclaim need no list scans;
+//   - span reclamation is left to the maintenance thread (reclaimAll), which
+//     runs on a non-real-time thread, releases spans outside the bucket
+//     locks and stops scanning a class still on free lists as soon as a
+//     real-time thread misses its lock.
+//
+// On a real-time thread:
+//   - enterThread() sets ThreadCache::STASH_BATCHES batches of every size
+//     class aside for the thread (its stash, about 1.5 MB taken from the
+//     reserve);
+//   - pool locks are try-locks spun at most MAX_SPINS times, never yielding
+//     (each miss is counted, lockMisses()). A refill that cannot get
+//     CentralCache or PageCache in time takes a batch from the class's stash
+//     instead, and each later refill that gets through sets one new batch
+//     aside. A miss with the stash used up (that many misses in a row on one
+//     class) waits for the lock after all, like any thread, so nullptr always
+//     means the reserve ran out; such waits are the one latency the bound
+//     does not cover, and are counted (contentionWaits()).
+//     A free that cannot get the lock keeps its blocks in the thread cache
+//     until a later free gets through;
+//   - trim requests, memory-limit flushes and heap-profile samples are
+//     ignored, and empty spans are not handed back to PageCache;
+//   - objects above Size::MAX_ALLOC_SIZE are refused (nullptr), since they
+//     would come from malloc.
+// Bounded here means bounded by the pool's constants (batch sizes, span
+// lengths, the thread-cache threshold), not by anything that grows with the
+// heap. Locking the pages against swap (mlockall) is left to the application.
+namespace RealTime
+{
+	constexpr size_t MAX_SPINS = 1024;
+
+	inline thread_local bool thisThread = false;
+	// lockMisses() of the calling thread alone
+	inline thread_local size_t thisThreadMisses = 0;
+
+	// Spin limit for the calling thread's lock attempts: 0 (wait as long as it
+	// takes) except on real-time threads.
+	inline size_t spinBound()
+	{
+		return thisThread ? MAX_SPINS : 0;
+	}
+
+	// Reserves and pre-faults `reserveBytes` for the global pool, and the
+	// metadata its spans can need, then freezes its growth. False if the
+	// memory cannot be mapped; the pool then stays in normal mode.
+	bool start(size_t reserveBytes);
+	bool active();
+
+	// leaveThread() hands the stash to the thread cache's free lists.
+	void enterThread();
+	void leaveThread();
+
+	// Lock attempts real-time threads gave up on.
+	size_t lockMisses();
+	void noteLockMiss();
+	// Refills on real-time threads that missed a lock with the stash used up
+	// and waited for it.
+	size_t contentionWaits();
+	void noteContentionWait();
+}
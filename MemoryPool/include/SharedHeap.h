@@ -0,0 +1,93 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+using std::size_t;
+
+namespace mpool
+{
+	// A heap inside one shared-memory region (memfd, POSIX shm or a file) that
+	// every process mapping the region can allocate from and free into,
+	// whatever address the region lands at. All metadata lives in the region
+	// and names blocks by their offset from its start, so a producer can
+	// allocate a message, pass toOffset(ptr) to another process, and that
+	// process reads it through fromOffset() and deallocates it.
+	//
+	// A file-backed heap outlives the process: reopened after a restart, its
+	// objects are live again straight away, found through root(). Objects
+	// must then link to each other by offset, never by pointer.
+	//
+	// Blocks up to Size::MAX_ALLOC_SIZE come from lock-free per-size-class
+	// free lists (heads tagged against ABA); spans for them and larger objects
+	// come from a page tier behind a spinlock kept in the region. A process
+	// that dies while holding that lock leaves a shared heap unusable (the
+	// next owner of a file heap checks and unlocks it). Free page
+	// runs are reused by length, never coalesced. There are no thread caches:
+	// a block is never stranded in a process that exits. POSIX only.
+	class SharedHeap
+	{
+	public:
+		SharedHeap() = default;
+		~SharedHeap();
+		SharedHeap(const SharedHeap &) = delete;
+		SharedHeap &operator=(const SharedHeap &) = delete;
+
+		// Creates and maps a new region of at least `bytes`: a POSIX shm object
+		// (fails if `name` exists) or, with a null name, an anonymous memfd that
+		// other processes reach through fd() (inherited, or sent over a socket).
+		bool create(const char *name, size_t bytes);
+		// Maps a region made by create(), by name or by descriptor. The
+		// descriptor is duplicated; the caller keeps its own.
+		bool open(const char *name);
+		bool attach(int fd);
+		// Maps the file at `path` as a persistent heap, creating it with room
+		// for `bytes` if it does not exist (an existing file keeps its size).
+		// One process owns a file heap at a time (others can attach(fd())).
+		// A heap its last owner did not close() is check()ed first and
+		// refused if damaged; blocks the owner was holding stay allocated.
+		bool openFile(const char *path, size_t bytes);
+		// Writes a file heap's dirty pages back to the file.
+		bool sync();
+		// Unmaps the region; blocks stay allocated for the other processes (or
+		// the next owner of a file heap).
+		void close();
+		static bool unlink(const char *name);
+
+		// Walks the header, the page runs and every free list, checking that
+		// each offset lies in the used part of the region and no list loops.
+		// Safe only while no other process is using the heap.
+		bool check() const;
+
+		// nullptr once the region is exhausted.
+		void *allocate(size_t size);
+		void deallocate(void *ptr, size_t size);
+
+		uint64_t toOffset(const void *ptr) const { return static_cast<const char *>(ptr) - base_; }
+		void *fromOffset(uint64_t offset) const { return base_ + offset; }
+
+		// A word in the region for publishing a root object (a queue, a
+		// directory) to processes that attach later; 0 until set.
+		void setRoot(uint64_t offset);
+		uint64_t root() const;
+
+		bool isOpen() const { return base_ != nullptr; }
+		int fd() const { return fd_; }
+		size_t size() const { return size_; }
+		// Bytes handed out from the page tier so far (spans in use or free).
+		size_t mappedBytes() const;
+
+	private:
+		struct Header;
+		Header *header() const { return reinterpret_cast<Header *>(base_); }
+		bool map(int fd, size_t bytes, bool initialize);
+		static size_t regionBytes(size_t bytes);
+		void *pop(size_t index);
+		void push(size_t index, uint64_t first, uint64_t last);
+		uint64_t allocatePages(size_t numPages);
+		void deallocatePages(uint64_t offset, size_t numPages);
+
+		char *base_ = nullptr;
+		size_t size_ = 0;
+		int fd_ = -1;
+		bool file_ = false;
+	};
+}
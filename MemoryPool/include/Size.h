@@ -8,6 +8,7 @@ namespace Size {
 	constexpr size_t FREE_LIST_SIZE{ 28 };
 	constexpr size_t PAGE_SIZE{ 4096 };
 	constexpr size_t SPAN_PAGES{ 8 };
+	constexpr size_t CACHE_LINE{ 64 };
 
 	// Tiered size-class scheme (28 classes, 8 B – 2048 B):
 	//   [0-7]   8 B aligned:  8, 16, 24, 32, 40, 48, 56, 64
@@ -36,4 +37,11 @@ namespace Size {
 		if (index < 24) return 512 + (index - 19) * 128;
 		return                 1024 + (index - 23) * 256;
 	}
+
+	// The block size actually handed out for a request of `size` bytes; sizes
+	// above MAX_ALLOC_SIZE (served by malloc) are returned unchanged.
+	inline size_t classSize(size_t size)
+	{
+		return size == 0 || size > MAX_ALLOC_SIZE ? size : indexToBlockSize(sizeToIndex(size));
+	}
 }
@@ -1,30 +1,63 @@
 #pragma once
 #include <atomic>
 #include <thread>
-
+#include <cstddef>
 
 class SpinLockGuard
 {
 public:
-	// Take atomic_flag by reference, not by value
-	SpinLockGuard(std::atomic_flag& spinLock);
+	// Take atomic_flag by reference, not by value.
+	// contended (optional) is bumped when the first attempt finds the lock held.
+	// maxSpins, if not 0, bounds the attempts and never yields: the guard may
+	// then give up without the lock (see ownsLock).
+	SpinLockGuard(std::atomic_flag& spinLock, std::atomic<size_t>* contended = nullptr, size_t maxSpins = 0);
 	~SpinLockGuard();
 
+	bool ownsLock() const
+	{
+		return owns_;
+	}
+
+	// Releases the lock before the guard goes out of scope.
+	void unlock()
+	{
+		if (owns_)
+			spinLock_.clear(std::memory_order_release);
+		owns_ = false;
+	}
+
 private:
 	std::atomic_flag& spinLock_;
+	bool owns_ = true;
 };
 
 // Constructor now takes a reference
-SpinLockGuard::SpinLockGuard(std::atomic_flag& lock)
+inline SpinLockGuard::SpinLockGuard(std::atomic_flag& lock, std::atomic<size_t>* contended, size_t maxSpins)
 	: spinLock_(lock)
 {
+	if (!this->spinLock_.test_and_set(std::memory_order_acquire))
+		return;
+
+	if (contended)
+		contended->fetch_add(1, std::memory_order_relaxed);
+	if (maxSpins)
+	{
+		for (size_t spin = 1; spin < maxSpins; ++spin)
+		{
+			if (!this->spinLock_.test(std::memory_order_relaxed) && !this->spinLock_.test_and_set(std::memory_order_acquire))
+				return;
+		}
+		owns_ = false;
+		return;
+	}
 	while (this->spinLock_.test_and_set(std::memory_order_acquire)) 
 	{
 		std::this_thread::yield();
 	}
 }
 
-SpinLockGuard::~SpinLockGuard()
+inline SpinLockGuard::~SpinLockGuard()
 {
-	spinLock_.clear(std::memory_order_release);
+	if (owns_)
+		spinLock_.clear(std::memory_order_release);
 }
\ No newline at end of file
@@ -0,0 +1,44 @@
+#pragma once
+#include <cstddef>
+using std::size_t;
+
+// Snapshot of allocator counters, filled by MemoryPool::getStats().
+// Counters are maintained on slow paths only (lock acquisition, refills,
+// span traffic); the ThreadCache fast path never touches them.
+struct PoolStats
+{
+	// CentralCache bucket spin locks, summed over all size classes
+	size_t centralLockAcquires{0};
+	size_t centralLockContended{0};
+
+	// PageCache::mutexLock
+	size_t pageLockAcquires{0};
+	size_t pageLockContended{0};
+
+	// memory accounting, in bytes
+	size_t mappedBytes{0};		 // obtained from the OS by PageCache
+	size_t pageFreeBytes{0};	 // free spans held by PageCache
+	size_t pageCachedBytes{0};	 // freed spans parked in PageCache's per-CPU span cache
+	size_t pageReleasedBytes{0}; // free span pages handed back to the OS (cumulative)
+	size_t centralSpanBytes{0};	 // spans carved into blocks by CentralCache
+	size_t centralFreeBytes{0};	 // free blocks parked in CentralCache buckets
+	size_t threadHeldBytes{0};	 // blocks handed to threads: in use or in a ThreadCache
+	size_t metadataBytes{0};	 // mapped for the pool's own bookkeeping (MetaArena)
+
+	size_t centralSpansReleased{0}; // spans CentralCache gave back to PageCache
+	size_t spanCacheHits{0};		// span requests served by the span cache, without mutexLock
+};
+
+// One size class of CentralCache, filled by CentralCache::collectClassStats.
+// Which of the held blocks sit in thread caches rather than in use is not
+// tracked: that would cost the ThreadCache fast path.
+struct ClassStats
+{
+	size_t blockSize{0};
+	size_t freeBlocks{0};	 // parked in the CentralCache bucket
+	size_t heldBlocks{0};	 // handed to threads: in use or in a ThreadCache
+	size_t refills{0};		 // batches thread caches fetched
+	size_t drains{0};		 // batches thread caches returned
+	size_t lockAcquires{0};
+	size_t lockContended{0};
+};
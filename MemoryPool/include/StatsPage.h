@@ -0,0 +1,61 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include "Size.h"
+#include "Stats.h"
+using std::size_t;
+
+// Live counters of the global pool in a POSIX shared-memory page,
+// "/mpool-stats.<pid>", so another process (tools/mpooltop) can watch a
+// running program without attaching a debugger. A background thread copies
+// the counters the pool keeps anyway (Stats.h) into the page every period,
+// under a seqlock: the sequence is odd while a copy is being written, and a
+// reader retries until it sees the same even value before and after its
+// read. The allocation paths only keep those counters up, with relaxed
+// stores on their slow paths.
+//
+// The page is created readable by the same user only, removed by
+// stopPublishing() and at exit; one left behind by a crash is recognised by
+// its pid no longer running. Independent heaps (mpool::Heap) are not
+// included. POSIX only.
+namespace StatsPage
+{
+	constexpr uint64_t MAGIC = 0x315453706F6D; // "mopST1"
+
+	struct Snapshot
+	{
+		uint64_t publishedNs; // steady_clock, comparable across processes on Linux
+		uint64_t publishes;
+		PoolStats pool;
+		ClassStats classes[Size::FREE_LIST_SIZE];
+	};
+
+	constexpr size_t WORDS = sizeof(Snapshot) / sizeof(uint64_t);
+	static_assert(sizeof(Snapshot) % sizeof(uint64_t) == 0, "snapshot must copy as whole words");
+
+	struct Page
+	{
+		uint64_t magic;
+		uint32_t words; // WORDS of the writer, to refuse a mismatched reader
+		uint32_t pid;
+		uint64_t periodNs;
+		std::atomic<uint64_t> sequence;
+		std::atomic<uint64_t> data[WORDS];
+	};
+	static_assert(sizeof(Page) <= Size::PAGE_SIZE, "stats must fit in one page");
+
+	// Creates the page and starts publishing every `period` (again while
+	// running: changes the period). False if the page cannot be created.
+	bool publish(std::chrono::milliseconds period = std::chrono::milliseconds(100));
+	void stopPublishing();
+
+	// Reader side: maps the page of process `pid` read-only. nullptr if it
+	// has none (or one from an incompatible build).
+	const Page *attach(int pid);
+	void detach(const Page *page);
+	// A consistent copy of the latest counters; false if the writer was in
+	// the middle of every attempt.
+	bool read(const Page &page, Snapshot &out);
+}
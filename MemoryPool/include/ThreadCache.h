@@ -1,21 +1,35 @@
 #pragma once
 
 #include <array>
+#include <atomic>
 #include "Size.h"
 #include <cstddef>
 using std::size_t;
+using std::ptrdiff_t;
+
+class CentralCache;
+namespace mpool
+{
+	class Heap;
+}
 
 struct FreeListEntry
 {
 	void *head;
 	void *tail;
 	size_t size;
+	// The last min(freshCount, size) blocks of the list came from a zero span
+	// and are zero apart from their next pointer. Blocks are only ever pushed
+	// at the head, so they stay at the tail; deallocate clamps the count
+	// before pushing and pops leave it alone.
+	size_t freshCount;
 
 	FreeListEntry()
 	{
 		head = nullptr;
 		tail = nullptr;
 		size = 0;
+		freshCount = 0;
 	}
 };
 
@@ -25,16 +39,47 @@ public:
 	// Use the Singleton pattern
 	static ThreadCache &getInstance();
 	void *allocate(size_t);
+	// allocate() with the block cleared; blocks never used since their span
+	// came zeroed from the OS only get their next pointer cleared.
+	void *allocateZeroed(size_t);
 	void deallocate(void *ptr, size_t);
+	// Asks every thread cache to give half of each free list back to
+	// CentralCache on its next allocate/deallocate call.
+	static void requestTrim();
+	// Fills this thread's free list for index with up to count blocks from
+	// CentralCache, never beyond the point where deallocate would drain it.
+	// Returns the blocks the list holds afterwards.
+	size_t prewarm(size_t index, size_t count);
+	// Real-time threads (see RealTime.h): fillStash sets STASH_BATCHES
+	// batches of every size class aside for refills that cannot get
+	// CentralCache in time; dropStash moves what is left into the free lists.
+	static constexpr size_t STASH_BATCHES = 4;
+	void fillStash();
+	void dropStash();
 
 private:
-	ThreadCache()
+	friend class mpool::Heap;
+	explicit ThreadCache(CentralCache &central) : central_(central)
 	{
 		freeListEntries_.fill(FreeListEntry());
 	}
+	CentralCache &central_;
 	std::array<FreeListEntry, Size::FREE_LIST_SIZE> freeListEntries_;
+	// Bytes left before the next heap-profile sample (see HeapProfiler.h).
+	ptrdiff_t bytesUntilSample_ = 0;
+	// Null-terminated batches set aside by fillStash, per size class; the
+	// first stashed_[index] slots are in use and the last one goes first.
+	std::array<std::array<void *, STASH_BATCHES>, Size::FREE_LIST_SIZE> stash_{};
+	std::array<size_t, Size::FREE_LIST_SIZE> stashed_{};
+	// Last trim request this cache has honoured (see requestTrim).
+	size_t seenTrimEpoch_ = trimEpoch_.load(std::memory_order_relaxed);
+	inline static std::atomic<size_t> trimEpoch_{0};
 
 	void *refillFromCentral(size_t);
+	void *sampleAllocation(size_t size);
+	void pushBatch(FreeListEntry &entry, void *batch, bool zeroed);
 	void drainToCentral(void *head, void *tail, size_t);
 	bool shouldReturn(size_t index);
+	static size_t returnThreshold(size_t index);
+	void trim();
 };
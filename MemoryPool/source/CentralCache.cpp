@@ -1,90 +1,105 @@
 ﻿#include "CentralCache.h"
 #include <thread>
 #include <PageCache.h>
-#include <unordered_map>
 #include "Size.h"
 #include <cstddef>
 #include "SpinLockGuard.h"
+#include "RealTime.h"
+#include <bit>
 using std::size_t;
 
 const std::chrono::milliseconds CentralCache::MAX_DELAY_DURATION{1000};
-CentralCache::CentralCache()
+
+// Statistics counters have a single writer at a time (the caller holds the
+// lock guarding them), so a relaxed load+store is enough; readers may be racy.
+static inline void addCounter(std::atomic<size_t> &counter, size_t delta)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+
+CentralCache::CentralCache(PageCache &pageCache) : pageCache_(pageCache)
 {
     for (auto &freeListBucket : freeListBuckets_)
     {
         freeListBucket.freelist_ = nullptr;
+        freeListBucket.carving_ = nullptr;
+        freeListBucket.partial_ = nullptr;
+        freeListBucket.empty_ = nullptr;
+        freeListBucket.layout_ = SpanLayout::FreeList;
+        freeListBucket.nextColor_ = 0;
+        freeListBucket.prewarmedBlocks_ = 0;
         freeListBucket.splk.clear(std::memory_order_relaxed);
+        freeListBucket.realTimeWaiting_.store(false, std::memory_order_relaxed);
         freeListBucket.delayCounts_ = 0;
         freeListBucket.latestRetTime_ = std::chrono::steady_clock::now();
+        freeListBucket.lockAcquires_.store(0, std::memory_order_relaxed);
+        freeListBucket.lockContended_.store(0, std::memory_order_relaxed);
+        freeListBucket.freeBlocks_.store(0, std::memory_order_relaxed);
+        freeListBucket.heldBlocks_.store(0, std::memory_order_relaxed);
+        freeListBucket.refills_.store(0, std::memory_order_relaxed);
+        freeListBucket.drains_.store(0, std::memory_order_relaxed);
     }
 }
 
 CentralCache &CentralCache::getInstance()
 {
-    static CentralCache instance;
-    return instance;
+    // never destroyed, like PageCache::getInstance
+    static CentralCache *instance = new CentralCache(PageCache::getInstance());
+    return *instance;
 }
 
-void *CentralCache::allocateBatch(size_t index)
+void *CentralCache::allocateBatch(size_t index, bool *zeroed)
 {
+    if (zeroed)
+        *zeroed = false;
 
     if (index >= Size::FREE_LIST_SIZE)
         return nullptr;
 
-    size_t size = Size::indexToBlockSize(index);
     size_t numBlocks = CentralToThreadStrategy(index);
 
-    SpinLockGuard lock(freeListBuckets_[index].splk);
+    FreeListBucket &bucket = freeListBuckets_[index];
+    SpinLockGuard lock(bucket.splk, &bucket.lockContended_, RealTime::spinBound());
+    if (!lock.ownsLock())
+    {
+        RealTime::noteLockMiss();
+        bucket.realTimeWaiting_.store(true, std::memory_order_relaxed);
+        return nullptr;
+    }
+    addCounter(bucket.lockAcquires_, 1);
+    addCounter(bucket.refills_, 1);
+    if (RealTime::thisThread)
+        bucket.realTimeWaiting_.store(false, std::memory_order_relaxed);
+
+    if (bucket.layout_ == SpanLayout::Bitmap)
+        return allocateFromBitmap(bucket, index, numBlocks);
 
     void *result = freeListBuckets_[index].freelist_;
 
     if (!result)
     {
-        size_t numPages = PageToCentralStrategy(index);
-        result = fetchFromPageCache(index);
-
-        if (!result)
-            return nullptr;
-
-        char *head = static_cast<char *>(result);
-        size_t totalBlocks = (numPages * Size::PAGE_SIZE) / size;
-        size_t allocBlocks = std::min(numBlocks, totalBlocks);
-
+        // Nothing recycled: carve the next blocks out of the bucket's current
+        // span, fetching a fresh one once it is used up. Blocks are linked
+        // only when handed out, so pages nobody asked for are never touched.
+        SpanTracker *tracker = bucket.carving_;
+        if (!tracker)
         {
-            std::unique_lock pmLock(pageMapMutex_);
-
-            uintptr_t spanKey = reinterpret_cast<uintptr_t>(result);
-            SpanTracker &tracker = spanStore_[spanKey];
-            tracker.init(result, numPages, totalBlocks);
-
-            size_t basePage = spanKey / Size::PAGE_SIZE;
-            for (size_t p = 0; p < numPages; ++p)
-                pageMap_[basePage + p] = &tracker;
+            tracker = fetchSpan(index);
+            if (!tracker)
+                return nullptr;
+            bucket.carving_ = tracker;
+            addCounter(bucket.freeBlocks_, tracker->blockCount);
         }
 
-        // Build the list returned to ThreadCache
-        for (size_t i = 1; i < allocBlocks; ++i)
-        {
-            void *current = head + (i - 1) * size;
-            void *next = head + i * size;
-            *reinterpret_cast<void **>(current) = next;
-        }
-        *reinterpret_cast<void **>(head + (allocBlocks - 1) * size) = nullptr;
-
-        // Remaining blocks stay on CentralCache free list
-        if (totalBlocks > allocBlocks)
-        {
-            void *remainStart = head + allocBlocks * size;
-            for (size_t i = allocBlocks + 1; i < totalBlocks; ++i)
-            {
-                void *current = head + (i - 1) * size;
-                void *next = head + i * size;
-                *reinterpret_cast<void **>(current) = next;
-            }
-            *reinterpret_cast<void **>(head + (totalBlocks - 1) * size) = nullptr;
-
-            freeListBuckets_[index].freelist_ = remainStart;
-        }
+        size_t count = 0;
+        result = carveBlocks(*tracker, numBlocks, count);
+        if (zeroed)
+            *zeroed = tracker->zeroed;
+        if (tracker->carvedCount == tracker->blockCount)
+            bucket.carving_ = nullptr;
+
+        addCounter(bucket.freeBlocks_, 0 - count);
+        addCounter(bucket.heldBlocks_, count);
     }
     else
     {
@@ -103,23 +118,143 @@ void *CentralCache::allocateBatch(size_t index)
             *reinterpret_cast<void **>(prev) = nullptr;
 
         freeListBuckets_[index].freelist_ = current;
+        bucket.prewarmedBlocks_ -= std::min(bucket.prewarmedBlocks_, count);
+        addCounter(bucket.freeBlocks_, 0 - count);
+        addCounter(bucket.heldBlocks_, count);
     }
 
     return result;
 }
 
-void *CentralCache::fetchFromPageCache(size_t index)
+void *CentralCache::fetchFromPageCache(size_t index, bool *zeroed)
+{
+    size_t numPages = PageToCentralStrategy(index);
+    return pageCache_.allocateSpan(numPages, zeroed);
+}
+
+// Gets a span from PageCache and registers it in the page map; no block of it
+// is linked yet. Caller holds the bucket lock.
+SpanTracker *CentralCache::fetchSpan(size_t index)
 {
+    bool zeroed = false;
+    void *spanAddr = fetchFromPageCache(index, &zeroed);
+    if (!spanAddr)
+        return nullptr;
+
+    size_t size = Size::indexToBlockSize(index);
     size_t numPages = PageToCentralStrategy(index);
-    return PageCache::getInstance().allocateSpan(numPages);
+    size_t totalBlocks = (numPages * Size::PAGE_SIZE) / size;
+
+    // Cache coloring: spans start page-aligned, so without an offset the
+    // blocks of every span of a class share the same L1 sets. The offset
+    // comes out of the tail slack; classes whose blocks fill the span exactly
+    // (the power-of-two ones among them) give up their last block for it.
+    size_t color = 0;
+    if (cacheColoring_.load(std::memory_order_relaxed))
+    {
+        size_t slack = numPages * Size::PAGE_SIZE - totalBlocks * size;
+        if (slack < Size::CACHE_LINE && size % Size::CACHE_LINE == 0 && totalBlocks > 1)
+        {
+            --totalBlocks;
+            slack += size;
+        }
+        size_t colors = std::min(slack, Size::PAGE_SIZE - Size::CACHE_LINE) / Size::CACHE_LINE + 1;
+        color = freeListBuckets_[index].nextColor_++ % colors * Size::CACHE_LINE;
+    }
+
+    std::unique_lock pmLock(pageMapMutex_);
+
+    SpanTracker *tracker = arena_.create<SpanTracker>();
+    size_t basePage = reinterpret_cast<uintptr_t>(spanAddr) / Size::PAGE_SIZE;
+    size_t mapped = 0;
+    while (tracker && mapped < numPages && pageMap_.set(basePage + mapped, tracker))
+        ++mapped;
+    if (!tracker || mapped < numPages)
+    {
+        // out of metadata memory: undo and report failure
+        for (size_t p = 0; p < mapped; ++p)
+            pageMap_.clear(basePage + p);
+        if (tracker)
+            arena_.destroy(tracker);
+        pmLock.unlock();
+        pageCache_.deallocateSpan(spanAddr, numPages);
+        return nullptr;
+    }
+
+    tracker->init(spanAddr, numPages, totalBlocks, size, color);
+    tracker->zeroed = zeroed;
+    addCounter(spanBytes_, numPages * Size::PAGE_SIZE);
+    return tracker;
+}
+
+// Links up to maxBlocks not-yet-carved blocks of the span into a
+// null-terminated list. Caller holds the bucket lock.
+void *CentralCache::carveBlocks(SpanTracker &tracker, size_t maxBlocks, size_t &count)
+{
+    count = std::min(maxBlocks, tracker.blockCount - tracker.carvedCount);
+    char *head = tracker.blocks() + tracker.carvedCount * tracker.blockSize;
+    for (size_t i = 1; i < count; ++i)
+        *reinterpret_cast<void **>(head + (i - 1) * tracker.blockSize) = head + i * tracker.blockSize;
+    *reinterpret_cast<void **>(head + (count - 1) * tracker.blockSize) = nullptr;
+
+    tracker.carvedCount += count;
+    return head;
+}
+
+void CentralCache::collectStats(PoolStats &stats) const
+{
+    for (const auto &bucket : freeListBuckets_)
+    {
+        stats.centralLockAcquires += bucket.lockAcquires_.load(std::memory_order_relaxed);
+        stats.centralLockContended += bucket.lockContended_.load(std::memory_order_relaxed);
+        size_t blockSize = Size::indexToBlockSize(&bucket - freeListBuckets_.data());
+        stats.centralFreeBytes += bucket.freeBlocks_.load(std::memory_order_relaxed) * blockSize;
+        stats.threadHeldBytes += bucket.heldBlocks_.load(std::memory_order_relaxed) * blockSize;
+    }
+    stats.centralSpanBytes += spanBytes_.load(std::memory_order_relaxed);
+    stats.centralSpansReleased += spansReleased_.load(std::memory_order_relaxed);
+    stats.metadataBytes += arena_.mappedBytes();
+}
+
+void CentralCache::collectClassStats(ClassStats (&classes)[Size::FREE_LIST_SIZE]) const
+{
+    for (size_t index = 0; index < Size::FREE_LIST_SIZE; ++index)
+    {
+        const FreeListBucket &bucket = freeListBuckets_[index];
+        ClassStats &stats = classes[index];
+        stats.blockSize = Size::indexToBlockSize(index);
+        stats.freeBlocks = bucket.freeBlocks_.load(std::memory_order_relaxed);
+        stats.heldBlocks = bucket.heldBlocks_.load(std::memory_order_relaxed);
+        stats.refills = bucket.refills_.load(std::memory_order_relaxed);
+        stats.drains = bucket.drains_.load(std::memory_order_relaxed);
+        stats.lockAcquires = bucket.lockAcquires_.load(std::memory_order_relaxed);
+        stats.lockContended = bucket.lockContended_.load(std::memory_order_relaxed);
+    }
 }
 
-void CentralCache::deallocateBatch(void *ptr, void *tail, size_t numReturn, size_t index)
+bool CentralCache::deallocateBatch(void *ptr, void *tail, size_t numReturn, size_t index)
 {
     if (ptr == nullptr || numReturn == 0 || index >= Size::FREE_LIST_SIZE)
-        return;
+        return true;
 
-    SpinLockGuard lock(freeListBuckets_[index].splk);
+    FreeListBucket &bucket = freeListBuckets_[index];
+    SpinLockGuard lock(bucket.splk, &bucket.lockContended_, RealTime::spinBound());
+    if (!lock.ownsLock())
+    {
+        RealTime::noteLockMiss();
+        bucket.realTimeWaiting_.store(true, std::memory_order_relaxed);
+        return false;
+    }
+    addCounter(bucket.lockAcquires_, 1);
+    addCounter(bucket.drains_, 1);
+    if (RealTime::thisThread)
+        bucket.realTimeWaiting_.store(false, std::memory_order_relaxed);
+
+    if (bucket.layout_ == SpanLayout::Bitmap)
+    {
+        deallocateToBitmap(bucket, ptr, numReturn);
+        return true;
+    }
 
     // Find the last block returned
     // void *tail = ptr;
@@ -133,11 +268,26 @@ void CentralCache::deallocateBatch(void *ptr, void *tail, size_t numReturn, size
     // Splice central head after returned tail
     *reinterpret_cast<void **>(tail) = freeListBuckets_[index].freelist_;
     freeListBuckets_[index].freelist_ = ptr;
+    addCounter(bucket.freeBlocks_, numReturn);
+    addCounter(bucket.heldBlocks_, 0 - numReturn);
 
+    // the reclaim scan is unbounded: real-time threads leave it to reclaimAll
+    if (RealTime::thisThread)
+        return true;
     size_t currentCount = freeListBuckets_[index].delayCounts_ + numReturn;
-    auto currentTime = std::chrono::steady_clock::now();
-    if (shouldReturn(index, currentCount, currentTime))
-        tryReclaimSpans(index);
+    SpanTracker *returned = nullptr;
+    if (backgroundReclaim_.load(std::memory_order_relaxed))
+    {
+        if (currentCount >= MAX_DELAY_COUNT)
+            returned = tryReclaimSpans(index);
+    }
+    else if (shouldReturn(index, currentCount, std::chrono::steady_clock::now()))
+    {
+        returned = tryReclaimSpans(index);
+    }
+    lock.unlock();
+    releaseSpans(returned);
+    return true;
 }
 
 bool CentralCache::shouldReturn(size_t index, size_t currentCount, std::chrono::steady_clock::time_point currentTime)
@@ -149,75 +299,145 @@ bool CentralCache::shouldReturn(size_t index, size_t currentCount, std::chrono::
     return (currentTime - lastTime) >= MAX_DELAY_DURATION;
 }
 
-void CentralCache::tryReclaimSpans(size_t index)
+// Unlinks every span whose carved blocks are all on the free list: one pass
+// counts the free blocks per span, a second unlinks the blocks of the spans
+// found complete. Returns them chained through reclaimNext, for releaseSpans
+// once the caller has dropped the bucket lock. Both passes hold the lock for
+// the whole list, so they give way to real-time threads: one that misses the
+// lock raises realTimeWaiting_ until it next gets it, and a pass that sees the
+// flag stops, undoing what it did, and leaves the spans to a later call.
+SpanTracker *CentralCache::tryReclaimSpans(size_t index)
 {
-    freeListBuckets_[index].delayCounts_ = 0;
-    freeListBuckets_[index].latestRetTime_ = std::chrono::steady_clock::now();
-
-    std::unordered_map<SpanTracker *, size_t> spanFreeCounts;
+    FreeListBucket &bucket = freeListBuckets_[index];
+    bucket.delayCounts_ = 0;
+    bucket.latestRetTime_ = std::chrono::steady_clock::now();
+    auto giveWay = [&bucket](size_t seen)
     {
-        std::shared_lock pmLock(pageMapMutex_);
+        return seen % 64 == 0 && bucket.realTimeWaiting_.load(std::memory_order_relaxed);
+    };
 
-        void *currentBlock = freeListBuckets_[index].freelist_;
-        while (currentBlock)
-        {
-            SpanTracker *tracker = getSpanTracker(currentBlock);
-            if (tracker)
-                spanFreeCounts[tracker]++;
+    std::shared_lock pmLock(pageMapMutex_);
 
-            currentBlock = *reinterpret_cast<void **>(currentBlock);
+    // count free blocks per span in the trackers themselves, chaining the
+    // ones touched; only this bucket (whose lock we hold) uses these fields
+    SpanTracker *touched = nullptr;
+    bool counted = true;
+    size_t seen = 0;
+    for (void *block = bucket.freelist_; block; block = *reinterpret_cast<void **>(block))
+    {
+        if (giveWay(seen++))
+        {
+            counted = false;
+            break;
+        }
+        SpanTracker *tracker = getSpanTracker(block);
+        if (tracker && tracker->reclaimCount++ == 0)
+        {
+            tracker->reclaimNext = touched;
+            touched = tracker;
         }
     }
 
-    for (const auto &[tracker, newFreeBlocks] : spanFreeCounts)
-        returnSpan(tracker, newFreeBlocks, index);
-}
-
-void CentralCache::returnSpan(SpanTracker *tracker, size_t freeCount, size_t index)
-{
-    if (freeCount == tracker->blockCount)
+    // keep the spans every carved block of which is back (the uncarved rest
+    // was never handed out), marked by their non-zero reclaimCount; spans
+    // prewarm carved wait until the bucket has handed out as many blocks
+    SpanTracker *returned = nullptr;
+    size_t pending = 0; // their blocks still on the list
+    while (touched)
     {
-        void *spanAddr = tracker->spanAddr;
-        size_t numPages = tracker->numPages;
-
-        // Remove blocks of this span from free list
-        void *head = freeListBuckets_[index].freelist_;
-        void *newHead = nullptr;
-        void *prev = nullptr;
-        void *current = head;
+        SpanTracker *tracker = touched;
+        touched = tracker->reclaimNext;
+        if (counted && tracker->reclaimCount == tracker->carvedCount &&
+            !(tracker->prewarmed && bucket.prewarmedBlocks_))
+        {
+            tracker->reclaimNext = returned;
+            returned = tracker;
+            pending += tracker->reclaimCount;
+        }
+        else
+        {
+            tracker->reclaimCount = 0;
+            tracker->reclaimNext = nullptr;
+        }
+    }
 
-        while (current)
+    // unlink their blocks into a side list, so that giving way halfway only
+    // has to splice it back in front
+    void *removed = nullptr;
+    void *removedTail = nullptr;
+    void **link = &bucket.freelist_;
+    for (seen = 0; pending; ++seen)
+    {
+        if (giveWay(seen))
         {
-            void *next = *reinterpret_cast<void **>(current);
-            if (current >= spanAddr &&
-                current < static_cast<char *>(spanAddr) + numPages * Size::PAGE_SIZE)
+            if (removed)
             {
-                if (prev)
-                {
-                    *reinterpret_cast<void **>(prev) = next;
-                }
-                else
-                {
-                    newHead = next;
-                }
+                *reinterpret_cast<void **>(removedTail) = bucket.freelist_;
+                bucket.freelist_ = removed;
             }
-            else
+            while (returned)
             {
-                if (!prev)
-                    newHead = current;
-                prev = current;
+                SpanTracker *tracker = returned;
+                returned = tracker->reclaimNext;
+                tracker->reclaimCount = 0;
+                tracker->reclaimNext = nullptr;
             }
-            current = next;
+            return nullptr;
         }
-
-        freeListBuckets_[index].freelist_ = newHead;
-        PageCache::getInstance().deallocateSpan(spanAddr, numPages);
-
+        void *block = *link;
+        SpanTracker *tracker = getSpanTracker(block);
+        if (tracker && tracker->reclaimCount)
+        {
+            *link = *reinterpret_cast<void **>(block);
+            *reinterpret_cast<void **>(block) = removed;
+            if (!removed)
+                removedTail = block;
+            removed = block;
+            --pending;
+        }
+        else
         {
-            std::unique_lock pmLock(pageMapMutex_);
-            unregisterSpan(*tracker);
+            link = reinterpret_cast<void **>(block);
         }
     }
+
+    for (SpanTracker *tracker = returned; tracker; tracker = tracker->reclaimNext)
+    {
+        addCounter(bucket.freeBlocks_, 0 - tracker->blockCount);
+        if (bucket.carving_ == tracker)
+            bucket.carving_ = nullptr;
+    }
+    return returned;
+}
+
+// Releases the spans tryReclaimSpans unlinked; no thread can reach them any
+// more, so without the bucket lock.
+void CentralCache::releaseSpans(SpanTracker *returned)
+{
+    while (returned)
+    {
+        SpanTracker *tracker = returned;
+        returned = tracker->reclaimNext;
+        releaseSpan(tracker);
+    }
+}
+
+// Drops the span's tracker and gives the span back to PageCache. Caller has
+// already unlinked the span and every block of it under the bucket lock, and
+// may have dropped the lock since.
+void CentralCache::releaseSpan(SpanTracker *tracker)
+{
+    void *spanAddr = tracker->spanAddr;
+    size_t numPages = tracker->numPages;
+    {
+        // before PageCache has the pages: a refill of this class could get
+        // them back and register its own tracker for them in the meantime
+        std::unique_lock pmLock(pageMapMutex_);
+        unregisterSpan(*tracker);
+        addCounter(spanBytes_, 0 - numPages * Size::PAGE_SIZE);
+        addCounter(spansReleased_, 1);
+    }
+    pageCache_.deallocateSpan(spanAddr, numPages);
 }
 
 size_t CentralCache::CentralToThreadStrategy(size_t index)
@@ -275,11 +495,10 @@ void CentralCache::unregisterSpan(SpanTracker &tracker)
     size_t basePage = reinterpret_cast<uintptr_t>(addr) / Size::PAGE_SIZE;
     for (size_t p = 0; p < numPages; ++p)
     {
-        pageMap_.erase(basePage + p);
+        pageMap_.clear(basePage + p);
     }
 
-    uintptr_t spanKey = reinterpret_cast<uintptr_t>(addr);
-    spanStore_.erase(spanKey);
+    arena_.destroy(&tracker);
 }
 
 // find which page the block belongs to,
@@ -287,8 +506,297 @@ void CentralCache::unregisterSpan(SpanTracker &tracker)
 SpanTracker *CentralCache::getSpanTracker(void *blockAddr)
 {
     size_t pageNum = reinterpret_cast<uintptr_t>(blockAddr) / Size::PAGE_SIZE;
-    auto it = pageMap_.find(pageNum);
-    if (it != pageMap_.end())
-        return it->second;
-    return nullptr;
-}
\ No newline at end of file
+    return pageMap_.get(pageNum);
+}
+size_t CentralCache::blockSizeOf(const void *ptr)
+{
+    std::shared_lock pmLock(pageMapMutex_);
+    SpanTracker *tracker = getSpanTracker(const_cast<void *>(ptr));
+    if (!tracker)
+        return 0;
+
+    if (static_cast<const char *>(ptr) < tracker->blocks())
+        return 0;
+    size_t offset = static_cast<const char *>(ptr) - tracker->blocks();
+    if (offset % tracker->blockSize != 0 || offset / tracker->blockSize >= tracker->blockCount)
+        return 0;
+    return tracker->blockSize;
+}
+
+bool CentralCache::setSpanLayout(size_t index, SpanLayout layout)
+{
+    if (index >= Size::FREE_LIST_SIZE)
+        return false;
+
+    FreeListBucket &bucket = freeListBuckets_[index];
+    SpinLockGuard lock(bucket.splk, &bucket.lockContended_);
+    if (bucket.layout_ == layout)
+        return true;
+
+    // a span keeps the layout it was carved with, so only switch while the
+    // class has no span at all
+    if (bucket.freeBlocks_.load(std::memory_order_relaxed) != 0 ||
+        bucket.heldBlocks_.load(std::memory_order_relaxed) != 0)
+        return false;
+
+    bucket.layout_ = layout;
+    return true;
+}
+
+static void pushSpan(SpanTracker *&list, SpanTracker *tracker)
+{
+    tracker->prev = nullptr;
+    tracker->next = list;
+    if (list)
+        list->prev = tracker;
+    list = tracker;
+}
+
+static void unlinkSpan(SpanTracker *&list, SpanTracker *tracker)
+{
+    if (tracker->prev)
+        tracker->prev->next = tracker->next;
+    else
+        list = tracker->next;
+    if (tracker->next)
+        tracker->next->prev = tracker->prev;
+    tracker->prev = tracker->next = nullptr;
+}
+
+static size_t bitmapWords(const SpanTracker &tracker)
+{
+    return (tracker.blockCount + 63) / 64;
+}
+
+// Gives a freshly fetched span an all-free bitmap and links it into the
+// bucket's partial_ list. Caller holds the bucket lock.
+bool CentralCache::initBitmap(FreeListBucket &bucket, SpanTracker *tracker)
+{
+    size_t words = bitmapWords(*tracker);
+    tracker->freeBits = static_cast<uint64_t *>(arena_.allocate(words * sizeof(uint64_t)));
+    if (!tracker->freeBits)
+    {
+        releaseSpan(tracker); // no metadata memory left
+        return false;
+    }
+    for (size_t w = 0; w < words; ++w)
+        tracker->freeBits[w] = ~uint64_t(0);
+    if (tracker->blockCount % 64)
+        tracker->freeBits[words - 1] = (uint64_t(1) << (tracker->blockCount % 64)) - 1;
+    tracker->freeCount = tracker->blockCount;
+    tracker->carvedCount = tracker->blockCount;
+    pushSpan(bucket.partial_, tracker);
+    addCounter(bucket.freeBlocks_, tracker->blockCount);
+    return true;
+}
+
+// Hands out up to numBlocks blocks, lowest free bits first, partially used
+// spans before empty ones. Whole free words are taken 64 blocks at a time
+// with countr_zero; the blocks themselves are only written to link the batch.
+void *CentralCache::allocateFromBitmap(FreeListBucket &bucket, size_t index, size_t numBlocks)
+{
+    void *head = nullptr;
+    void **link = &head;
+    size_t count = 0;
+
+    while (count < numBlocks)
+    {
+        SpanTracker *tracker = bucket.partial_;
+        if (!tracker && bucket.empty_)
+        {
+            tracker = bucket.empty_;
+            unlinkSpan(bucket.empty_, tracker);
+            pushSpan(bucket.partial_, tracker);
+        }
+        if (!tracker)
+        {
+            tracker = fetchSpan(index);
+            if (!tracker)
+                break;
+
+            if (!initBitmap(bucket, tracker))
+                break;
+        }
+
+        char *base = tracker->blocks();
+        size_t taken = 0;
+        size_t words = bitmapWords(*tracker);
+        for (size_t w = 0; w < words && count + taken < numBlocks; ++w)
+        {
+            uint64_t bits = tracker->freeBits[w];
+            while (bits && count + taken < numBlocks)
+            {
+                size_t bit = w * 64 + std::countr_zero(bits);
+                bits &= bits - 1;
+                void *block = base + bit * tracker->blockSize;
+                *link = block;
+                link = reinterpret_cast<void **>(block);
+                ++taken;
+            }
+            tracker->freeBits[w] = bits;
+        }
+
+        tracker->freeCount -= taken;
+        count += taken;
+        if (tracker->freeCount == 0)
+            unlinkSpan(bucket.partial_, tracker);
+    }
+
+    *link = nullptr;
+    addCounter(bucket.freeBlocks_, 0 - count);
+    addCounter(bucket.heldBlocks_, count);
+    return head;
+}
+
+// Sets each returned block's bit. A span whose last block comes back moves to
+// the empty list; all but one empty span are given back to PageCache.
+void CentralCache::deallocateToBitmap(FreeListBucket &bucket, void *ptr, size_t numReturn)
+{
+    {
+        std::shared_lock pmLock(pageMapMutex_);
+        void *block = ptr;
+        for (size_t i = 0; i < numReturn && block; ++i)
+        {
+            void *next = *reinterpret_cast<void **>(block);
+            SpanTracker *tracker = getSpanTracker(block);
+            size_t bit = (static_cast<char *>(block) - tracker->blocks()) / tracker->blockSize;
+            tracker->freeBits[bit / 64] |= uint64_t(1) << (bit % 64);
+
+            if (tracker->freeCount++ == 0)
+                pushSpan(bucket.partial_, tracker);
+            if (tracker->freeCount == tracker->blockCount)
+            {
+                unlinkSpan(bucket.partial_, tracker);
+                pushSpan(bucket.empty_, tracker);
+            }
+            block = next;
+        }
+    }
+    addCounter(bucket.freeBlocks_, numReturn);
+    addCounter(bucket.heldBlocks_, 0 - numReturn);
+
+    // PageCache's lock and merges are no place for a real-time thread;
+    // reclaimAll hands the empty spans back later
+    if (RealTime::thisThread)
+        return;
+    while (bucket.empty_ && bucket.empty_->next)
+    {
+        SpanTracker *tracker = bucket.empty_;
+        unlinkSpan(bucket.empty_, tracker);
+        addCounter(bucket.freeBlocks_, 0 - tracker->blockCount);
+        releaseBitmapSpan(tracker);
+    }
+}
+
+void CentralCache::releaseBitmapSpan(SpanTracker *tracker)
+{
+    arena_.deallocate(tracker->freeBits, bitmapWords(*tracker) * sizeof(uint64_t));
+    releaseSpan(tracker);
+}
+
+void CentralCache::reclaimAll()
+{
+    for (size_t index = 0; index < Size::FREE_LIST_SIZE; ++index)
+    {
+        FreeListBucket &bucket = freeListBuckets_[index];
+        // Spans are released once the bucket lock is dropped, and bitmap
+        // classes are emptied one span per hold: a real-time thread waiting
+        // for the lock only waits for an unlink or a scan that gives way.
+        while (true)
+        {
+            SpanTracker *tracker = nullptr;
+            SpanTracker *returned = nullptr;
+            {
+                SpinLockGuard lock(bucket.splk, &bucket.lockContended_);
+                addCounter(bucket.lockAcquires_, 1);
+
+                if (bucket.layout_ == SpanLayout::FreeList)
+                {
+                    if (bucket.freelist_)
+                        returned = tryReclaimSpans(index);
+                }
+                else if (bucket.empty_)
+                {
+                    // the hot path keeps one empty span around; an idle class needs none
+                    tracker = bucket.empty_;
+                    unlinkSpan(bucket.empty_, tracker);
+                    addCounter(bucket.freeBlocks_, 0 - tracker->blockCount);
+                }
+            }
+            releaseSpans(returned);
+            if (!tracker)
+                break;
+            // unlinked with every block free, so no thread can reach it
+            releaseBitmapSpan(tracker);
+        }
+    }
+}
+
+void CentralCache::setBackgroundReclaim(bool on)
+{
+    backgroundReclaim_.store(on, std::memory_order_relaxed);
+}
+
+void CentralCache::setCacheColoring(bool on)
+{
+    cacheColoring_.store(on, std::memory_order_relaxed);
+}
+
+bool CentralCache::reserveMetadata(size_t numPages)
+{
+    // a one-page span of 8-byte blocks needs an 8-word bitmap; longer spans
+    // need proportionally more, so 64 bytes per page covers any layout
+    size_t perPage = ((sizeof(SpanTracker) + 63) & ~size_t(63)) + 64;
+    return arena_.reserve(numPages * perPage + PageMap<SpanTracker>::nodeBytes(numPages));
+}
+
+size_t CentralCache::prewarm(size_t index, size_t numBlocks)
+{
+    if (index >= Size::FREE_LIST_SIZE)
+        return 0;
+
+    FreeListBucket &bucket = freeListBuckets_[index];
+    SpinLockGuard lock(bucket.splk, &bucket.lockContended_);
+    addCounter(bucket.lockAcquires_, 1);
+
+    // carving writes a link into every block, which also faults the pages in;
+    // finish the span being carved lazily first (its blocks already count as free)
+    if (bucket.layout_ == SpanLayout::FreeList && bucket.carving_)
+    {
+        SpanTracker *tracker = bucket.carving_;
+        size_t count = 0;
+        void *head = carveBlocks(*tracker, tracker->blockCount, count);
+        void *tail = static_cast<char *>(head) + (count - 1) * tracker->blockSize;
+        *reinterpret_cast<void **>(tail) = bucket.freelist_;
+        bucket.freelist_ = head;
+        bucket.carving_ = nullptr;
+    }
+
+    while (bucket.freeBlocks_.load(std::memory_order_relaxed) < numBlocks)
+    {
+        SpanTracker *tracker = fetchSpan(index);
+        if (!tracker)
+            break;
+        if (bucket.layout_ == SpanLayout::Bitmap)
+        {
+            if (!initBitmap(bucket, tracker))
+                break;
+            char *base = tracker->blocks();
+            for (size_t b = 0; b < tracker->blockCount; ++b)
+                base[b * tracker->blockSize] = 0;
+            continue;
+        }
+
+        size_t count = 0;
+        void *head = carveBlocks(*tracker, tracker->blockCount, count);
+        void *tail = static_cast<char *>(head) + (count - 1) * tracker->blockSize;
+        *reinterpret_cast<void **>(tail) = bucket.freelist_;
+        bucket.freelist_ = head;
+        // every block is free, so the next reclaim would hand the span
+        // straight back (bitmap spans stay on partial_ until first used)
+        tracker->prewarmed = true;
+        bucket.prewarmedBlocks_ += count;
+        addCounter(bucket.freeBlocks_, count);
+    }
+    return bucket.freeBlocks_.load(std::memory_order_relaxed);
+}
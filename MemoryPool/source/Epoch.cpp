@@ -0,0 +1,263 @@
+#include "../include/Epoch.h"
+#include "../include/MemoryPool.h"
+#include "../include/MetaArena.h"
+#include <iterator>
+#include <mutex>
+#include <new>
+#if defined(__linux__)
+#include <linux/membarrier.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
+namespace
+{
+	// Retired blocks, staged in page-sized chunks from a metadata arena; a
+	// chunk only holds blocks retired in one epoch.
+	struct Entry
+	{
+		void *ptr;
+		size_t size;
+	};
+	struct Chunk
+	{
+		Chunk *next;
+		uint64_t epoch;
+		size_t count;
+		Entry entries[(4096 - 3 * sizeof(size_t)) / sizeof(Entry)];
+	};
+	static_assert(sizeof(Chunk) <= 4096, "chunk must stay within the arena's recycled sizes");
+
+	// blocks retired in epoch e are safe once the global epoch reaches e + 2,
+	// so three slots per thread cover every epoch still waiting
+	constexpr size_t SLOTS = 3;
+	// retires between attempts to advance; each attempt costs a process-wide
+	// barrier when enter() relies on one
+	constexpr size_t ADVANCE_EVERY = 512;
+
+	MetaArena &arena()
+	{
+		// never destroyed: exited threads' chunks may outlive static destruction
+		alignas(MetaArena) static unsigned char storage[sizeof(MetaArena)];
+		static MetaArena *instance = new (storage) MetaArena;
+		return *instance;
+	}
+
+	std::atomic<Epoch::ThreadRecord *> records{nullptr};
+
+	// limbo of exited threads, freed by whichever thread next advances
+	std::mutex orphanLock;
+	Chunk *orphans = nullptr;
+	std::atomic<size_t> orphanCount{0};
+
+	struct ThreadLimbo
+	{
+		Chunk *slots[SLOTS] = {};
+		uint64_t slotEpoch[SLOTS] = {};
+		size_t pending = 0;
+		size_t sinceAdvance = 0;
+		bool registered = false;
+		~ThreadLimbo();
+	};
+	thread_local ThreadLimbo limbo;
+
+	void heavyFence()
+	{
+#if defined(__linux__) && defined(MEMBARRIER_CMD_PRIVATE_EXPEDITED)
+		::syscall(__NR_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0);
+#elif defined(_WIN32)
+		::FlushProcessWriteBuffers();
+#endif
+	}
+
+	void initFence()
+	{
+#if defined(__linux__) && defined(MEMBARRIER_CMD_PRIVATE_EXPEDITED)
+		if (::syscall(__NR_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0) == 0)
+			Epoch::asymmetricFence.store(true, std::memory_order_relaxed);
+#elif defined(_WIN32)
+		Epoch::asymmetricFence.store(true, std::memory_order_relaxed);
+#endif
+	}
+
+	// Frees every block in the list and the chunks themselves; returns the
+	// number of blocks.
+	size_t freeChunks(Chunk *chunk)
+	{
+		size_t blocks = 0;
+		while (chunk)
+		{
+			for (size_t i = 0; i < chunk->count; ++i)
+				MemoryPool::deallocate(chunk->entries[i].ptr, chunk->entries[i].size);
+			blocks += chunk->count;
+			Chunk *next = chunk->next;
+			arena().deallocate(chunk, sizeof(Chunk));
+			chunk = next;
+		}
+		return blocks;
+	}
+
+	// Moves the epoch on if every thread inside a critical section has seen
+	// the current one. True if it advanced (here or on another thread).
+	bool tryAdvance()
+	{
+		uint64_t epoch = Epoch::globalEpoch.load(std::memory_order_seq_cst);
+		if (Epoch::asymmetricFence.load(std::memory_order_relaxed))
+			heavyFence(); // makes readers' announcements visible
+		for (Epoch::ThreadRecord *r = records.load(std::memory_order_acquire); r; r = r->next)
+		{
+			if (!r->inUse.load(std::memory_order_acquire))
+				continue;
+			uint64_t local = r->epoch.load(std::memory_order_seq_cst);
+			if (local != 0 && local != epoch)
+				return false;
+		}
+		Epoch::globalEpoch.compare_exchange_strong(epoch, epoch + 1, std::memory_order_seq_cst);
+		return true;
+	}
+
+	// Frees the calling thread's slots and the orphans that are two epochs old.
+	void collect(ThreadLimbo &l)
+	{
+		uint64_t epoch = Epoch::globalEpoch.load(std::memory_order_seq_cst);
+		for (size_t s = 0; s < SLOTS; ++s)
+		{
+			if (l.slots[s] && l.slotEpoch[s] + 2 <= epoch)
+			{
+				l.pending -= freeChunks(l.slots[s]);
+				l.slots[s] = nullptr;
+			}
+		}
+
+		if (orphanCount.load(std::memory_order_relaxed) == 0)
+			return;
+		Chunk *safe = nullptr;
+		{
+			std::lock_guard<std::mutex> guard(orphanLock);
+			for (Chunk **link = &orphans; *link;)
+			{
+				Chunk *chunk = *link;
+				if (chunk->epoch + 2 <= epoch)
+				{
+					*link = chunk->next;
+					chunk->next = safe;
+					safe = chunk;
+					orphanCount.fetch_sub(chunk->count, std::memory_order_relaxed);
+				}
+				else
+				{
+					link = &chunk->next;
+				}
+			}
+		}
+		freeChunks(safe);
+	}
+
+	ThreadLimbo::~ThreadLimbo()
+	{
+		// The thread cache may already be gone, so nothing is freed here:
+		// staged blocks become orphans for other threads to free.
+		if (Epoch::record)
+		{
+			Epoch::record->epoch.store(0, std::memory_order_release);
+			Epoch::record->inUse.store(false, std::memory_order_release);
+			Epoch::record = nullptr;
+		}
+		std::lock_guard<std::mutex> guard(orphanLock);
+		for (Chunk *&slot : slots)
+		{
+			while (Chunk *chunk = slot)
+			{
+				slot = chunk->next;
+				chunk->next = orphans;
+				orphans = chunk;
+				orphanCount.fetch_add(chunk->count, std::memory_order_relaxed);
+			}
+		}
+	}
+}
+
+namespace Epoch
+{
+	ThreadRecord *registerThread()
+	{
+		static std::once_flag fenceOnce;
+		std::call_once(fenceOnce, initFence);
+		limbo.registered = true; // its destructor gives the record back
+
+		ThreadRecord *rec = nullptr;
+		for (ThreadRecord *r = records.load(std::memory_order_acquire); r && !rec; r = r->next)
+		{
+			bool expected = false;
+			if (!r->inUse.load(std::memory_order_relaxed) && r->inUse.compare_exchange_strong(expected, true))
+				rec = r;
+		}
+		if (!rec)
+		{
+			rec = arena().create<ThreadRecord>();
+			if (!rec)
+				throw std::bad_alloc();
+			rec->inUse.store(true, std::memory_order_relaxed);
+			ThreadRecord *head = records.load(std::memory_order_relaxed);
+			do
+				rec->next = head;
+			while (!records.compare_exchange_weak(head, rec, std::memory_order_release, std::memory_order_relaxed));
+		}
+		record = rec;
+		return rec;
+	}
+
+	void retire(void *ptr, size_t size)
+	{
+		if (!ptr)
+			return;
+		if (!record)
+			registerThread();
+
+		ThreadLimbo &l = limbo;
+		// read after the caller unlinked ptr
+		uint64_t epoch = globalEpoch.load(std::memory_order_seq_cst);
+		size_t slot = epoch % SLOTS;
+		if (l.slotEpoch[slot] != epoch)
+		{
+			// whatever the slot holds was retired three or more epochs ago
+			l.pending -= freeChunks(l.slots[slot]);
+			l.slots[slot] = nullptr;
+			l.slotEpoch[slot] = epoch;
+		}
+
+		Chunk *chunk = l.slots[slot];
+		if (!chunk || chunk->count == std::size(chunk->entries))
+		{
+			chunk = static_cast<Chunk *>(arena().allocate(sizeof(Chunk)));
+			if (!chunk)
+				throw std::bad_alloc();
+			chunk->epoch = epoch;
+			chunk->next = l.slots[slot];
+			l.slots[slot] = chunk;
+		}
+		chunk->entries[chunk->count++] = {ptr, size};
+		++l.pending;
+
+		if (++l.sinceAdvance >= ADVANCE_EVERY)
+		{
+			l.sinceAdvance = 0;
+			if (tryAdvance())
+				collect(l);
+		}
+	}
+
+	size_t flush()
+	{
+		if (!record)
+			registerThread();
+		ThreadLimbo &l = limbo;
+		size_t advanced = 0;
+		while (advanced < SLOTS && tryAdvance())
+			++advanced;
+		collect(l);
+		return l.pending + orphanCount.load(std::memory_order_relaxed);
+	}
+}
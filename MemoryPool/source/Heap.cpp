@@ -0,0 +1,213 @@
+#include "../include/Heap.h"
+#include "../include/ThreadCache.h"
+#include "../include/PageCache.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace
+{
+	std::atomic<uint64_t> nextHeapId{1};
+	std::atomic<size_t> threadCacheCount{0};
+
+	// The heaps not destroyed yet, by id, so threads can tell which of their
+	// caches are stale and memory limit flushes reach every heap. Never
+	// destroyed, like the default tiers: a heap with static storage may
+	// outlive this file's statics.
+	struct LiveHeaps
+	{
+		std::mutex lock;
+		std::unordered_map<uint64_t, mpool::Heap *> ids;
+	};
+	LiveHeaps &liveHeaps()
+	{
+		static LiveHeaps *instance = new LiveHeaps;
+		return *instance;
+	}
+
+	// This thread's caches, one per heap id, plus the last one looked up so
+	// repeated calls on the same heap skip the map.
+	struct ThreadHeaps
+	{
+		uint64_t lastId = 0;
+		ThreadCache *last = nullptr;
+		std::unordered_map<uint64_t, std::unique_ptr<ThreadCache>> caches;
+		void sweep();
+		~ThreadHeaps();
+	};
+	thread_local ThreadHeaps threadHeaps;
+	// A heap with static storage may be destroyed after the main thread's
+	// thread_locals; it must not touch threadHeaps then.
+	thread_local bool threadHeapsGone = false;
+
+	// Frees this thread's caches for heaps deleted or destroy()ed since.
+	void ThreadHeaps::sweep()
+	{
+		LiveHeaps &live = liveHeaps();
+		std::lock_guard<std::mutex> lock(live.lock);
+		for (auto it = caches.begin(); it != caches.end();)
+		{
+			if (live.ids.count(it->first))
+			{
+				++it;
+				continue;
+			}
+			if (lastId == it->first)
+			{
+				lastId = 0;
+				last = nullptr;
+			}
+			it = caches.erase(it);
+			threadCacheCount.fetch_sub(1, std::memory_order_relaxed);
+		}
+	}
+
+	ThreadHeaps::~ThreadHeaps()
+	{
+		threadCacheCount.fetch_sub(caches.size(), std::memory_order_relaxed);
+		threadHeapsGone = true;
+	}
+
+	size_t pagesFor(size_t size)
+	{
+		return (size + Size::PAGE_SIZE - 1) / Size::PAGE_SIZE;
+	}
+}
+
+namespace mpool
+{
+	Heap::Heap()
+	{
+		create();
+	}
+
+	Heap::~Heap()
+	{
+		release();
+	}
+
+	void Heap::create()
+	{
+		id_ = nextHeapId.fetch_add(1, std::memory_order_relaxed);
+		pageCache_ = new PageCache;
+		centralCache_ = new CentralCache(*pageCache_);
+		LiveHeaps &live = liveHeaps();
+		std::lock_guard<std::mutex> lock(live.lock);
+		live.ids.emplace(id_, this);
+	}
+
+	void Heap::release()
+	{
+		{
+			LiveHeaps &live = liveHeaps();
+			std::lock_guard<std::mutex> lock(live.lock);
+			live.ids.erase(id_);
+		}
+		// the calling thread's cache is the only one we can reach; the other
+		// threads' go with their next sweep
+		if (!threadHeapsGone)
+		{
+			if (threadHeaps.lastId == id_)
+			{
+				threadHeaps.lastId = 0;
+				threadHeaps.last = nullptr;
+			}
+			threadCacheCount.fetch_sub(threadHeaps.caches.erase(id_), std::memory_order_relaxed);
+		}
+
+		delete centralCache_;
+		delete pageCache_;
+	}
+
+	void Heap::destroy()
+	{
+		release();
+		create();
+	}
+
+	ThreadCache &Heap::threadCache()
+	{
+		if (threadHeaps.lastId == id_)
+			return *threadHeaps.last;
+
+		auto it = threadHeaps.caches.find(id_);
+		if (it == threadHeaps.caches.end())
+		{
+			// a new cache is rare enough to pay for dropping the stale ones
+			threadHeaps.sweep();
+			it = threadHeaps.caches.emplace(id_, std::unique_ptr<ThreadCache>(new ThreadCache(*centralCache_))).first;
+			it->second->bytesUntilSample_ = PTRDIFF_MAX; // never sample
+			threadCacheCount.fetch_add(1, std::memory_order_relaxed);
+		}
+		threadHeaps.lastId = id_;
+		threadHeaps.last = it->second.get();
+		return *it->second;
+	}
+
+	size_t Heap::threadCaches()
+	{
+		return threadCacheCount.load(std::memory_order_relaxed);
+	}
+
+	void *Heap::allocate(size_t size)
+	{
+		if (size > Size::MAX_ALLOC_SIZE)
+			return pageCache_->allocateSpan(pagesFor(size));
+		return threadCache().allocate(size);
+	}
+
+	void Heap::deallocate(void *ptr, size_t size)
+	{
+		if (ptr == nullptr || size == 0)
+			return;
+		if (size > Size::MAX_ALLOC_SIZE)
+			return pageCache_->deallocateSpan(ptr, pagesFor(size));
+		threadCache().deallocate(ptr, size);
+	}
+
+	bool Heap::setSpanLayout(size_t size, SpanLayout layout)
+	{
+		if (size == 0 || size > Size::MAX_ALLOC_SIZE)
+			return false;
+		return centralCache_->setSpanLayout(Size::sizeToIndex(size), layout);
+	}
+
+	void Heap::setSpanCache(bool enabled)
+	{
+		pageCache_->setSpanCache(enabled);
+	}
+
+	void Heap::setCacheColoring(bool enabled)
+	{
+		centralCache_->setCacheColoring(enabled);
+	}
+
+	size_t Heap::releaseToOS()
+	{
+		return pageCache_->releaseToOS();
+	}
+
+	size_t Heap::releaseAll()
+	{
+		LiveHeaps &live = liveHeaps();
+		// held throughout, so release() waits before deleting the tiers
+		std::lock_guard<std::mutex> lock(live.lock);
+		size_t pages = 0;
+		for (auto &entry : live.ids)
+		{
+			entry.second->centralCache_->reclaimAll();
+			pages += entry.second->releaseToOS();
+		}
+		return pages;
+	}
+
+	PoolStats Heap::getStats() const
+	{
+		PoolStats stats;
+		centralCache_->collectStats(stats);
+		pageCache_->collectStats(stats);
+		return stats;
+	}
+}
@@ -0,0 +1,253 @@
+#include "../include/HeapDebug.h"
+
+#ifdef MPOOL_HEAP_DEBUG
+#include "../include/ThreadCache.h"
+#include "../include/CentralCache.h"
+#include "../include/HeapProfiler.h"
+#include "Size.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#if defined(__GLIBC__) || defined(__APPLE__)
+#include <execinfo.h>
+#define MPOOL_HAVE_BACKTRACE 1
+#endif
+
+namespace
+{
+	// Block layout: [Header][front red zone][user bytes][back red zone + padding]
+	struct Header
+	{
+		uint32_t magic;
+		uint32_t state;
+		size_t size; // requested size
+		void *allocSite[4];
+		void *freeSite[2];
+	};
+
+	constexpr uint32_t MAGIC = 0x4D504F4C; // "MPOL"
+	constexpr uint32_t STATE_LIVE = 1;
+	constexpr uint32_t STATE_QUARANTINED = 2;
+
+	constexpr size_t REDZONE = 16;
+	constexpr size_t USER_OFFSET = sizeof(Header) + REDZONE;
+	constexpr unsigned char REDZONE_BYTE = 0xFA;
+	constexpr unsigned char FRESH_BYTE = 0xCD;
+	constexpr unsigned char FREED_BYTE = 0xDD;
+
+	constexpr size_t QUARANTINE_BYTES = 4 << 20;
+
+	size_t internalSize(size_t size)
+	{
+		return USER_OFFSET + ((size + Size::ALIGNMENT - 1) & ~(Size::ALIGNMENT - 1)) + REDZONE;
+	}
+
+	void abortHandler(HeapDebug::Error, void *, size_t)
+	{
+		std::abort();
+	}
+
+	HeapDebug::ErrorHandler errorHandler = abortHandler;
+
+	// Stores up to n caller frames, skipping this function and its caller.
+	void captureSite(void **site, int n)
+	{
+		for (int i = 0; i < n; ++i)
+			site[i] = nullptr;
+#ifdef MPOOL_HAVE_BACKTRACE
+		void *frames[8];
+		int got = backtrace(frames, 2 + n);
+		for (int i = 2; i < got; ++i)
+			site[i - 2] = frames[i];
+#endif
+	}
+
+	void printSite(const char *label, void *const *site, int n)
+	{
+		int count = 0;
+		while (count < n && site[count])
+			++count;
+		if (count == 0)
+			return;
+		std::fprintf(stderr, "  %s:\n", label);
+#ifdef MPOOL_HAVE_BACKTRACE
+		backtrace_symbols_fd(const_cast<void **>(site), count, 2);
+#endif
+	}
+
+	void report(HeapDebug::Error error, void *ptr, size_t size, const Header *header)
+	{
+		std::fprintf(stderr, "mpool heap error: %s on %p (size %zu)\n", HeapDebug::errorName(error), ptr, size);
+		if (header)
+		{
+			printSite("allocated at", header->allocSite, 4);
+			if (header->state == STATE_QUARANTINED)
+				printSite("freed at", header->freeSite, 2);
+		}
+		void *here[4];
+		captureSite(here, 4);
+		printSite("detected at", here, 4);
+		errorHandler(error, ptr, size);
+	}
+
+	bool filledWith(const unsigned char *p, size_t n, unsigned char value)
+	{
+		for (size_t i = 0; i < n; ++i)
+			if (p[i] != value)
+				return false;
+		return true;
+	}
+
+	// Freed blocks wait here before they become reusable.
+	std::mutex quarantineLock;
+	std::deque<std::pair<char *, size_t>> quarantine; // base, internal size
+	size_t quarantineBytes = 0;
+
+	// caller holds quarantineLock
+	void release(char *base, size_t internal)
+	{
+		Header *header = reinterpret_cast<Header *>(base);
+		quarantineBytes -= internal;
+
+		unsigned char *user = reinterpret_cast<unsigned char *>(base + USER_OFFSET);
+		if (header->magic != MAGIC || header->state != STATE_QUARANTINED ||
+			internalSize(header->size) != internal || !filledWith(user, header->size, FREED_BYTE))
+		{
+			report(HeapDebug::Error::UseAfterFree, user, internal - USER_OFFSET - REDZONE,
+				   header->magic == MAGIC ? header : nullptr);
+			return;
+		}
+		header->magic = 0;
+		ThreadCache::getInstance().deallocate(base, internal);
+	}
+}
+
+namespace HeapDebug
+{
+	const char *errorName(Error error)
+	{
+		switch (error)
+		{
+		case Error::DoubleFree:
+			return "double free";
+		case Error::InvalidPointer:
+			return "free of a pointer not allocated by the pool";
+		case Error::WrongSizeClass:
+			return "free with a size from a different size class";
+		case Error::SizeMismatch:
+			return "free with a size different from the allocation";
+		case Error::BufferUnderflow:
+			return "write before the start of the block";
+		case Error::BufferOverflow:
+			return "write past the end of the block";
+		case Error::UseAfterFree:
+			return "write to a freed block";
+		}
+		return "unknown error";
+	}
+
+	void setErrorHandler(ErrorHandler handler)
+	{
+		errorHandler = handler ? handler : abortHandler;
+	}
+
+	void *allocate(size_t size)
+	{
+		if (size == 0)
+			return nullptr;
+
+		size_t internal = internalSize(size);
+		char *base = static_cast<char *>(ThreadCache::getInstance().allocate(internal));
+		if (!base)
+			return nullptr;
+
+		Header *header = reinterpret_cast<Header *>(base);
+		header->magic = MAGIC;
+		header->state = STATE_LIVE;
+		header->size = size;
+		captureSite(header->allocSite, 4);
+		header->freeSite[0] = header->freeSite[1] = nullptr;
+
+		char *user = base + USER_OFFSET;
+		std::memset(base + sizeof(Header), REDZONE_BYTE, REDZONE);
+		std::memset(user, FRESH_BYTE, size);
+		std::memset(user + size, REDZONE_BYTE, internal - USER_OFFSET - size);
+		return user;
+	}
+
+	void deallocate(void *ptr, size_t size)
+	{
+		if (ptr == nullptr || size == 0)
+			return;
+
+		char *user = static_cast<char *>(ptr);
+		char *base = user - USER_OFFSET;
+		Header *header = reinterpret_cast<Header *>(base);
+
+		if (header->magic != MAGIC)
+			return report(Error::InvalidPointer, ptr, size, nullptr);
+		if (header->state == STATE_QUARANTINED)
+			return report(Error::DoubleFree, ptr, size, header);
+		if (header->state != STATE_LIVE)
+			return report(Error::InvalidPointer, ptr, size, nullptr);
+
+		// pool blocks must belong to a live span of the class the caller names
+		size_t internal = internalSize(header->size);
+		if (internal <= Size::MAX_ALLOC_SIZE && !HeapProfiler::isSampled(base))
+		{
+			size_t spanBlockSize = CentralCache::getInstance().blockSizeOf(base);
+			if (spanBlockSize == 0)
+				return report(Error::InvalidPointer, ptr, size, header);
+			size_t callerInternal = internalSize(size);
+			if (callerInternal > Size::MAX_ALLOC_SIZE ||
+				Size::indexToBlockSize(Size::sizeToIndex(callerInternal)) != spanBlockSize)
+				return report(Error::WrongSizeClass, ptr, size, header);
+		}
+		if (header->size != size)
+			return report(Error::SizeMismatch, ptr, size, header);
+
+		const unsigned char *front = reinterpret_cast<unsigned char *>(base + sizeof(Header));
+		if (!filledWith(front, REDZONE, REDZONE_BYTE))
+			return report(Error::BufferUnderflow, ptr, size, header);
+		const unsigned char *back = reinterpret_cast<unsigned char *>(user + size);
+		if (!filledWith(back, internal - USER_OFFSET - size, REDZONE_BYTE))
+			return report(Error::BufferOverflow, ptr, size, header);
+
+		header->state = STATE_QUARANTINED;
+		captureSite(header->freeSite, 2);
+		std::memset(user, FREED_BYTE, size);
+
+		std::lock_guard<std::mutex> lock(quarantineLock);
+		quarantine.push_back({base, internal});
+		quarantineBytes += internal;
+		while (quarantineBytes > QUARANTINE_BYTES)
+		{
+			auto [oldest, oldestSize] = quarantine.front();
+			quarantine.pop_front();
+			release(oldest, oldestSize);
+		}
+	}
+
+	size_t usableSize(const void *ptr)
+	{
+		if (ptr == nullptr)
+			return 0;
+		const Header *header = reinterpret_cast<const Header *>(static_cast<const char *>(ptr) - USER_OFFSET);
+		return header->magic == MAGIC && header->state == STATE_LIVE ? header->size : 0;
+	}
+
+	void flushQuarantine()
+	{
+		std::lock_guard<std::mutex> lock(quarantineLock);
+		while (!quarantine.empty())
+		{
+			auto [oldest, oldestSize] = quarantine.front();
+			quarantine.pop_front();
+			release(oldest, oldestSize);
+		}
+	}
+}
+#endif
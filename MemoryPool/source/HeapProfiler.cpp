@@ -0,0 +1,213 @@
+#include "../include/HeapProfiler.h"
+#include "Size.h"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <vector>
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+#if defined(__GLIBC__) || defined(__APPLE__)
+#include <execinfo.h>
+#define MPOOL_HAVE_BACKTRACE 1
+#endif
+
+namespace
+{
+	// One page per sampled object: the object at the start, its record in the
+	// tail (objects are at most MAX_ALLOC_SIZE, half a page).
+	constexpr size_t MAX_SAMPLES = 16384;
+	constexpr int MAX_DEPTH = 30;
+	constexpr std::ptrdiff_t DISABLED_INTERVAL = 1 << 20;
+
+	struct Record
+	{
+		size_t size;
+		int depth;
+		void *stack[MAX_DEPTH];
+	};
+	static_assert(Size::MAX_ALLOC_SIZE + sizeof(Record) <= Size::PAGE_SIZE, "record must fit in the page tail");
+
+	std::atomic<size_t> rate{0};
+
+	// region bookkeeping, guarded by lock
+	std::mutex lock;
+	char *region = nullptr;
+	uint32_t freeSlots[MAX_SAMPLES];
+	size_t numFree = 0;
+	uint64_t liveSlots[MAX_SAMPLES / 64];
+
+	thread_local uint64_t rngState = 0;
+
+	Record *recordOf(size_t slot)
+	{
+		return reinterpret_cast<Record *>(region + slot * Size::PAGE_SIZE + Size::MAX_ALLOC_SIZE);
+	}
+
+	// caller holds lock
+	bool reserveRegion()
+	{
+		if (region)
+			return true;
+		size_t bytes = MAX_SAMPLES * Size::PAGE_SIZE;
+#if defined(_WIN32)
+		void *ptr = ::VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+		if (!ptr)
+			return false;
+#else
+		void *ptr = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (ptr == MAP_FAILED)
+			return false;
+#endif
+		region = static_cast<char *>(ptr);
+		for (size_t i = 0; i < MAX_SAMPLES; ++i)
+			freeSlots[i] = static_cast<uint32_t>(MAX_SAMPLES - 1 - i);
+		numFree = MAX_SAMPLES;
+		HeapProfiler::regionSize.store(bytes, std::memory_order_relaxed);
+		HeapProfiler::regionBase.store(reinterpret_cast<uintptr_t>(region), std::memory_order_release);
+		return true;
+	}
+
+	// xorshift64*, seeded per thread from its own address
+	double nextUniform()
+	{
+		if (rngState == 0)
+			rngState = reinterpret_cast<uintptr_t>(&rngState) | 1;
+		rngState ^= rngState >> 12;
+		rngState ^= rngState << 25;
+		rngState ^= rngState >> 27;
+		uint64_t r = rngState * 0x2545F4914F6CDD1DULL;
+		return (static_cast<double>(r >> 11) + 1.0) / 9007199254740992.0; // (0, 1]
+	}
+}
+
+namespace HeapProfiler
+{
+	void setSampleRate(size_t bytes)
+	{
+		if (bytes)
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			if (!reserveRegion())
+				return;
+		}
+		rate.store(bytes, std::memory_order_relaxed);
+	}
+
+	size_t sampleRate()
+	{
+		return rate.load(std::memory_order_relaxed);
+	}
+
+	std::ptrdiff_t nextSampleInterval()
+	{
+		size_t r = rate.load(std::memory_order_relaxed);
+		if (r == 0)
+			return DISABLED_INTERVAL;
+		// exponential with mean r: the gap between Poisson arrivals over bytes
+		double interval = -std::log(nextUniform()) * static_cast<double>(r);
+		return static_cast<std::ptrdiff_t>(std::min(interval, 1e15));
+	}
+
+	void *allocateSampled(size_t size)
+	{
+		if (rate.load(std::memory_order_relaxed) == 0 || size > Size::MAX_ALLOC_SIZE)
+			return nullptr;
+
+		Record record;
+		record.size = size;
+		record.depth = 0;
+#ifdef MPOOL_HAVE_BACKTRACE
+		// skip this frame; the ThreadCache frames below it (how many depends
+		// on inlining) are the same for every sample
+		void *frames[MAX_DEPTH + 1];
+		int got = backtrace(frames, MAX_DEPTH + 1);
+		for (int i = 1; i < got; ++i)
+			record.stack[record.depth++] = frames[i];
+#endif
+
+		std::lock_guard<std::mutex> guard(lock);
+		if (numFree == 0)
+			return nullptr;
+		size_t slot = freeSlots[--numFree];
+		liveSlots[slot / 64] |= uint64_t(1) << (slot % 64);
+		*recordOf(slot) = record;
+		return region + slot * Size::PAGE_SIZE;
+	}
+
+	void deallocateSampled(void *ptr)
+	{
+		size_t slot = (static_cast<char *>(ptr) - region) / Size::PAGE_SIZE;
+		std::lock_guard<std::mutex> guard(lock);
+		liveSlots[slot / 64] &= ~(uint64_t(1) << (slot % 64));
+		freeSlots[numFree++] = static_cast<uint32_t>(slot);
+#if !defined(_WIN32)
+		// a sampled page is rarely reused soon; give it back
+		::madvise(region + slot * Size::PAGE_SIZE, Size::PAGE_SIZE, MADV_DONTNEED);
+#endif
+	}
+
+	size_t sampledSize(const void *ptr)
+	{
+		// the record is written before the object is handed out and only
+		// changes once it is freed, so the owner can read it without the lock
+		return recordOf((static_cast<const char *>(ptr) - region) / Size::PAGE_SIZE)->size;
+	}
+
+	bool dumpHeapProfile(const char *path)
+	{
+		// live samples grouped by stack: count, bytes
+		std::map<std::vector<void *>, std::pair<size_t, size_t>> byStack;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			for (size_t w = 0; region && w < MAX_SAMPLES / 64; ++w)
+			{
+				for (uint64_t bits = liveSlots[w]; bits; bits &= bits - 1)
+				{
+					const Record *rec = recordOf(w * 64 + std::countr_zero(bits));
+					auto &entry = byStack[std::vector<void *>(rec->stack, rec->stack + rec->depth)];
+					entry.first += 1;
+					entry.second += rec->size;
+				}
+			}
+		}
+
+		FILE *out = std::fopen(path, "w");
+		if (!out)
+			return false;
+
+		// pprof scales heap_v2 samples back up by the sampling rate itself
+		size_t totalCount = 0, totalBytes = 0;
+		for (auto &[stack, entry] : byStack)
+		{
+			totalCount += entry.first;
+			totalBytes += entry.second;
+		}
+		std::fprintf(out, "heap profile: %6zu: %8zu [%6zu: %8zu] @ heap_v2/%zu\n", totalCount, totalBytes,
+					 totalCount, totalBytes, sampleRate());
+		for (auto &[stack, entry] : byStack)
+		{
+			std::fprintf(out, "%6zu: %8zu [%6zu: %8zu] @", entry.first, entry.second, entry.first, entry.second);
+			for (void *pc : stack)
+				std::fprintf(out, " %p", pc);
+			std::fputc('\n', out);
+		}
+
+		// symbolization needs the load addresses
+		std::fputs("\nMAPPED_LIBRARIES:\n", out);
+		if (FILE *maps = std::fopen("/proc/self/maps", "r"))
+		{
+			char buf[4096];
+			size_t n;
+			while ((n = std::fread(buf, 1, sizeof(buf), maps)) > 0)
+				std::fwrite(buf, 1, n, out);
+			std::fclose(maps);
+		}
+		return std::fclose(out) == 0;
+	}
+}
@@ -0,0 +1,85 @@
+#include "../include/Maintenance.h"
+#include "../include/ThreadCache.h"
+#include "../include/CentralCache.h"
+#include "../include/PageCache.h"
+#include "../include/Epoch.h"
+
+Maintenance &Maintenance::getInstance()
+{
+	static Maintenance instance;
+	return instance;
+}
+
+Maintenance::Maintenance()
+{
+	// constructed first, so they are destroyed after the thread is joined
+	CentralCache::getInstance();
+	PageCache::getInstance();
+}
+
+Maintenance::~Maintenance()
+{
+	stop();
+}
+
+void Maintenance::start(std::chrono::milliseconds period)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	period_ = period;
+	if (thread_.joinable())
+	{
+		wake_.notify_one();
+		return;
+	}
+	stopping_ = false;
+	CentralCache::getInstance().setBackgroundReclaim(true);
+	thread_ = std::thread(&Maintenance::loop, this);
+}
+
+void Maintenance::stop()
+{
+	std::thread thread;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (!thread_.joinable())
+			return;
+		stopping_ = true;
+		thread = std::move(thread_);
+	}
+	wake_.notify_one();
+	thread.join();
+	CentralCache::getInstance().setBackgroundReclaim(false);
+}
+
+bool Maintenance::running()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return thread_.joinable();
+}
+
+void Maintenance::runOnce()
+{
+	// thread caches trim asynchronously; what they return is picked up by
+	// the next pass
+	ThreadCache::requestTrim();
+	// also frees what exited threads retired, so it does not wait for the
+	// next retire elsewhere
+	Epoch::flush();
+	CentralCache::getInstance().reclaimAll();
+	PageCache::getInstance().releaseToOS();
+}
+
+void Maintenance::loop()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (!stopping_)
+	{
+		// a new period (start() while running) restarts the wait
+		auto period = period_;
+		if (wake_.wait_for(lock, period, [&] { return stopping_ || period_ != period; }))
+			continue;
+		lock.unlock();
+		runOnce();
+		lock.lock();
+	}
+}
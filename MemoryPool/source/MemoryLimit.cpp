@@ -0,0 +1,290 @@
+#include "../include/MemoryLimit.h"
+#include "../include/Heap.h"
+#include "../include/Maintenance.h"
+#include <algorithm>
+#include <cstdint>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+
+namespace
+{
+	std::atomic<size_t> softBytes{0};
+	std::atomic<size_t> hardBytes{0};
+	std::atomic<size_t> footprintBytes{0};
+	// footprint after the last flush; the next soft-limit flush waits for it
+	// to grow by flushStep, which doubles while flushes leave it over the limit
+	std::atomic<size_t> flushedAt{0};
+	std::atomic<size_t> flushStep{0};
+	std::atomic<size_t> flushCount{0};
+	std::atomic<MemoryLimit::Handler> handlerFn{nullptr};
+	std::mutex flushLock;
+
+	// set by tryGrow on the thread whose allocation was refused
+	thread_local bool refused = false;
+	thread_local size_t refusedBytes = 0;
+
+	void noteGrowth(size_t now)
+	{
+		size_t soft = softBytes.load(std::memory_order_relaxed);
+		if (soft && now > soft && now >= flushedAt.load(std::memory_order_relaxed) + flushStep.load(std::memory_order_relaxed))
+			MemoryLimit::flushRequested.store(true, std::memory_order_relaxed);
+	}
+
+	// "some avg10=" of a PSI file; -1 if absent
+	double readSomeAvg10(const std::string &path)
+	{
+		std::ifstream in(path);
+		std::string word;
+		while (in >> word)
+		{
+			if (word == "some" && in >> word && word.compare(0, 6, "avg10=") == 0)
+				return std::stod(word.substr(6));
+		}
+		return -1;
+	}
+
+	// memory.current; 0 if absent
+	size_t readCurrent(const std::string &path)
+	{
+		std::ifstream in(path);
+		size_t bytes = 0;
+		in >> bytes;
+		return bytes;
+	}
+
+	// the calling process's cgroup v2 directory, from /proc/self/cgroup
+	std::string ownCgroup()
+	{
+		std::ifstream in("/proc/self/cgroup");
+		for (std::string line; std::getline(in, line);)
+		{
+			if (line.compare(0, 3, "0::") == 0)
+				return "/sys/fs/cgroup" + line.substr(3);
+		}
+		return "/sys/fs/cgroup";
+	}
+
+	class PressureWatcher
+	{
+	public:
+		static PressureWatcher &getInstance()
+		{
+			static PressureWatcher instance;
+			return instance;
+		}
+
+		void start(std::string dir, double someAvg10, size_t currentBytes, std::chrono::milliseconds period)
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			dir_ = std::move(dir);
+			someAvg10_ = someAvg10;
+			currentBytes_ = currentBytes;
+			period_ = period;
+			++generation_;
+			if (thread_.joinable())
+			{
+				wake_.notify_one();
+				return;
+			}
+			stopping_ = false;
+			thread_ = std::thread(&PressureWatcher::loop, this);
+		}
+
+		void stop()
+		{
+			std::thread thread;
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				if (!thread_.joinable())
+					return;
+				stopping_ = true;
+				thread = std::move(thread_);
+			}
+			wake_.notify_one();
+			thread.join();
+		}
+
+	private:
+		PressureWatcher()
+		{
+			// constructed first, so it is destroyed after the thread is joined
+			Maintenance::getInstance();
+		}
+		~PressureWatcher()
+		{
+			stop();
+		}
+
+		void loop()
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			size_t cooldown = 0;
+			while (!stopping_)
+			{
+				size_t generation = generation_;
+				if (wake_.wait_for(lock, period_, [&] { return stopping_ || generation_ != generation; }))
+				{
+					cooldown = 0;
+					continue;
+				}
+				if (cooldown > 0)
+				{
+					--cooldown;
+					continue;
+				}
+				std::string dir = dir_;
+				double someAvg10 = someAvg10_;
+				size_t currentBytes = currentBytes_;
+				lock.unlock();
+
+				bool pressed = someAvg10 > 0 && readSomeAvg10(dir + "/memory.pressure") >= someAvg10;
+				pressed = pressed || (currentBytes > 0 && readCurrent(dir + "/memory.current") >= currentBytes);
+				if (pressed)
+				{
+					MemoryLimit::flush();
+					cooldown = 10;
+				}
+				lock.lock();
+			}
+		}
+
+		std::mutex mutex_;
+		std::condition_variable wake_;
+		std::thread thread_;
+		std::string dir_;
+		double someAvg10_ = 0;
+		size_t currentBytes_ = 0;
+		std::chrono::milliseconds period_{100};
+		size_t generation_ = 0;
+		bool stopping_ = false;
+	};
+}
+
+namespace MemoryLimit
+{
+	void setSoftLimit(size_t bytes)
+	{
+		softBytes.store(bytes, std::memory_order_relaxed);
+		flushedAt.store(0, std::memory_order_relaxed);
+		flushStep.store(bytes / 16, std::memory_order_relaxed);
+		noteGrowth(footprintBytes.load(std::memory_order_relaxed));
+	}
+
+	void setHardLimit(size_t bytes)
+	{
+		hardBytes.store(bytes, std::memory_order_relaxed);
+	}
+
+	size_t softLimit()
+	{
+		return softBytes.load(std::memory_order_relaxed);
+	}
+
+	size_t hardLimit()
+	{
+		return hardBytes.load(std::memory_order_relaxed);
+	}
+
+	size_t footprint()
+	{
+		return footprintBytes.load(std::memory_order_relaxed);
+	}
+
+	size_t flushes()
+	{
+		return flushCount.load(std::memory_order_relaxed);
+	}
+
+	void setHandler(Handler h)
+	{
+		handlerFn.store(h, std::memory_order_relaxed);
+	}
+
+	bool watchPressure(const char *cgroupDir, double someAvg10, size_t currentBytes, std::chrono::milliseconds period)
+	{
+		std::string dir = cgroupDir ? cgroupDir : ownCgroup();
+		if (!std::ifstream(dir + "/memory.pressure") && !std::ifstream(dir + "/memory.current"))
+			return false;
+		PressureWatcher::getInstance().start(std::move(dir), someAvg10, currentBytes, period);
+		return true;
+	}
+
+	void stopWatchingPressure()
+	{
+		PressureWatcher::getInstance().stop();
+	}
+
+	bool tryGrow(size_t bytes)
+	{
+		size_t hard = hardBytes.load(std::memory_order_relaxed);
+		size_t current = footprintBytes.load(std::memory_order_relaxed);
+		do
+		{
+			if (hard && current + bytes > hard)
+			{
+				refused = true;
+				refusedBytes = bytes;
+				flushRequested.store(true, std::memory_order_relaxed);
+				return false;
+			}
+		} while (!footprintBytes.compare_exchange_weak(current, current + bytes, std::memory_order_relaxed));
+		noteGrowth(current + bytes);
+		return true;
+	}
+
+	void grow(size_t bytes)
+	{
+		noteGrowth(footprintBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+	}
+
+	void shrink(size_t bytes)
+	{
+		footprintBytes.fetch_sub(bytes, std::memory_order_relaxed);
+	}
+
+	void flush()
+	{
+		// one flush at a time; a thread arriving during one has nothing to add
+		std::unique_lock<std::mutex> lock(flushLock, std::try_to_lock);
+		if (!lock.owns_lock())
+			return;
+		flushRequested.store(false, std::memory_order_relaxed);
+		Maintenance::getInstance().runOnce();
+		mpool::Heap::releaseAll();
+		flushCount.fetch_add(1, std::memory_order_relaxed);
+		size_t now = footprintBytes.load(std::memory_order_relaxed);
+		size_t soft = softBytes.load(std::memory_order_relaxed);
+		// a limit the live data alone exceeds cannot be flushed down to: back
+		// off, by at least a sixteenth of the footprint, rather than flush on
+		// every sixteenth of the limit
+		size_t step = soft / 16;
+		if (soft && now > soft)
+			step = std::max(now / 16, std::min(flushStep.load(std::memory_order_relaxed), SIZE_MAX / 4) * 2);
+		flushStep.store(step, std::memory_order_relaxed);
+		flushedAt.store(now, std::memory_order_relaxed);
+	}
+
+	bool recover(unsigned attempt)
+	{
+		if (!refused)
+			return false; // not the limit: out of memory for real
+		refused = false;
+		if (attempt == 0)
+		{
+			flush();
+			return true;
+		}
+		if (Handler h = handlerFn.load(std::memory_order_relaxed))
+			return h(refusedBytes);
+		if (std::new_handler h = std::get_new_handler())
+		{
+			h(); // frees memory, or throws
+			return true;
+		}
+		return false;
+	}
+}
@@ -0,0 +1,105 @@
+#include "../include/MetaArena.h"
+#include "../include/SpinLockGuard.h"
+#include <cstring>
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+MetaArena::~MetaArena()
+{
+	while (chunks_)
+	{
+		Chunk *chunk = chunks_;
+		chunks_ = chunk->next;
+#if defined(_WIN32)
+		::VirtualFree(chunk, 0, MEM_RELEASE);
+#else
+		::munmap(chunk, chunk->size);
+#endif
+	}
+}
+
+// Maps a chunk of at least `bytes` and links it for the destructor.
+// Caller holds lock_.
+MetaArena::Chunk *MetaArena::mapChunk(size_t bytes, bool populate)
+{
+#if defined(_WIN32)
+	void *ptr = ::VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	if (!ptr)
+		return nullptr;
+#else
+	void *ptr = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ptr == MAP_FAILED)
+		return nullptr;
+#endif
+	if (populate)
+		for (size_t off = 0; off < bytes; off += 4096)
+			static_cast<volatile char *>(ptr)[off] = 0;
+	Chunk *chunk = static_cast<Chunk *>(ptr);
+	chunk->size = bytes;
+	chunk->next = chunks_;
+	chunks_ = chunk;
+	mappedBytes_.store(mappedBytes_.load(std::memory_order_relaxed) + bytes, std::memory_order_relaxed);
+	return chunk;
+}
+
+void *MetaArena::allocate(size_t bytes)
+{
+	size_t rounded = (bytes + GRAIN - 1) & ~(GRAIN - 1);
+	SpinLockGuard guard(lock_);
+
+	if (rounded <= MAX_SMALL)
+	{
+		FreeBlock *&list = freeLists_[rounded / GRAIN - 1];
+		if (list)
+		{
+			FreeBlock *block = list;
+			list = block->next;
+			std::memset(block, 0, rounded);
+			return block;
+		}
+	}
+
+	if (static_cast<size_t>(bumpEnd_ - bump_) < rounded)
+	{
+		// the rest of the current chunk is abandoned
+		size_t size = rounded + GRAIN > CHUNK_SIZE ? rounded + GRAIN : CHUNK_SIZE;
+		Chunk *chunk = mapChunk(size);
+		if (!chunk)
+			return nullptr;
+		bump_ = reinterpret_cast<char *>(chunk) + GRAIN;
+		bumpEnd_ = reinterpret_cast<char *>(chunk) + size;
+	}
+	void *ptr = bump_;
+	bump_ += rounded;
+	return ptr;
+}
+
+bool MetaArena::reserve(size_t bytes)
+{
+	size_t rounded = (bytes + GRAIN - 1) & ~(GRAIN - 1);
+	SpinLockGuard guard(lock_);
+	if (static_cast<size_t>(bumpEnd_ - bump_) >= rounded)
+		return true;
+	// the rest of the current chunk is abandoned, as in allocate
+	Chunk *chunk = mapChunk(rounded + GRAIN, true);
+	if (!chunk)
+		return false;
+	bump_ = reinterpret_cast<char *>(chunk) + GRAIN;
+	bumpEnd_ = bump_ + rounded;
+	return true;
+}
+
+void MetaArena::deallocate(void *ptr, size_t bytes)
+{
+	size_t rounded = (bytes + GRAIN - 1) & ~(GRAIN - 1);
+	if (ptr == nullptr || rounded > MAX_SMALL)
+		return;
+
+	SpinLockGuard guard(lock_);
+	FreeBlock *block = static_cast<FreeBlock *>(ptr);
+	block->next = freeLists_[rounded / GRAIN - 1];
+	freeLists_[rounded / GRAIN - 1] = block;
+}
@@ -1,171 +1,479 @@
 #include "../include/PageCache.h"
+#include "../include/MemoryLimit.h"
+#include "../include/RealTime.h"
+#include "../include/SpinLockGuard.h"
 #include "Size.h"
+#include <algorithm>
 #if defined(_WIN32)
 #include <windows.h>
 #else
 #include <sys/mman.h>
 #endif
+#if defined(__linux__)
+#include <sched.h>
+#endif
 
-void *PageCache::allocateSpan(size_t numPages)
+// single writer (mutexLock held); readers in collectStats may be racy
+static inline void addCounter(std::atomic<size_t> &counter, size_t delta)
 {
-	std::lock_guard<std::mutex> lock(mutexLock);
+	counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
 
-	auto it = freeSpans_.lower_bound(numPages);
-	if (it != freeSpans_.end())
+// Takes mutexLock, counting acquisitions and the ones that had to wait.
+std::unique_lock<std::mutex> PageCache::lockPageCache(size_t maxSpins)
+{
+	std::unique_lock<std::mutex> lock(mutexLock, std::try_to_lock);
+	if (!lock.owns_lock())
 	{
-		// remove spanToReturn from the freeSpans_ list
-		Span *spanToReturn = it->second;
-		if (spanToReturn->next)
-			freeSpans_[it->first] = spanToReturn->next;
-		else
-			freeSpans_.erase(it);
-		void *oldEnd = static_cast<char *>(spanToReturn->addr) + spanToReturn->numPages * Size::PAGE_SIZE;
-		endMap_.erase(oldEnd);
-
-		if (spanToReturn->numPages > numPages)
+		lockContended_.fetch_add(1, std::memory_order_relaxed);
+		if (!maxSpins)
+			lock.lock();
+		for (size_t spin = 1; spin < maxSpins && !lock.try_lock(); ++spin)
+		{
+		}
+		if (!lock.owns_lock())
 		{
-			void *newSpanAddr = static_cast<char *>(spanToReturn->addr) + numPages * Size::PAGE_SIZE;
+			RealTime::noteLockMiss();
+			return lock;
+		}
+	}
+	addCounter(lockAcquires_, 1);
+	return lock;
+}
 
-			Span *newSpan = allocSpanMeta();
-			newSpan->numPages = spanToReturn->numPages - numPages;
-			newSpan->addr = newSpanAddr;
+PageCache::~PageCache()
+{
+	// released free pages were already taken off the footprint
+	size_t released = 0;
+	for (Span *head : freeSpans_)
+		for (Span *span = head; span; span = span->next)
+			if (span->released)
+				released += span->numPages;
+	MemoryLimit::shrink((mappedPages_.load(std::memory_order_relaxed) - released) * Size::PAGE_SIZE);
+	for (Region *region = regions_; region; region = region->next)
+		systemFree(region->addr, region->numPages);
+}
 
-			// head insertion to add the newSpan to freeSpans_ list
-			newSpan->next = freeSpans_[newSpan->numPages];
-			freeSpans_[newSpan->numPages] = newSpan;
+void PageCache::collectStats(PoolStats &stats) const
+{
+	stats.pageLockAcquires += lockAcquires_.load(std::memory_order_relaxed);
+	stats.pageLockContended += lockContended_.load(std::memory_order_relaxed);
+	stats.mappedBytes += mappedPages_.load(std::memory_order_relaxed) * Size::PAGE_SIZE;
+	stats.pageFreeBytes += freePages_.load(std::memory_order_relaxed) * Size::PAGE_SIZE;
+	stats.pageReleasedBytes += releasedPages_.load(std::memory_order_relaxed) * Size::PAGE_SIZE;
+	stats.metadataBytes += arena_.mappedBytes();
+	for (const SpanSlot &slot : spanSlots_)
+	{
+		stats.pageCachedBytes += slot.pages.load(std::memory_order_relaxed) * Size::PAGE_SIZE;
+		stats.spanCacheHits += slot.hits.load(std::memory_order_relaxed);
+	}
+}
 
-			spanMap_[newSpanAddr] = newSpan;
+static size_t pageOf(const void *addr)
+{
+	return reinterpret_cast<uintptr_t>(addr) / Size::PAGE_SIZE;
+}
 
-			void *newEnd = static_cast<char *>(newSpanAddr) + newSpan->numPages * Size::PAGE_SIZE;
-			endMap_[newEnd] = newSpan;
+// The slot for the CPU the caller runs on; it may migrate right after, which
+// only costs locality.
+static size_t currentSpanSlot(size_t slots)
+{
+#if defined(__linux__)
+	int cpu = ::sched_getcpu();
+	if (cpu >= 0)
+		return static_cast<size_t>(cpu) % slots;
+#elif defined(_WIN32)
+	return ::GetCurrentProcessorNumber() % slots;
+#endif
+	static thread_local char tag;
+	return (reinterpret_cast<uintptr_t>(&tag) >> 12) % slots;
+}
+
+void *PageCache::popCachedSpan(size_t numPages)
+{
+	SpanSlot &slot = spanSlots_[currentSpanSlot(SPAN_CACHE_SLOTS)];
+	SpinLockGuard guard(slot.lock, nullptr, RealTime::spinBound());
+	unsigned char &count = slot.count[numPages - 1];
+	if (!guard.ownsLock() || count == 0)
+		return nullptr;
+	addCounter(slot.pages, 0 - numPages);
+	addCounter(slot.hits, 1);
+	return slot.spans[numPages - 1][--count];
+}
+
+bool PageCache::pushCachedSpan(void *spanAddr, size_t numPages)
+{
+	SpanSlot &slot = spanSlots_[currentSpanSlot(SPAN_CACHE_SLOTS)];
+	SpinLockGuard guard(slot.lock);
+	unsigned char &count = slot.count[numPages - 1];
+	if (count == SPAN_CACHE_DEPTH || slot.pages.load(std::memory_order_relaxed) + numPages > SPAN_CACHE_SLOT_PAGES)
+		return false;
+	slot.spans[numPages - 1][count++] = spanAddr;
+	addCounter(slot.pages, numPages);
+	return true;
+}
+
+size_t PageCache::flushSpanCache()
+{
+	size_t pages = 0;
+	for (SpanSlot &slot : spanSlots_)
+	{
+		if (slot.pages.load(std::memory_order_relaxed) == 0)
+			continue;
+		struct
+		{
+			void *addr;
+			size_t numPages;
+		} taken[SPAN_CACHE_PAGES * SPAN_CACHE_DEPTH];
+		size_t numTaken = 0;
+		{
+			SpinLockGuard guard(slot.lock);
+			for (size_t n = 1; n <= SPAN_CACHE_PAGES; ++n)
+			{
+				for (unsigned char i = 0; i < slot.count[n - 1]; ++i)
+					taken[numTaken++] = {slot.spans[n - 1][i], n};
+				slot.count[n - 1] = 0;
+			}
+			slot.pages.store(0, std::memory_order_relaxed);
+		}
+
+		auto lock = lockPageCache();
+		for (size_t i = 0; i < numTaken; ++i)
+		{
+			releaseSpan(taken[i].addr);
+			pages += taken[i].numPages;
+		}
+	}
+	return pages;
+}
+
+void PageCache::setSpanCache(bool enabled)
+{
+	spanCacheEnabled_.store(enabled, std::memory_order_relaxed);
+	if (!enabled)
+		flushSpanCache();
+}
+
+void PageCache::setGrowth(bool enabled)
+{
+	growth_.store(enabled, std::memory_order_relaxed);
+}
+
+bool PageCache::reserveMetadata(size_t numPages)
+{
+	return arena_.reserve(numPages * ((sizeof(Span) + 63) & ~size_t(63)) + 2 * PageMap<Span>::nodeBytes(numPages));
+}
+
+void *PageCache::allocateSpan(size_t numPages, bool *zeroed)
+{
+	if (numPages >= 1 && numPages <= SPAN_CACHE_PAGES && spanCacheEnabled_.load(std::memory_order_relaxed))
+	{
+		if (void *spanAddr = popCachedSpan(numPages))
+		{
+			// cached spans were freed after use, so never known zero
+			if (zeroed)
+				*zeroed = false;
+			return spanAddr;
 		}
+	}
 
-		spanToReturn->numPages = numPages;
-		spanMap_[spanToReturn->addr] = spanToReturn;
+	auto lock = lockPageCache(RealTime::spinBound());
+	if (!lock.owns_lock())
+		return nullptr;
+
+	Span *spanToReturn = takeFreeSpan(numPages);
+	if (spanToReturn && spanToReturn->released && !MemoryLimit::tryGrow(numPages * Size::PAGE_SIZE))
+	{
+		// refaulting released pages counts against the hard limit like mapping
+		pushFreeSpan(spanToReturn);
+		return nullptr;
+	}
+	if (spanToReturn)
+	{
+		endMap_.clear(pageOf(spanToReturn->addr) + spanToReturn->numPages);
+
+		// split off the tail; without metadata for it the caller gets it all
+		Span *newSpan = spanToReturn->numPages > numPages ? arena_.create<Span>() : nullptr;
+		void *newSpanAddr = static_cast<char *>(spanToReturn->addr) + numPages * Size::PAGE_SIZE;
+		if (newSpan && spanMap_.set(pageOf(newSpanAddr), newSpan))
+		{
+			newSpan->numPages = spanToReturn->numPages - numPages;
+			newSpan->addr = newSpanAddr;
+			newSpan->released = spanToReturn->released;
+			newSpan->zeroed = spanToReturn->zeroed;
+			pushFreeSpan(newSpan);
+			endMap_.set(pageOf(newSpanAddr) + newSpan->numPages, newSpan);
+			spanToReturn->numPages = numPages;
+		}
+		else if (newSpan)
+		{
+			arena_.destroy(newSpan);
+		}
+		if (spanToReturn->released)
+			MemoryLimit::grow((spanToReturn->numPages - numPages) * Size::PAGE_SIZE);
+
+		if (zeroed)
+			*zeroed = spanToReturn->zeroed;
+		spanToReturn->released = false;
+		spanToReturn->zeroed = false;
+		addCounter(freePages_, 0 - spanToReturn->numPages);
 		return spanToReturn->addr;
 	}
 
-	void *newSpanAddr = systemAlloc(numPages);
+	Span *newSpan = mapSpan(numPages, false);
+	if (!newSpan)
+		return nullptr;
+	if (zeroed)
+		*zeroed = true;
+	newSpan->zeroed = false;
+	return newSpan->addr;
+}
+
+bool PageCache::reserve(size_t numPages, bool populate)
+{
+	if (numPages == 0)
+		return true;
+
+	auto lock = lockPageCache();
+	Span *span = mapSpan(numPages, populate);
+	if (!span)
+		return false;
+	addCounter(freePages_, numPages);
+	pushFreeSpan(span);
+	endMap_.set(pageOf(span->addr) + numPages, span);
+	return true;
+}
+
+// Maps a fresh region and registers it as one in-use span. Caller holds
+// mutexLock.
+PageCache::Span *PageCache::mapSpan(size_t numPages, bool populate)
+{
+	if (!growth_.load(std::memory_order_relaxed))
+		return nullptr;
+	if (!MemoryLimit::tryGrow(numPages * Size::PAGE_SIZE))
+		return nullptr;
+	void *newSpanAddr = systemAlloc(numPages, populate);
 	if (!newSpanAddr)
+	{
+		MemoryLimit::shrink(numPages * Size::PAGE_SIZE);
+		return nullptr;
+	}
+
+	Span *newSpan = arena_.create<Span>();
+	Region *region = arena_.create<Region>();
+	if (!newSpan || !region || !spanMap_.set(pageOf(newSpanAddr), newSpan))
+	{
+		if (newSpan)
+			arena_.destroy(newSpan);
+		if (region)
+			arena_.destroy(region);
+		systemFree(newSpanAddr, numPages);
+		MemoryLimit::shrink(numPages * Size::PAGE_SIZE);
 		return nullptr;
+	}
+	addCounter(mappedPages_, numPages);
+	region->addr = newSpanAddr;
+	region->numPages = numPages;
+	region->next = regions_;
+	regions_ = region;
 
-	Span *newSpan = allocSpanMeta();
 	newSpan->addr = newSpanAddr;
 	newSpan->numPages = numPages;
 	newSpan->next = nullptr;
+	newSpan->released = false;
+	newSpan->zeroed = true; // anonymous mappings start out zero
+	return newSpan;
+}
 
-	spanMap_[newSpan->addr] = newSpan;
-	return newSpan->addr;
+void PageCache::pushFreeSpan(Span *span)
+{
+	Span *&list = freeSpans_[std::min(span->numPages, LARGE_PAGES)];
+	span->next = list;
+	list = span;
+}
+
+// Unlinks the smallest free span of at least numPages: the exact-length
+// lists first, then the best fit among the large ones.
+PageCache::Span *PageCache::takeFreeSpan(size_t numPages)
+{
+	for (size_t n = numPages; n < LARGE_PAGES; ++n)
+	{
+		if (Span *span = freeSpans_[n])
+		{
+			freeSpans_[n] = span->next;
+			return span;
+		}
+	}
+
+	Span *best = nullptr;
+	Span **bestLink = nullptr;
+	for (Span **link = &freeSpans_[LARGE_PAGES]; *link; link = &(*link)->next)
+	{
+		if ((*link)->numPages >= numPages && (!best || (*link)->numPages < best->numPages))
+		{
+			best = *link;
+			bestLink = link;
+		}
+	}
+	if (best)
+		*bestLink = best->next;
+	return best;
 }
 
-// Helper: remove a span from its freeSpans_ bucket.
+// Helper: remove a span from its freeSpans_ list.
 // Returns true if found and removed, false otherwise.
 // Used by both forward and backward merge.
 bool PageCache::removeFromFreeList(Span *target)
 {
-	auto bucketIt = freeSpans_.find(target->numPages);
-	if (bucketIt == freeSpans_.end())
-		return false;
-
-	Span *cur = bucketIt->second;
-	Span *prev = nullptr;
-	while (cur)
+	for (Span **link = &freeSpans_[std::min(target->numPages, LARGE_PAGES)]; *link; link = &(*link)->next)
 	{
-		if (cur == target)
+		if (*link == target)
 		{
-			// target is middle or end of the list
-			if (prev)
-				prev->next = cur->next;
-
-			// target is head of the list
-			else
-			{
-				// has more than 1 span in the bucket
-				if (cur->next)
-					bucketIt->second = cur->next;
-
-				// head is the only span in the bucket
-				else
-					freeSpans_.erase(bucketIt);
-			}
-
+			*link = target->next;
 			return true;
 		}
-		prev = cur;
-		cur = cur->next;
 	}
 	return false;
 }
 
 void PageCache::deallocateSpan(void *spanAddr, size_t numPages)
 {
-	std::lock_guard<std::mutex> lock(mutexLock);
+	if (numPages >= 1 && numPages <= SPAN_CACHE_PAGES && spanCacheEnabled_.load(std::memory_order_relaxed)
+		&& pushCachedSpan(spanAddr, numPages))
+		return;
+	auto lock = lockPageCache();
+	releaseSpan(spanAddr);
+}
 
-	auto it = spanMap_.find(spanAddr);
-	if (it == spanMap_.end())
+// Returns an in-use span to the free lists, merging it with free neighbours.
+// Caller holds mutexLock.
+void PageCache::releaseSpan(void *spanAddr)
+{
+	Span *span = spanMap_.get(pageOf(spanAddr));
+	if (!span)
 		return;
-	Span *span = it->second;
+	addCounter(freePages_, span->numPages);
 
+	// Neighbours are merged whatever their state: a zero or released one loses
+	// it, which only costs allocateZeroed a memset, while leaving it apart
+	// would fragment the free pages for good after every releaseToOS.
 	// forward merge
 	void *nextSpanAddr = static_cast<char *>(spanAddr) + span->numPages * Size::PAGE_SIZE;
-	auto nextIt = spanMap_.find(nextSpanAddr);
-	if (nextIt != spanMap_.end())
+	Span *nextSpan = spanMap_.get(pageOf(nextSpanAddr));
+	if (nextSpan)
 	{
-		Span *nextSpan = nextIt->second;
-
 		bool found = removeFromFreeList(nextSpan);
 		if (found)
 		{
-			void *nextEnd = static_cast<char *>(nextSpanAddr) + nextSpan->numPages * Size::PAGE_SIZE;
-			endMap_.erase(nextEnd);
+			if (nextSpan->released)
+				MemoryLimit::grow(nextSpan->numPages * Size::PAGE_SIZE);
+			endMap_.clear(pageOf(nextSpanAddr) + nextSpan->numPages);
 
 			span->numPages += nextSpan->numPages;
-			spanMap_.erase(nextSpanAddr);
-			freeSpanMeta(nextSpan);
+			spanMap_.clear(pageOf(nextSpanAddr));
+			arena_.destroy(nextSpan);
 		}
 	}
 
 	// backward merge
-	auto prevIt = endMap_.find(spanAddr);
-	if (prevIt != endMap_.end())
+	Span *prevSpan = endMap_.get(pageOf(spanAddr));
+	if (prevSpan)
 	{
-		Span *prevSpan = prevIt->second;
-
 		bool found = removeFromFreeList(prevSpan);
 
 		if (found)
 		{
-			endMap_.erase(prevIt);
+			if (prevSpan->released)
+				MemoryLimit::grow(prevSpan->numPages * Size::PAGE_SIZE);
+			endMap_.clear(pageOf(spanAddr));
 			prevSpan->numPages += span->numPages;
-			spanMap_.erase(spanAddr);
-			freeSpanMeta(span);
+			spanMap_.clear(pageOf(spanAddr));
+			arena_.destroy(span);
 
 			span = prevSpan;
 			spanAddr = prevSpan->addr;
 		}
 	}
 
+	// the pages just freed are resident and dirty, so the merged span is too
+	span->released = false;
+	span->zeroed = false;
+
 	// Insert merged span into freeSpans_
-	span->next = freeSpans_[span->numPages];
-	freeSpans_[span->numPages] = span;
+	pushFreeSpan(span);
+	endMap_.set(pageOf(spanAddr) + span->numPages, span);
+}
+
+size_t PageCache::releaseToOS()
+{
+	// frozen: every page stays resident, so reuse never faults
+	if (!growth_.load(std::memory_order_relaxed))
+		return 0;
+	flushSpanCache();
+	auto lock = lockPageCache();
 
-	void *mergedEnd = static_cast<char *>(spanAddr) + span->numPages * Size::PAGE_SIZE;
-	endMap_[mergedEnd] = span;
+	size_t pages = 0;
+	for (Span *head : freeSpans_)
+	{
+		for (Span *span = head; span; span = span->next)
+		{
+			if (span->released)
+				continue;
+			size_t size = span->numPages * Size::PAGE_SIZE;
+#if defined(_WIN32)
+			::VirtualAlloc(span->addr, size, MEM_RESET, PAGE_READWRITE);
+#else
+			::madvise(span->addr, size, MADV_DONTNEED);
+#endif
+			span->released = true;
+#if !defined(_WIN32)
+			// private anonymous pages refault as zero after MADV_DONTNEED;
+			// MEM_RESET makes no such promise
+			span->zeroed = true;
+#endif
+			pages += span->numPages;
+		}
+	}
+	addCounter(releasedPages_, pages);
+	MemoryLimit::shrink(pages * Size::PAGE_SIZE);
+	return pages;
 }
 
-void *PageCache::systemAlloc(size_t numPages)
+void *PageCache::systemAlloc(size_t numPages, bool populate)
 {
 	size_t size = numPages * Size::PAGE_SIZE;
 
 #if defined(_WIN32)
 	// Windows:
 	void *ptr = ::VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
-	return ptr;
+	if (!ptr)
+		return nullptr;
 #else
 	// Linux/macOS: POSIX mmap
-	void *ptr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_POPULATE
+	if (populate)
+		flags |= MAP_POPULATE;
+#endif
+	void *ptr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, -1, 0);
 	if (ptr == MAP_FAILED)
 		return nullptr;
+#endif
+#if defined(_WIN32) || !defined(MAP_POPULATE)
+	// no populate flag: fault the pages in by hand
+	if (populate)
+		for (size_t off = 0; off < size; off += Size::PAGE_SIZE)
+			static_cast<volatile char *>(ptr)[off] = 0;
+#endif
 	return ptr;
+}
+
+void PageCache::systemFree(void *ptr, size_t numPages)
+{
+#if defined(_WIN32)
+	(void)numPages;
+	::VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+	::munmap(ptr, numPages * Size::PAGE_SIZE);
 #endif
 }
@@ -0,0 +1,71 @@
+#include "../include/RealTime.h"
+#include "../include/CentralCache.h"
+#include "../include/PageCache.h"
+#include "../include/ThreadCache.h"
+
+namespace
+{
+	std::atomic<bool> started{false};
+	std::atomic<size_t> misses{0};
+	std::atomic<size_t> waits{0};
+}
+
+namespace RealTime
+{
+	bool start(size_t reserveBytes)
+	{
+		PageCache &pageCache = PageCache::getInstance();
+		size_t pages = (reserveBytes + Size::PAGE_SIZE - 1) / Size::PAGE_SIZE;
+		CentralCache &central = CentralCache::getInstance();
+		if (!pageCache.reserve(pages, true) || !pageCache.reserveMetadata(pages) || !central.reserveMetadata(pages))
+			return false;
+		pageCache.setGrowth(false);
+
+		// fails for classes already in use, which keep their free lists
+		for (size_t index = 0; index < Size::FREE_LIST_SIZE; ++index)
+			central.setSpanLayout(index, SpanLayout::Bitmap);
+		central.setBackgroundReclaim(true);
+		started.store(true, std::memory_order_relaxed);
+		return true;
+	}
+
+	bool active()
+	{
+		return started.load(std::memory_order_relaxed);
+	}
+
+	void enterThread()
+	{
+		// constructed here, not on the first allocation; the stash is taken
+		// with unbounded locks, before the thread counts as real-time
+		ThreadCache::getInstance().fillStash();
+		thisThread = true;
+	}
+
+	void leaveThread()
+	{
+		thisThread = false;
+		ThreadCache::getInstance().dropStash();
+	}
+
+	size_t lockMisses()
+	{
+		return misses.load(std::memory_order_relaxed);
+	}
+
+	void noteLockMiss()
+	{
+		misses.fetch_add(1, std::memory_order_relaxed);
+		++thisThreadMisses;
+	}
+
+	size_t contentionWaits()
+	{
+		return waits.load(std::memory_order_relaxed);
+	}
+
+	void noteContentionWait()
+	{
+		waits.fetch_add(1, std::memory_order_relaxed);
+	}
+}
@@ -0,0 +1,463 @@
+#include "../include/SharedHeap.h"
+#include "../include/Size.h"
+#include "../include/SpinLockGuard.h"
+#include <atomic>
+#include <new>
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	constexpr uint64_t MAGIC = 0x314D4853706F6D; // "mpoSHM1"
+	// runs of this many pages or more share one first-fit list
+	constexpr size_t LARGE_PAGES = 128;
+	// pages taken from the page tier whenever a size class runs dry
+	constexpr size_t CLASS_SPAN_PAGES = 16;
+	// free-list heads: block offset in the low bits, a change counter above
+	// it so a head popped and pushed back between a load and a CAS is noticed
+	constexpr int OFFSET_BITS = 40;
+	constexpr uint64_t OFFSET_MASK = (uint64_t(1) << OFFSET_BITS) - 1;
+	constexpr uint64_t TAG_ONE = uint64_t(1) << OFFSET_BITS;
+
+	static_assert(std::atomic<uint64_t>::is_always_lock_free,
+		"atomics in the shared region must be lock-free to work across processes");
+
+	// first words of a free page run
+	struct FreeRun
+	{
+		uint64_t next;
+		uint64_t numPages;
+	};
+
+	size_t pagesFor(size_t size)
+	{
+		return (size + Size::PAGE_SIZE - 1) / Size::PAGE_SIZE;
+	}
+
+	size_t roundToPages(size_t size)
+	{
+		return pagesFor(size) * Size::PAGE_SIZE;
+	}
+
+	// A block's link word may be rewritten by another process while a stale
+	// pop reads it; the tagged CAS then fails, but the access must be atomic.
+	std::atomic_ref<uint64_t> linkOf(char *base, uint64_t offset)
+	{
+		return std::atomic_ref<uint64_t>(*reinterpret_cast<uint64_t *>(base + offset));
+	}
+}
+
+struct mpool::SharedHeap::Header
+{
+	std::atomic<uint64_t> magic{0}; // set last, once the rest is initialized
+	uint64_t headerSize = sizeof(Header); // catches a file from another layout
+	uint64_t size = 0;
+	std::atomic<uint64_t> root{0};
+	// a file heap's owner clears this on open and sets it in close()
+	uint32_t clean = 1;
+
+	struct alignas(64) ClassHead
+	{
+		std::atomic<uint64_t> head{0};
+	};
+	ClassHead classes[Size::FREE_LIST_SIZE];
+
+	alignas(64) std::atomic_flag pageLock;
+	// guarded by pageLock
+	uint64_t bump = 0; // first byte never handed out
+	uint64_t freeRuns[LARGE_PAGES + 1] = {};
+};
+
+namespace mpool
+{
+	SharedHeap::~SharedHeap()
+	{
+		close();
+	}
+
+	bool SharedHeap::create(const char *name, size_t bytes)
+	{
+#if defined(_WIN32)
+		(void)name;
+		(void)bytes;
+		return false;
+#else
+		if (isOpen())
+			return false;
+		bytes = regionBytes(bytes);
+		if (bytes == 0)
+			return false;
+
+		int fd;
+		if (name)
+		{
+			fd = ::shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+		}
+		else
+		{
+#if defined(__linux__)
+			fd = ::memfd_create("mpool-shared-heap", MFD_CLOEXEC);
+#else
+			fd = -1;
+#endif
+		}
+		if (fd < 0)
+			return false;
+		if (::ftruncate(fd, static_cast<off_t>(bytes)) != 0 || !map(fd, bytes, true))
+		{
+			::close(fd);
+			if (name)
+				::shm_unlink(name);
+			return false;
+		}
+		return true;
+#endif
+	}
+
+	bool SharedHeap::open(const char *name)
+	{
+#if defined(_WIN32)
+		(void)name;
+		return false;
+#else
+		if (isOpen())
+			return false;
+		int fd = ::shm_open(name, O_RDWR, 0);
+		if (fd < 0)
+			return false;
+		struct stat st;
+		if (::fstat(fd, &st) != 0 || !map(fd, static_cast<size_t>(st.st_size), false))
+		{
+			::close(fd);
+			return false;
+		}
+		return true;
+#endif
+	}
+
+	bool SharedHeap::attach(int fd)
+	{
+#if defined(_WIN32)
+		(void)fd;
+		return false;
+#else
+		if (isOpen())
+			return false;
+		int own = ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+		if (own < 0)
+			return false;
+		struct stat st;
+		if (::fstat(own, &st) != 0 || !map(own, static_cast<size_t>(st.st_size), false))
+		{
+			::close(own);
+			return false;
+		}
+		return true;
+#endif
+	}
+
+	bool SharedHeap::openFile(const char *path, size_t bytes)
+	{
+#if defined(_WIN32)
+		(void)path;
+		(void)bytes;
+		return false;
+#else
+		if (isOpen())
+			return false;
+		int fd = ::open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+		if (fd < 0)
+			return false;
+		// released by the kernel if the owner dies, so a crash never locks out
+		// the next owner
+		struct stat st;
+		if (::flock(fd, LOCK_EX | LOCK_NB) != 0 || ::fstat(fd, &st) != 0)
+		{
+			::close(fd);
+			return false;
+		}
+
+		bool fresh = st.st_size == 0;
+		size_t size = fresh ? regionBytes(bytes) : static_cast<size_t>(st.st_size);
+		if (size == 0 || (fresh && ::ftruncate(fd, static_cast<off_t>(size)) != 0) || !map(fd, size, fresh))
+		{
+			::close(fd);
+			return false;
+		}
+
+		Header *h = header();
+		if (!h->clean)
+		{
+			// the last owner died with the heap open; its locks die with it
+			h->pageLock.clear(std::memory_order_relaxed);
+			if (!check())
+			{
+				close();
+				return false;
+			}
+		}
+		h->clean = 0;
+		file_ = true;
+		return true;
+#endif
+	}
+
+	bool SharedHeap::sync()
+	{
+#if defined(_WIN32)
+		return false;
+#else
+		return base_ && ::msync(base_, size_, MS_SYNC) == 0;
+#endif
+	}
+
+	size_t SharedHeap::regionBytes(size_t bytes)
+	{
+		size_t total = roundToPages(sizeof(Header)) + roundToPages(bytes);
+		return total > OFFSET_MASK ? 0 : total;
+	}
+
+	bool SharedHeap::map(int fd, size_t bytes, bool initialize)
+	{
+#if defined(_WIN32)
+		(void)fd;
+		(void)bytes;
+		(void)initialize;
+		return false;
+#else
+		if (bytes < sizeof(Header))
+			return false;
+		void *base = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (base == MAP_FAILED)
+			return false;
+
+		Header *h = static_cast<Header *>(base);
+		if (initialize)
+		{
+			h = new (base) Header;
+			h->size = bytes;
+			h->bump = roundToPages(sizeof(Header));
+			h->magic.store(MAGIC, std::memory_order_release);
+		}
+		else if (h->magic.load(std::memory_order_acquire) != MAGIC || h->headerSize != sizeof(Header)
+			|| h->size != bytes)
+		{
+			::munmap(base, bytes);
+			return false;
+		}
+
+		base_ = static_cast<char *>(base);
+		size_ = bytes;
+		fd_ = fd;
+		return true;
+#endif
+	}
+
+	void SharedHeap::close()
+	{
+#if !defined(_WIN32)
+		if (base_ && file_)
+			header()->clean = 1;
+		if (base_)
+			::munmap(base_, size_);
+		if (fd_ >= 0)
+			::close(fd_);
+#endif
+		base_ = nullptr;
+		size_ = 0;
+		fd_ = -1;
+		file_ = false;
+	}
+
+	bool SharedHeap::unlink(const char *name)
+	{
+#if defined(_WIN32)
+		(void)name;
+		return false;
+#else
+		return ::shm_unlink(name) == 0;
+#endif
+	}
+
+	void *SharedHeap::allocate(size_t size)
+	{
+		if (size == 0)
+			return nullptr;
+		if (size > Size::MAX_ALLOC_SIZE)
+		{
+			uint64_t offset = allocatePages(pagesFor(size));
+			return offset ? base_ + offset : nullptr;
+		}
+		return pop(Size::sizeToIndex(size));
+	}
+
+	void SharedHeap::deallocate(void *ptr, size_t size)
+	{
+		if (!ptr)
+			return;
+		uint64_t offset = toOffset(ptr);
+		if (size > Size::MAX_ALLOC_SIZE)
+			deallocatePages(offset, pagesFor(size));
+		else
+			push(Size::sizeToIndex(size), offset, offset);
+	}
+
+	void SharedHeap::setRoot(uint64_t offset)
+	{
+		header()->root.store(offset, std::memory_order_release);
+	}
+
+	uint64_t SharedHeap::root() const
+	{
+		return header()->root.load(std::memory_order_acquire);
+	}
+
+	size_t SharedHeap::mappedBytes() const
+	{
+		SpinLockGuard guard(header()->pageLock);
+		return header()->bump - roundToPages(sizeof(Header));
+	}
+
+	bool SharedHeap::check() const
+	{
+		const Header *h = header();
+		if (!h)
+			return false;
+		uint64_t start = roundToPages(sizeof(Header));
+		if (h->size != size_ || h->bump < start || h->bump > h->size || h->bump % Size::PAGE_SIZE != 0)
+			return false;
+		uint64_t used = h->bump - start;
+		if (h->root.load(std::memory_order_relaxed) >= h->bump)
+			return false;
+
+		// a list longer than what could fit in the used pages must loop
+		uint64_t runs = 0;
+		for (size_t n = 1; n <= LARGE_PAGES; ++n)
+		{
+			for (uint64_t offset = h->freeRuns[n]; offset;)
+			{
+				if (offset < start || offset >= h->bump || offset % Size::PAGE_SIZE != 0 || ++runs > used / Size::PAGE_SIZE)
+					return false;
+				const FreeRun *run = reinterpret_cast<const FreeRun *>(base_ + offset);
+				bool lengthFits = n < LARGE_PAGES ? run->numPages == n : run->numPages >= LARGE_PAGES;
+				if (!lengthFits || run->numPages > (h->bump - offset) / Size::PAGE_SIZE)
+					return false;
+				offset = run->next;
+			}
+		}
+
+		for (size_t index = 0; index < Size::FREE_LIST_SIZE; ++index)
+		{
+			uint64_t limit = used / Size::indexToBlockSize(index);
+			uint64_t count = 0;
+			uint64_t offset = h->classes[index].head.load(std::memory_order_relaxed) & OFFSET_MASK;
+			while (offset)
+			{
+				if (offset < start || offset >= h->bump || offset % Size::ALIGNMENT != 0 || ++count > limit)
+					return false;
+				offset = linkOf(base_, offset).load(std::memory_order_relaxed);
+			}
+		}
+		return true;
+	}
+
+	void *SharedHeap::pop(size_t index)
+	{
+		std::atomic<uint64_t> &head = header()->classes[index].head;
+		uint64_t current = head.load(std::memory_order_acquire);
+		while (true)
+		{
+			uint64_t offset = current & OFFSET_MASK;
+			if (offset == 0)
+			{
+				// carve a fresh span and publish all of it but the first block
+				size_t blockSize = Size::indexToBlockSize(index);
+				size_t count = CLASS_SPAN_PAGES * Size::PAGE_SIZE / blockSize;
+				uint64_t span = allocatePages(CLASS_SPAN_PAGES);
+				if (span == 0)
+					return nullptr;
+				for (size_t i = 1; i + 1 < count; ++i)
+					linkOf(base_, span + i * blockSize).store(span + (i + 1) * blockSize, std::memory_order_relaxed);
+				push(index, span + blockSize, span + (count - 1) * blockSize);
+				return base_ + span;
+			}
+			uint64_t next = linkOf(base_, offset).load(std::memory_order_relaxed);
+			uint64_t replacement = ((current & ~OFFSET_MASK) + TAG_ONE) | next;
+			if (head.compare_exchange_weak(current, replacement, std::memory_order_acquire, std::memory_order_acquire))
+				return base_ + offset;
+		}
+	}
+
+	// Pushes the chain first..last, already linked, onto a class list.
+	void SharedHeap::push(size_t index, uint64_t first, uint64_t last)
+	{
+		std::atomic<uint64_t> &head = header()->classes[index].head;
+		uint64_t current = head.load(std::memory_order_relaxed);
+		uint64_t replacement;
+		do
+		{
+			linkOf(base_, last).store(current & OFFSET_MASK, std::memory_order_relaxed);
+			replacement = ((current & ~OFFSET_MASK) + TAG_ONE) | first;
+		} while (!head.compare_exchange_weak(current, replacement, std::memory_order_release, std::memory_order_relaxed));
+	}
+
+	uint64_t SharedHeap::allocatePages(size_t numPages)
+	{
+		Header *h = header();
+		SpinLockGuard guard(h->pageLock);
+
+		if (numPages < LARGE_PAGES && h->freeRuns[numPages])
+		{
+			uint64_t offset = h->freeRuns[numPages];
+			h->freeRuns[numPages] = reinterpret_cast<FreeRun *>(base_ + offset)->next;
+			return offset;
+		}
+
+		// first fit among the large runs, keeping what is left over
+		for (uint64_t *link = &h->freeRuns[LARGE_PAGES]; *link;)
+		{
+			FreeRun *run = reinterpret_cast<FreeRun *>(base_ + *link);
+			if (run->numPages < numPages)
+			{
+				link = &run->next;
+				continue;
+			}
+			uint64_t offset = *link;
+			*link = run->next;
+			size_t rest = run->numPages - numPages;
+			if (rest > 0)
+			{
+				uint64_t restOffset = offset + numPages * Size::PAGE_SIZE;
+				FreeRun *restRun = reinterpret_cast<FreeRun *>(base_ + restOffset);
+				uint64_t &list = h->freeRuns[rest < LARGE_PAGES ? rest : LARGE_PAGES];
+				restRun->next = list;
+				restRun->numPages = rest;
+				list = restOffset;
+			}
+			return offset;
+		}
+
+		size_t bytes = numPages * Size::PAGE_SIZE;
+		if (bytes > h->size - h->bump)
+			return 0;
+		uint64_t offset = h->bump;
+		h->bump += bytes;
+		return offset;
+	}
+
+	void SharedHeap::deallocatePages(uint64_t offset, size_t numPages)
+	{
+		Header *h = header();
+		SpinLockGuard guard(h->pageLock);
+		FreeRun *run = reinterpret_cast<FreeRun *>(base_ + offset);
+		uint64_t &list = h->freeRuns[numPages < LARGE_PAGES ? numPages : LARGE_PAGES];
+		run->next = list;
+		run->numPages = numPages;
+		list = offset;
+	}
+}
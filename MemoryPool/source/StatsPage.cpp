@@ -0,0 +1,240 @@
+#include "../include/StatsPage.h"
+#include "../include/CentralCache.h"
+#include "../include/PageCache.h"
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	constexpr int READ_ATTEMPTS = 1000;
+
+	void pageName(int pid, char (&name)[32])
+	{
+		std::snprintf(name, sizeof(name), "/mpool-stats.%d", pid);
+	}
+
+	uint64_t nowNs()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+				   std::chrono::steady_clock::now().time_since_epoch())
+			.count();
+	}
+
+	class Publisher
+	{
+	public:
+		static Publisher &getInstance()
+		{
+			static Publisher instance;
+			return instance;
+		}
+
+		bool start(std::chrono::milliseconds period)
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (!page_ && !create())
+				return false;
+			period_ = period;
+			page_->periodNs = std::chrono::duration_cast<std::chrono::nanoseconds>(period).count();
+			if (thread_.joinable())
+			{
+				wake_.notify_one();
+				return true;
+			}
+			stopping_ = false;
+			write();
+			thread_ = std::thread(&Publisher::loop, this);
+			return true;
+		}
+
+		void stop()
+		{
+			std::thread thread;
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				stopping_ = true;
+				thread = std::move(thread_);
+			}
+			wake_.notify_one();
+			if (thread.joinable())
+				thread.join();
+
+			std::lock_guard<std::mutex> lock(mutex_);
+			remove();
+		}
+
+	private:
+		Publisher()
+		{
+			// constructed first, so they outlive the thread
+			CentralCache::getInstance();
+			PageCache::getInstance();
+		}
+		~Publisher()
+		{
+			stop();
+		}
+
+		// caller holds mutex_
+		bool create()
+		{
+#if defined(_WIN32)
+			return false;
+#else
+			char name[32];
+			pageName(static_cast<int>(::getpid()), name);
+			int fd = ::shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0600);
+			if (fd < 0)
+				return false;
+			void *ptr = MAP_FAILED;
+			if (::ftruncate(fd, Size::PAGE_SIZE) == 0)
+				ptr = ::mmap(nullptr, Size::PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			::close(fd);
+			if (ptr == MAP_FAILED)
+			{
+				::shm_unlink(name);
+				return false;
+			}
+			// fresh pages are zero: sequence 0, no snapshot yet
+			page_ = static_cast<StatsPage::Page *>(ptr);
+			page_->words = static_cast<uint32_t>(StatsPage::WORDS);
+			page_->pid = static_cast<uint32_t>(::getpid());
+			std::atomic_thread_fence(std::memory_order_release);
+			page_->magic = StatsPage::MAGIC;
+			return true;
+#endif
+		}
+
+		// caller holds mutex_
+		void remove()
+		{
+#if !defined(_WIN32)
+			if (!page_)
+				return;
+			char name[32];
+			pageName(static_cast<int>(page_->pid), name);
+			::shm_unlink(name);
+			::munmap(page_, Size::PAGE_SIZE);
+			page_ = nullptr;
+#endif
+		}
+
+		// caller holds mutex_ (the only writer)
+		void write()
+		{
+			StatsPage::Snapshot snapshot{};
+			CentralCache::getInstance().collectStats(snapshot.pool);
+			PageCache::getInstance().collectStats(snapshot.pool);
+			CentralCache::getInstance().collectClassStats(snapshot.classes);
+			snapshot.publishedNs = nowNs();
+			snapshot.publishes = ++publishes_;
+
+			uint64_t words[StatsPage::WORDS];
+			std::memcpy(words, &snapshot, sizeof(words));
+			uint64_t sequence = page_->sequence.load(std::memory_order_relaxed);
+			page_->sequence.store(sequence + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+			for (size_t i = 0; i < StatsPage::WORDS; ++i)
+				page_->data[i].store(words[i], std::memory_order_relaxed);
+			page_->sequence.store(sequence + 2, std::memory_order_release);
+		}
+
+		void loop()
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			while (!stopping_)
+			{
+				auto period = period_;
+				if (wake_.wait_for(lock, period, [&] { return stopping_ || period_ != period; }))
+					continue;
+				write();
+			}
+		}
+
+		std::mutex mutex_;
+		std::condition_variable wake_;
+		std::thread thread_;
+		std::chrono::milliseconds period_{100};
+		bool stopping_ = false;
+		StatsPage::Page *page_ = nullptr;
+		uint64_t publishes_ = 0;
+	};
+}
+
+namespace StatsPage
+{
+	bool publish(std::chrono::milliseconds period)
+	{
+		return Publisher::getInstance().start(period);
+	}
+
+	void stopPublishing()
+	{
+		Publisher::getInstance().stop();
+	}
+
+	const Page *attach(int pid)
+	{
+#if defined(_WIN32)
+		return nullptr;
+#else
+		char name[32];
+		pageName(pid, name);
+		int fd = ::shm_open(name, O_RDONLY, 0);
+		if (fd < 0)
+			return nullptr;
+		void *ptr = ::mmap(nullptr, Size::PAGE_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+		::close(fd);
+		if (ptr == MAP_FAILED)
+			return nullptr;
+		const Page *page = static_cast<const Page *>(ptr);
+		if (page->magic != MAGIC || page->words != WORDS)
+		{
+			::munmap(ptr, Size::PAGE_SIZE);
+			return nullptr;
+		}
+		return page;
+#endif
+	}
+
+	void detach(const Page *page)
+	{
+#if !defined(_WIN32)
+		if (page)
+			::munmap(const_cast<Page *>(page), Size::PAGE_SIZE);
+#endif
+	}
+
+	bool read(const Page &page, Snapshot &out)
+	{
+		uint64_t words[WORDS];
+		for (int attempt = 0; attempt < READ_ATTEMPTS; ++attempt)
+		{
+			uint64_t before = page.sequence.load(std::memory_order_acquire);
+			if (before == 0)
+				return false; // nothing published yet
+			if (before & 1)
+			{
+				std::this_thread::yield();
+				continue;
+			}
+			for (size_t i = 0; i < WORDS; ++i)
+				words[i] = page.data[i].load(std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (page.sequence.load(std::memory_order_relaxed) == before)
+			{
+				std::memcpy(&out, words, sizeof(words));
+				return true;
+			}
+		}
+		return false;
+	}
+}
@@ -1,11 +1,16 @@
 #include "../include/ThreadCache.h"
 #include "../include/CentralCache.h"
+#include "../include/HeapProfiler.h"
+#include "../include/MemoryLimit.h"
+#include "../include/RealTime.h"
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
 using std::size_t;
 
 ThreadCache &ThreadCache::getInstance()
 {
-	static thread_local ThreadCache instance;
+	static thread_local ThreadCache instance(CentralCache::getInstance());
 	return instance;
 }
 
@@ -15,11 +20,19 @@ void *ThreadCache::allocate(size_t size)
 	if (size == 0)
 		return nullptr;
 	if (size > Size::MAX_ALLOC_SIZE)
-		return malloc(size);
+		return RealTime::thisThread ? nullptr : malloc(size);
+
+	if (trimEpoch_.load(std::memory_order_relaxed) != seenTrimEpoch_)
+		trim();
 
 	// Free lists are implemented as singly linked lists using LIFO
 	// (head insertion + head removal).
 	size_t index = Size::sizeToIndex(size);
+	if ((bytesUntilSample_ -= static_cast<ptrdiff_t>(size)) < 0)
+	{
+		if (void *ptr = sampleAllocation(size))
+			return ptr;
+	}
 	if (freeListEntries_[index].head)
 	{
 		void *ptr = freeListEntries_[index].head;
@@ -33,6 +46,26 @@ void *ThreadCache::allocate(size_t size)
 	return refillFromCentral(index);
 }
 
+void *ThreadCache::allocateZeroed(size_t size)
+{
+	if (size == 0)
+		return nullptr;
+	if (size > Size::MAX_ALLOC_SIZE)
+		return RealTime::thisThread ? nullptr : calloc(1, size); // malloc's calloc skips fresh mmap'd chunks itself
+
+	void *ptr = allocate(size);
+	if (!ptr)
+		return nullptr;
+	// pops leave freshCount alone, so it exceeds size exactly when the block
+	// just taken was in the fresh tail (refill counts the block it returns)
+	const FreeListEntry &entry = freeListEntries_[Size::sizeToIndex(size)];
+	if (entry.freshCount > entry.size && !HeapProfiler::isSampled(ptr))
+		*static_cast<void **>(ptr) = nullptr;
+	else
+		std::memset(ptr, 0, size);
+	return ptr;
+}
+
 void ThreadCache::deallocate(void *ptr, size_t size)
 {
 	// Boundary Cases:
@@ -43,8 +76,16 @@ void ThreadCache::deallocate(void *ptr, size_t size)
 		free(ptr);
 		return;
 	}
+	if (HeapProfiler::isSampled(ptr))
+	{
+		HeapProfiler::deallocateSampled(ptr);
+		return;
+	}
+	if (trimEpoch_.load(std::memory_order_relaxed) != seenTrimEpoch_)
+		trim();
 
 	size_t index = Size::sizeToIndex(size);
+	freeListEntries_[index].freshCount = std::min(freeListEntries_[index].freshCount, freeListEntries_[index].size);
 	*reinterpret_cast<void **>(ptr) = freeListEntries_[index].head;
 	if (freeListEntries_[index].tail == nullptr)
 		freeListEntries_[index].tail = ptr;
@@ -54,9 +95,61 @@ void ThreadCache::deallocate(void *ptr, size_t size)
 		drainToCentral(freeListEntries_[index].head, freeListEntries_[index].tail, size);
 }
 
+// The sample countdown ran out: draw the next interval and hand this
+// allocation to the profiler. nullptr means serve it normally.
+void *ThreadCache::sampleAllocation(size_t size)
+{
+	// a sample takes a backtrace and the profiler's lock
+	if (RealTime::thisThread)
+	{
+		bytesUntilSample_ = PTRDIFF_MAX;
+		return nullptr;
+	}
+	bytesUntilSample_ = HeapProfiler::nextSampleInterval();
+	return HeapProfiler::allocateSampled(size);
+}
+
 void *ThreadCache::refillFromCentral(size_t index)
 {
-	void *ptr = CentralCache::getInstance().allocateBatch(index);
+	// a memory limit flush wanted by PageCache, which cannot run one under its lock
+	if (!RealTime::thisThread)
+		MemoryLimit::flushIfRequested();
+	bool zeroed = false;
+	size_t misses = RealTime::thisThreadMisses;
+	void *ptr = central_.allocateBatch(index, &zeroed);
+	for (unsigned attempt = 0; !ptr && !RealTime::thisThread && MemoryLimit::recover(attempt++);)
+	{
+		// the flush asked this cache to trim as well
+		if (trimEpoch_.load(std::memory_order_relaxed) != seenTrimEpoch_)
+			trim();
+		ptr = central_.allocateBatch(index, &zeroed);
+	}
+	if (RealTime::thisThread)
+	{
+		if (!ptr)
+		{
+			// CentralCache busy or out of memory: fall back on the stash
+			if (stashed_[index] > 0)
+				ptr = stash_[index][--stashed_[index]];
+		}
+		else if (stashed_[index] < STASH_BATCHES)
+		{
+			// the stash was used since: set one new batch aside per refill
+			// that gets through, so the work stays bounded
+			if (void *batch = central_.allocateBatch(index))
+				stash_[index][stashed_[index]++] = batch;
+		}
+		if (!ptr && RealTime::thisThreadMisses != misses)
+		{
+			// still busy with the stash used up: wait for the locks like any
+			// thread rather than fail (the holder may even be waiting for this
+			// CPU), so nullptr keeps meaning out of memory
+			RealTime::noteContentionWait();
+			RealTime::thisThread = false;
+			ptr = central_.allocateBatch(index, &zeroed);
+			RealTime::thisThread = true;
+		}
+	}
 	if (!ptr)
 		return nullptr;
 
@@ -65,9 +158,18 @@ void *ThreadCache::refillFromCentral(size_t index)
 	// Update the freeListSize
 	void *result = ptr;
 	ptr = *reinterpret_cast<void **>(ptr);
+	if (freeListEntries_[index].head)
+	{
+		// a flush above freed retired blocks into this very list: keep them
+		// (result stays out of the fresh count, so allocateZeroed clears it)
+		if (ptr)
+			pushBatch(freeListEntries_[index], ptr, zeroed);
+		return result;
+	}
 	if (ptr == nullptr)
 	{
 		freeListEntries_[index].tail = nullptr;
+		freeListEntries_[index].freshCount = zeroed ? 1 : 0;
 		return result;
 	}
 
@@ -83,6 +185,8 @@ void *ThreadCache::refillFromCentral(size_t index)
 	batchNum++;
 	freeListEntries_[index].tail = ptr;
 	freeListEntries_[index].size += batchNum;
+	// the list was empty: the whole batch, plus the block returned, is fresh or not
+	freeListEntries_[index].freshCount = zeroed ? batchNum + 1 : 0;
 	return result;
 }
 
@@ -103,17 +207,113 @@ void ThreadCache::drainToCentral(void *ptr, void *tail, size_t size)
 	for (size_t i = 1; i < numKeep && ptr; i++)
 		ptr = *reinterpret_cast<void **>(ptr);
 
+	// the returned blocks are the tail, where the fresh ones are
+	size_t fresh = std::min(freeListEntries_[index].freshCount, numBatch);
+	freeListEntries_[index].freshCount = fresh > numReturn ? fresh - numReturn : 0;
 	freeListEntries_[index].tail = ptr;
 	freeListEntries_[index].size = numKeep;
 	void *nodeReturn = *reinterpret_cast<void **>(ptr);
 	*reinterpret_cast<void **>(ptr) = nullptr;
-	CentralCache::getInstance().deallocateBatch(nodeReturn, tail, numReturn, index);
+	if (!central_.deallocateBatch(nodeReturn, tail, numReturn, index))
+	{
+		// real-time thread and CentralCache busy: keep them for a later try
+		*reinterpret_cast<void **>(ptr) = nodeReturn;
+		freeListEntries_[index].tail = tail;
+		freeListEntries_[index].size = numBatch;
+		freeListEntries_[index].freshCount = fresh;
+	}
 };
 
 bool ThreadCache::shouldReturn(size_t index)
+{
+	return freeListEntries_[index].size > returnThreshold(index);
+}
+
+size_t ThreadCache::returnThreshold(size_t index)
 {
 	size_t blockSize = Size::indexToBlockSize(index);
 	size_t threshold = (512 * 1024) / blockSize;
-	threshold = std::max(threshold, size_t(16));
-	return freeListEntries_[index].size > threshold;
-}
\ No newline at end of file
+	return std::max(threshold, size_t(16));
+}
+
+size_t ThreadCache::prewarm(size_t index, size_t count)
+{
+	if (index >= Size::FREE_LIST_SIZE)
+		return 0;
+
+	// honour a pending trim now, or the next allocation would halve the fill
+	if (trimEpoch_.load(std::memory_order_relaxed) != seenTrimEpoch_)
+		trim();
+
+	FreeListEntry &entry = freeListEntries_[index];
+	count = std::min(count, returnThreshold(index));
+	while (entry.size < count)
+	{
+		bool zeroed = false;
+		void *batch = central_.allocateBatch(index, &zeroed);
+		if (!batch)
+			break;
+		pushBatch(entry, batch, zeroed);
+	}
+	return entry.size;
+}
+
+// Splices a null-terminated batch in front of the list.
+void ThreadCache::pushBatch(FreeListEntry &entry, void *batch, bool zeroed)
+{
+	void *last = batch;
+	size_t batchNum = 1;
+	while (*reinterpret_cast<void **>(last) != nullptr)
+	{
+		last = *reinterpret_cast<void **>(last);
+		++batchNum;
+	}
+	*reinterpret_cast<void **>(last) = entry.head;
+	if (entry.tail == nullptr)
+		entry.tail = last;
+	entry.head = batch;
+	// still a fresh tail only if everything below the batch is fresh too
+	size_t fresh = std::min(entry.freshCount, entry.size);
+	entry.freshCount = zeroed && fresh == entry.size ? fresh + batchNum : fresh;
+	entry.size += batchNum;
+}
+
+void ThreadCache::fillStash()
+{
+	for (size_t index = 0; index < Size::FREE_LIST_SIZE; ++index)
+	{
+		while (stashed_[index] < STASH_BATCHES)
+		{
+			void *batch = central_.allocateBatch(index);
+			if (!batch)
+				break;
+			stash_[index][stashed_[index]++] = batch;
+		}
+	}
+}
+
+void ThreadCache::dropStash()
+{
+	for (size_t index = 0; index < Size::FREE_LIST_SIZE; ++index)
+	{
+		while (stashed_[index] > 0)
+			pushBatch(freeListEntries_[index], stash_[index][--stashed_[index]], false);
+	}
+}
+
+void ThreadCache::requestTrim()
+{
+	trimEpoch_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ThreadCache::trim()
+{
+	seenTrimEpoch_ = trimEpoch_.load(std::memory_order_relaxed);
+	if (RealTime::thisThread)
+		return;
+	for (size_t index = 0; index < Size::FREE_LIST_SIZE; ++index)
+	{
+		FreeListEntry &entry = freeListEntries_[index];
+		drainToCentral(entry.head, entry.tail, Size::indexToBlockSize(index));
+	}
+}
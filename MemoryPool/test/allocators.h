@@ -0,0 +1,56 @@
+#pragma once
+#include <iostream>
+#include <cstddef>
+#include <cstdlib>
+
+// Allocator selection for benchmark variants. add_bench_variants() in
+// CMakeLists.txt compiles one source per allocator with exactly one of
+// BENCH_USE_MEMPOOL / BENCH_USE_NEWDELETE / BENCH_USE_TCMALLOC defined, so each
+// allocator still runs in its own process (no cross-allocator heap warm-up).
+
+#if defined(BENCH_USE_MEMPOOL)
+#include "../include/MemoryPool.h"
+
+constexpr const char *BENCH_ALLOC_NAME = "Memory Pool";
+constexpr bool BENCH_ALLOC_AVAILABLE = true;
+inline void *benchAlloc(size_t s) { return MemoryPool::allocate(s); }
+inline void benchDealloc(void *p, size_t s) { MemoryPool::deallocate(p, s); }
+inline void *benchAllocZeroed(size_t s) { return MemoryPool::allocateZeroed(s); }
+inline void benchDeallocZeroed(void *p, size_t s) { MemoryPool::deallocate(p, s); }
+
+#elif defined(BENCH_USE_TCMALLOC)
+#ifdef HAVE_TCMALLOC
+#include <gperftools/tcmalloc.h>
+
+constexpr const char *BENCH_ALLOC_NAME = "TCMalloc";
+constexpr bool BENCH_ALLOC_AVAILABLE = true;
+inline void *benchAlloc(size_t s) { return tc_malloc(s); }
+inline void benchDealloc(void *p, size_t) { tc_free(p); }
+inline void *benchAllocZeroed(size_t s) { return tc_calloc(1, s); }
+inline void benchDeallocZeroed(void *p, size_t) { tc_free(p); }
+#else
+constexpr const char *BENCH_ALLOC_NAME = "TCMalloc";
+constexpr bool BENCH_ALLOC_AVAILABLE = false;
+inline void *benchAlloc(size_t) { return nullptr; }
+inline void benchDealloc(void *, size_t) {}
+inline void *benchAllocZeroed(size_t) { return nullptr; }
+inline void benchDeallocZeroed(void *, size_t) {}
+#endif
+
+#else
+constexpr const char *BENCH_ALLOC_NAME = "New/Delete";
+constexpr bool BENCH_ALLOC_AVAILABLE = true;
+inline void *benchAlloc(size_t s) { return new char[s]; }
+inline void benchDealloc(void *p, size_t) { delete[] static_cast<char *>(p); }
+// there is no zeroing operator new worth comparing against: use calloc
+inline void *benchAllocZeroed(size_t s) { return std::calloc(1, s); }
+inline void benchDeallocZeroed(void *p, size_t) { std::free(p); }
+#endif
+
+// Returns false (after telling the user why) when this variant cannot run.
+inline bool benchAllocatorAvailable()
+{
+    if (!BENCH_ALLOC_AVAILABLE)
+        std::cerr << "Built without tcmalloc. Reconfigure with libgoogle-perftools-dev installed.\n";
+    return BENCH_ALLOC_AVAILABLE;
+}
@@ -0,0 +1,94 @@
+// Zeroed allocation in large batches: for each block size, allocate --mb MB
+// worth of zeroed blocks and read them; then free everything and repeat.
+// Round 0 is served from memory fresh from the OS (the pool skips clearing
+// it), later rounds from recycled blocks, which every allocator has to clear.
+//
+//   bench_calloc_<alloc> [--mb N] [--rounds N] [--memset] [--reserve]
+// --memset uses plain allocate followed by memset instead of the zeroed call,
+// the baseline allocateZeroed / calloc is meant to beat. --reserve (mempool)
+// maps and faults in each size's memory first with MemoryPool::reserve, so
+// the fresh round measures clearing rather than page faults.
+#include "benchmarks.h"
+#include "allocators.h"
+#include <cstring>
+#include <string>
+
+int main(int argc, char** argv)
+{
+    if (!benchAllocatorAvailable())
+        return 1;
+
+    size_t mb = 64;
+    size_t rounds = 3;
+    bool explicitMemset = false;
+    bool reserve = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--memset") explicitMemset = true;
+        else if (arg == "--reserve") reserve = true;
+        else if (i + 1 < argc && arg == "--mb") mb = std::stoul(argv[++i]);
+        else if (i + 1 < argc && arg == "--rounds") rounds = std::stoul(argv[++i]);
+    }
+
+    const size_t SIZES[] = { 64, 256, 1024, 2048, 8192 };
+    std::cout << BENCH_ALLOC_NAME << (explicitMemset ? " (alloc + memset)" : " (zeroed)")
+              << (reserve ? " reserved" : "") << ", " << mb << " MB per size\n"
+              << std::left << std::setw(8) << "size" << std::right << std::setw(14) << "fresh ns/op"
+              << std::setw(16) << "recycled ns/op" << std::setw(14) << "fresh GB/s" << std::setw(16)
+              << "recycled GB/s" << "\n";
+
+    // One pass over all sizes first, keeping every block live: freed blocks
+    // would otherwise make later sizes' "fresh" round reuse dirty memory.
+    size_t checksum = 0;
+    std::vector<std::vector<void*>> ptrs(std::size(SIZES));
+    std::vector<double> freshNs(std::size(SIZES)), recycledNs(std::size(SIZES));
+#ifdef BENCH_USE_MEMPOOL
+    if (reserve) // spans do not pack blocks exactly: leave headroom
+        MemoryPool::reserve(std::size(SIZES) * ((mb << 20) + (mb << 20) / 4), true);
+#endif
+    for (size_t r = 0; r < rounds; ++r) {
+        for (size_t s = 0; s < std::size(SIZES); ++s) {
+            size_t size = SIZES[s];
+            size_t count = (mb << 20) / size;
+            ptrs[s].resize(count);
+            Timer t;
+            if (explicitMemset) {
+                for (size_t i = 0; i < count; ++i) {
+                    ptrs[s][i] = benchAlloc(size);
+                    std::memset(ptrs[s][i], 0, size);
+                }
+            }
+            else {
+                for (size_t i = 0; i < count; ++i)
+                    ptrs[s][i] = benchAllocZeroed(size);
+            }
+            double ns = t.elapsed() * 1e6 / count;
+            if (r == 0) freshNs[s] = ns;
+            else recycledNs[s] += ns / (rounds - 1);
+
+            // read every block once so untouched pages are not free, and dirty
+            // them so the next round really recycles written memory
+            for (void* ptr : ptrs[s]) {
+                char* p = static_cast<char*>(ptr);
+                checksum += p[0] + p[size - 1];
+                p[size / 2] = 1;
+            }
+        }
+        for (size_t s = 0; s < std::size(SIZES); ++s) {
+            for (void* ptr : ptrs[s]) {
+                if (explicitMemset) benchDealloc(ptr, SIZES[s]);
+                else benchDeallocZeroed(ptr, SIZES[s]);
+            }
+        }
+    }
+
+    for (size_t s = 0; s < std::size(SIZES); ++s) {
+        std::cout << std::left << std::setw(8) << SIZES[s] << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(14) << freshNs[s] << std::setw(16) << recycledNs[s] << std::setprecision(2)
+                  << std::setw(14) << SIZES[s] / freshNs[s] << std::setw(16)
+                  << (recycledNs[s] > 0 ? SIZES[s] / recycledNs[s] : 0.0) << "\n";
+    }
+    if (checksum != 0)
+        std::cout << "memory was not zero!\n";
+    return checksum != 0;
+}
@@ -0,0 +1,78 @@
+// Cache thrash over pooled objects: --objects blocks of one power-of-two class
+// are linked into a random cycle through their first word, and the benchmark
+// chases it, touching one cache line per object, like a scan over the headers
+// of pooled nodes. Without cache coloring every span starts page-aligned, so
+// the headers fall into a few of the L1's sets (4 KB apart = same set) and
+// evict each other long before the cache is full; with
+// MemoryPool::setCacheColoring they spread over as many sets as the spans'
+// offsets allow. Reports the distinct L1 sets the headers map to, the time per
+// access and, where perf_event_open works, the misses per access.
+//
+//   bench_coloring [--objects N] [--accesses N]
+#include "benchmarks.h"
+#include "../include/Heap.h"
+#include <random>
+#include <set>
+#include <string>
+
+int main(int argc, char** argv)
+{
+    size_t objects = 512;
+    size_t accesses = 20000000;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--objects") objects = std::stoul(argv[i + 1]);
+        else if (arg == "--accesses") accesses = std::stoul(argv[i + 1]);
+    }
+
+    const size_t SIZES[] = { 256, 512, 1024, 2048 };
+    std::cout << "Header chase over " << objects << " objects, " << accesses << " accesses\n"
+              << std::left << std::setw(8) << "size" << std::setw(10) << "coloring" << std::right
+              << std::setw(8) << "sets" << std::setw(12) << "ns/access" << std::setw(14) << "L1D miss/acc"
+              << std::setw(14) << "LLC miss/acc" << "\n";
+
+    PerfCounters counters;
+    for (size_t size : SIZES) {
+        for (bool coloring : { false, true }) {
+            mpool::Heap heap;
+            heap.setCacheColoring(coloring);
+            std::vector<void*> ptrs;
+            std::set<uintptr_t> sets;
+            for (size_t i = 0; i < objects; ++i) {
+                ptrs.push_back(heap.allocate(size));
+                // the L1 is virtually indexed: its set comes from the page offset
+                sets.insert(reinterpret_cast<uintptr_t>(ptrs.back()) % Size::PAGE_SIZE / Size::CACHE_LINE);
+            }
+
+            std::vector<void*> order = ptrs;
+            std::shuffle(order.begin(), order.end(), std::mt19937(42));
+            for (size_t i = 0; i < order.size(); ++i)
+                *static_cast<void**>(order[i]) = order[(i + 1) % order.size()];
+
+            void* p = order[0];
+            for (size_t i = 0; i < objects; ++i) p = *static_cast<void**>(p); // warm up
+            counters.start();
+            Timer t;
+            for (size_t i = 0; i < accesses; ++i) p = *static_cast<void**>(p);
+            // keeps the chase from being moved past the clock read
+            void* volatile sink = p;
+            (void)sink;
+            double ms = t.elapsed();
+            counters.stop();
+
+            auto perAccess = [&](PerfCounters::Event e) {
+                std::ostringstream out;
+                if (counters.value(e) < 0) out << "-";
+                else out << std::fixed << std::setprecision(3) << counters.value(e) / accesses;
+                return out.str();
+            };
+            std::cout << std::left << std::setw(8) << size << std::setw(10) << (coloring ? "on" : "off")
+                      << std::right << std::setw(8) << sets.size() << std::setw(12) << std::fixed
+                      << std::setprecision(2) << ms * 1e6 / accesses << std::setw(14)
+                      << perAccess(PerfCounters::L1D_MISSES) << std::setw(14) << perAccess(PerfCounters::LLC_MISSES)
+                      << "\n";
+
+            for (void* ptr : ptrs) heap.deallocate(ptr, size);
+        }
+    }
+}
@@ -0,0 +1,168 @@
+// Coroutine frame allocation: every call to a coroutine allocates its frame,
+// so short tasks are dominated by it. The mempool variant gives the promise
+// mpool::pooled_promise; newdelete leaves the frame to global operator new
+// and tcmalloc routes it to tc_malloc the same way.
+//
+// Workloads, each run for --tasks coroutine frames per thread:
+//   leaf     a task that returns at once (one small frame)
+//   fanout   a task awaiting 8 leaf tasks (9 frames per request)
+//   large    a task keeping a 3 KB buffer across an await: its frame is
+//            above MAX_ALLOC_SIZE and takes the large-object tier
+//
+//   bench_coroutine_<alloc> [--tasks N] [--threads N]
+#include "benchmarks.h"
+#include "allocators.h"
+#include <coroutine>
+#include <exception>
+#include <string>
+#include <utility>
+
+#if defined(BENCH_USE_MEMPOOL)
+#include "../include/PooledPromise.h"
+using FramePromise = mpool::pooled_promise;
+#elif defined(BENCH_USE_TCMALLOC)
+struct FramePromise
+{
+    static void* operator new(size_t size) { return benchAlloc(size); }
+    static void operator delete(void* frame, size_t size) noexcept { benchDealloc(frame, size); }
+};
+#else
+struct FramePromise {}; // global operator new
+#endif
+
+// GCC 12 reports from_promise on a promise with an empty base as an
+// out-of-bounds access (-Warray-bounds false positive).
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Warray-bounds"
+#endif
+
+// Lazily started task; awaiting it runs it and resumes the awaiter by
+// symmetric transfer when it finishes.
+template <class T>
+class Task
+{
+public:
+    struct promise_type : FramePromise
+    {
+        T value{};
+        std::coroutine_handle<> continuation;
+
+        Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        auto final_suspend() noexcept
+        {
+            struct FinalAwaiter
+            {
+                bool await_ready() noexcept { return false; }
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept
+                {
+                    std::coroutine_handle<> next = h.promise().continuation;
+                    return next ? next : std::noop_coroutine();
+                }
+                void await_resume() noexcept {}
+            };
+            return FinalAwaiter{};
+        }
+        void return_value(T v) { value = v; }
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    explicit Task(std::coroutine_handle<promise_type> h) : handle_(h) {}
+    Task(Task&& other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+    Task(const Task&) = delete;
+    ~Task()
+    {
+        if (handle_) handle_.destroy();
+    }
+
+    bool await_ready() { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter)
+    {
+        handle_.promise().continuation = awaiter;
+        return handle_;
+    }
+    T await_resume() { return handle_.promise().value; }
+
+    // runs a top-level task to completion on the calling thread
+    T run()
+    {
+        handle_.resume();
+        return handle_.promise().value;
+    }
+
+private:
+    std::coroutine_handle<promise_type> handle_;
+};
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+// noinline keeps the compiler from eliding the frame allocation
+[[gnu::noinline]] Task<int> leaf(int x)
+{
+    co_return x + 1;
+}
+
+[[gnu::noinline]] Task<int> fanout(int x)
+{
+    int sum = 0;
+    for (int i = 0; i < 8; ++i)
+        sum += co_await leaf(x + i);
+    co_return sum;
+}
+
+[[gnu::noinline]] Task<int> large(int x)
+{
+    char buf[3072];
+    for (size_t i = 0; i < sizeof(buf); i += 64)
+        buf[i] = static_cast<char>(x + i);
+    int v = co_await leaf(x);
+    co_return v + buf[(x * 64) % sizeof(buf)];
+}
+
+int main(int argc, char** argv)
+{
+    if (!benchAllocatorAvailable())
+        return 1;
+
+    size_t tasks = 1000000;
+    size_t numThreads = 1;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--tasks") tasks = std::stoul(argv[i + 1]);
+        else if (arg == "--threads") numThreads = std::stoul(argv[i + 1]);
+    }
+
+    struct Workload
+    {
+        const char* name;
+        size_t framesPerRequest;
+        Task<int> (*start)(int);
+    };
+    const Workload WORKLOADS[] = { { "leaf", 1, leaf }, { "fanout", 9, fanout }, { "large", 2, large } };
+
+    std::cout << BENCH_ALLOC_NAME << " coroutine frames, " << numThreads << " thread(s), " << tasks
+              << " frames per thread\n"
+              << std::left << std::setw(10) << "workload" << std::right << std::setw(12) << "ms"
+              << std::setw(16) << "ns/frame" << "\n"; // wall clock over all threads' frames
+
+    for (const Workload& w : WORKLOADS) {
+        std::atomic<long long> sink{ 0 };
+        auto body = [&]() {
+            long long local = 0;
+            size_t requests = tasks / w.framesPerRequest;
+            for (size_t i = 0; i < requests; ++i)
+                local += w.start(static_cast<int>(i)).run();
+            sink += local;
+        };
+        Timer timer;
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < numThreads; ++t)
+            threads.emplace_back(body);
+        for (auto& th : threads) th.join();
+        double ms = timer.elapsed();
+        std::cout << std::left << std::setw(10) << w.name << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(12) << ms << std::setw(16) << ms * 1e6 / (tasks * numThreads) << "\n";
+    }
+}
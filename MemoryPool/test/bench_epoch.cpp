@@ -0,0 +1,136 @@
+// Concurrent stack with deferred frees. Threads push and pop a shared stack:
+//   ebr     lock-free Treiber stack; pop reads the top node inside an
+//           mpool::EpochGuard and hands it to MemoryPool::retire
+//   mutex   the same stack behind a std::mutex, freeing nodes at once
+// Also reports the cost of an empty EpochGuard (enter + exit) and how many
+// retired blocks were still waiting at the end and after flushRetired().
+//
+//   bench_epoch [--threads N] [--ops N]
+#include "benchmarks.h"
+#include "../include/MemoryPool.h"
+#include <mutex>
+#include <string>
+
+struct Node
+{
+    Node* next;
+    uint64_t value;
+};
+
+class TreiberStack
+{
+    std::atomic<Node*> head_{ nullptr };
+
+public:
+    void push(uint64_t value)
+    {
+        Node* node = static_cast<Node*>(MemoryPool::allocate(sizeof(Node)));
+        node->value = value;
+        node->next = head_.load(std::memory_order_relaxed);
+        while (!head_.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed))
+            ;
+    }
+
+    bool pop(uint64_t& value)
+    {
+        mpool::EpochGuard guard; // node->next is read while others may pop it
+        Node* node = head_.load(std::memory_order_acquire);
+        while (node && !head_.compare_exchange_weak(node, node->next, std::memory_order_acquire, std::memory_order_acquire))
+            ;
+        if (!node)
+            return false;
+        value = node->value;
+        MemoryPool::retire(node, sizeof(Node));
+        return true;
+    }
+};
+
+class MutexStack
+{
+    std::mutex lock_;
+    Node* head_ = nullptr;
+
+public:
+    void push(uint64_t value)
+    {
+        Node* node = static_cast<Node*>(MemoryPool::allocate(sizeof(Node)));
+        node->value = value;
+        std::lock_guard<std::mutex> guard(lock_);
+        node->next = head_;
+        head_ = node;
+    }
+
+    bool pop(uint64_t& value)
+    {
+        Node* node;
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            node = head_;
+            if (!node)
+                return false;
+            head_ = node->next;
+        }
+        value = node->value;
+        MemoryPool::deallocate(node, sizeof(Node));
+        return true;
+    }
+};
+
+// ops push/pop pairs per thread; returns Mops/s
+template <class Stack>
+double runStack(Stack& stack, size_t numThreads, size_t ops)
+{
+    std::atomic<uint64_t> sum{ 0 };
+    Timer timer;
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < numThreads; ++t) {
+        threads.emplace_back([&, t]() {
+            uint64_t local = 0, v = 0;
+            for (size_t i = 0; i < ops; ++i) {
+                stack.push(t * ops + i);
+                if (stack.pop(v)) local += v;
+            }
+            sum += local;
+        });
+    }
+    for (auto& th : threads) th.join();
+    double ms = timer.elapsed();
+    uint64_t v;
+    while (stack.pop(v)) {}
+    return 2.0 * numThreads * ops / (ms * 1000.0);
+}
+
+int main(int argc, char** argv)
+{
+    size_t numThreads = 4;
+    size_t ops = 1000000;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--threads") numThreads = std::stoul(argv[i + 1]);
+        else if (arg == "--ops") ops = std::stoul(argv[i + 1]);
+    }
+
+    const size_t GUARDS = 10000000;
+    Timer guardTimer;
+    for (size_t i = 0; i < GUARDS; ++i) {
+        mpool::EpochGuard guard;
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+    }
+    double guardNs = guardTimer.elapsed() * 1e6 / GUARDS;
+
+    TreiberStack treiber;
+    double ebr = runStack(treiber, numThreads, ops);
+    size_t waiting = MemoryPool::flushRetired();
+    size_t afterFlush = MemoryPool::flushRetired();
+
+    MutexStack locked;
+    double mutex = runStack(locked, numThreads, ops);
+
+    std::cout << "Concurrent stack, " << numThreads << " threads x " << ops << " push/pop pairs\n"
+              << std::fixed << std::setprecision(2)
+              << "  EpochGuard enter+exit  " << guardNs << " ns"
+              << (Epoch::asymmetricFence.load() ? " (membarrier)" : " (fence)") << "\n"
+              << "  ebr (Treiber + retire) " << ebr << " Mops/s\n"
+              << "  mutex + deallocate     " << mutex << " Mops/s\n"
+              << "  retired still waiting  " << waiting << " after the run, " << afterFlush << " after a second flush\n";
+}
@@ -0,0 +1,106 @@
+// Growth-heavy buffers (string builders, byte vectors): --buffers buffers each
+// get appends of 1-32 bytes until they reach a random length up to --max-len,
+// growing by 1.5x or to exactly the length needed. Blind buffers take the
+// capacity they asked for; slack-aware ones take the block's real size from
+// MemoryPool::allocateAtLeast, so a 130 B request becomes 160 B of capacity
+// and the next appends fit without reallocating. Reports the reallocations
+// and bytes copied per buffer and the time per append.
+//
+//   bench_growth [--buffers N] [--max-len N]
+#include "benchmarks.h"
+#include "../include/MemoryPool.h"
+#include <cstring>
+#include <random>
+#include <string>
+
+namespace
+{
+    class GrowthBuffer
+    {
+    public:
+        GrowthBuffer(bool slackAware, bool exact) : slackAware_(slackAware), exact_(exact) {}
+        ~GrowthBuffer() { MemoryPool::deallocate(data_, capacity_); }
+
+        void append(const char* bytes, size_t n)
+        {
+            if (size_ + n > capacity_) grow(size_ + n);
+            std::memcpy(data_ + size_, bytes, n);
+            size_ += n;
+        }
+
+        size_t reallocations = 0;
+        size_t copied = 0;
+
+    private:
+        void grow(size_t needed)
+        {
+            size_t capacity = exact_ ? needed : std::max(needed, capacity_ + capacity_ / 2);
+            char* data;
+            if (slackAware_) {
+                AllocationResult r = MemoryPool::allocateAtLeast(capacity);
+                data = static_cast<char*>(r.ptr);
+                capacity = r.size;
+            }
+            else {
+                data = static_cast<char*>(MemoryPool::allocate(capacity));
+            }
+            if (data_) {
+                std::memcpy(data, data_, size_);
+                MemoryPool::deallocate(data_, capacity_);
+                ++reallocations;
+                copied += size_;
+            }
+            data_ = data;
+            capacity_ = capacity;
+        }
+
+        bool slackAware_;
+        bool exact_;
+        char* data_ = nullptr;
+        size_t size_ = 0;
+        size_t capacity_ = 0;
+    };
+}
+
+int main(int argc, char** argv)
+{
+    size_t buffers = 200000;
+    size_t maxLen = Size::MAX_ALLOC_SIZE;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--buffers") buffers = std::stoul(argv[i + 1]);
+        else if (arg == "--max-len") maxLen = std::stoul(argv[i + 1]);
+    }
+
+    char chunk[32];
+    std::memset(chunk, 'x', sizeof(chunk));
+    std::cout << "Growth of " << buffers << " buffers to 16-" << maxLen << " bytes in 1-32 byte appends\n"
+              << std::left << std::setw(8) << "growth" << std::setw(8) << "slack" << std::right << std::setw(14)
+              << "reallocs/buf" << std::setw(14) << "copied B/buf" << std::setw(14) << "ns/append" << "\n";
+
+    for (bool exact : { false, true }) {
+        for (bool slackAware : { false, true }) {
+            // same lengths and appends for every variant
+            std::mt19937 rng(42);
+            size_t reallocations = 0, copied = 0, appends = 0;
+            Timer t;
+            for (size_t b = 0; b < buffers; ++b) {
+                GrowthBuffer buffer(slackAware, exact);
+                size_t length = 16 + rng() % (maxLen - 15);
+                for (size_t len = 0; len < length;) {
+                    size_t n = std::min<size_t>(1 + rng() % sizeof(chunk), length - len);
+                    buffer.append(chunk, n);
+                    len += n;
+                    ++appends;
+                }
+                reallocations += buffer.reallocations;
+                copied += buffer.copied;
+            }
+            double ms = t.elapsed();
+            std::cout << std::left << std::setw(8) << (exact ? "exact" : "1.5x") << std::setw(8)
+                      << (slackAware ? "aware" : "blind") << std::right << std::fixed << std::setprecision(2)
+                      << std::setw(14) << static_cast<double>(reallocations) / buffers << std::setw(14)
+                      << static_cast<double>(copied) / buffers << std::setw(14) << ms * 1e6 / appends << "\n";
+        }
+    }
+}
@@ -0,0 +1,145 @@
+// Per-call latency benchmark: alloc and free are timed individually into
+// HDR-style histograms, per size class and thread count, so the rare slow
+// paths (refill from CentralCache/PageCache, mmap, span reclaim) show up in
+// the tail instead of disappearing into a total.
+//
+// Usage:
+//   bench_latency_<alloc> [--json FILE] [--ops N] [--threads 1,2,4]
+#include "benchmarks.h"
+#include "allocators.h"
+#include "histogram.h"
+#include <random>
+#include <sstream>
+#include <string>
+
+struct LatencyResult
+{
+    size_t size;
+    size_t threads;
+    LatencyHistogram alloc;
+    LatencyHistogram free;
+};
+
+// Each thread allocates BATCH objects, then frees them in shuffled order,
+// until opsPerThread allocations are done. Batches are large enough to push
+// every size class through its refill and drain thresholds.
+static void measure(LatencyResult& result, size_t opsPerThread)
+{
+    constexpr size_t BATCH = 4096;
+    std::vector<LatencyHistogram> allocH(result.threads), freeH(result.threads);
+
+    auto threadBody = [&](size_t t) {
+        std::mt19937 rng(static_cast<unsigned>(t + 1));
+        std::vector<void*> ptrs;
+        ptrs.reserve(BATCH);
+        for (size_t done = 0; done < opsPerThread; done += BATCH) {
+            for (size_t i = 0; i < BATCH; ++i) {
+                uint64_t t0 = LatencyClock::now();
+                void* p = benchAlloc(result.size);
+                uint64_t t1 = LatencyClock::now();
+                allocH[t].record(t1 - t0);
+                *static_cast<char*>(p) = 1;
+                ptrs.push_back(p);
+            }
+            std::shuffle(ptrs.begin(), ptrs.end(), rng);
+            for (void* p : ptrs) {
+                uint64_t t0 = LatencyClock::now();
+                benchDealloc(p, result.size);
+                uint64_t t1 = LatencyClock::now();
+                freeH[t].record(t1 - t0);
+            }
+            ptrs.clear();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < result.threads; ++t)
+        threads.emplace_back(threadBody, t);
+    for (auto& th : threads) th.join();
+
+    for (size_t t = 0; t < result.threads; ++t) {
+        result.alloc.merge(allocH[t]);
+        result.free.merge(freeH[t]);
+    }
+}
+
+static void writeStats(std::ostream& os, const LatencyHistogram& h, double tpn)
+{
+    os << "{\"count\": " << h.count()
+       << ", \"p50\": " << h.percentile(0.50) / tpn
+       << ", \"p99\": " << h.percentile(0.99) / tpn
+       << ", \"p999\": " << h.percentile(0.999) / tpn
+       << ", \"max\": " << h.max() / tpn << "}";
+}
+
+static void printRow(const LatencyResult& r, const char* op, const LatencyHistogram& h, double tpn)
+{
+    std::cout << std::right << std::setw(6) << r.size << std::setw(5) << r.threads
+              << std::setw(7) << op
+              << std::setw(10) << h.percentile(0.50) / tpn
+              << std::setw(10) << h.percentile(0.99) / tpn
+              << std::setw(10) << h.percentile(0.999) / tpn
+              << std::setw(12) << h.max() / tpn << "\n";
+}
+
+int main(int argc, char** argv)
+{
+    if (!benchAllocatorAvailable())
+        return 1;
+
+    std::string jsonPath;
+    size_t opsPerThread = 200000;
+    std::vector<size_t> threadCounts;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--json") jsonPath = argv[i + 1];
+        else if (arg == "--ops") opsPerThread = std::stoul(argv[i + 1]);
+        else if (arg == "--threads") {
+            std::stringstream list(argv[i + 1]);
+            std::string n;
+            while (std::getline(list, n, ',')) threadCounts.push_back(std::stoul(n));
+        }
+    }
+    if (threadCounts.empty()) {
+        size_t cores = std::max(1u, std::thread::hardware_concurrency());
+        for (size_t n = 1; n < cores; n *= 2) threadCounts.push_back(n);
+        threadCounts.push_back(cores);
+    }
+
+    const size_t SIZES[] = { 8, 16, 32, 64, 128, 256, 512, 1024, 2048, 4096 };
+    double tpn = LatencyClock::ticksPerNs();
+
+    runWarmup(benchAlloc, benchDealloc);
+    std::cout << BENCH_ALLOC_NAME << " per-call latency (ns, timer: " << LatencyClock::name() << ")\n"
+              << "  size  thr     op       p50       p99     p99.9         max\n"
+              << std::fixed << std::setprecision(0);
+
+    std::vector<LatencyResult> results;
+    results.reserve(std::size(SIZES) * threadCounts.size());
+    for (size_t threads : threadCounts) {
+        for (size_t size : SIZES) {
+            results.push_back({ size, threads, {}, {} });
+            LatencyResult& r = results.back();
+            measure(r, opsPerThread);
+            printRow(r, "alloc", r.alloc, tpn);
+            printRow(r, "free", r.free, tpn);
+        }
+    }
+
+    if (!jsonPath.empty()) {
+        std::ofstream out(jsonPath);
+        out << std::fixed << std::setprecision(1)
+            << "{\"allocator\": \"" << BENCH_ALLOC_NAME << "\", \"timer\": \"" << LatencyClock::name()
+            << "\", \"unit\": \"ns\", \"results\": [\n";
+        for (size_t i = 0; i < results.size(); ++i) {
+            const LatencyResult& r = results[i];
+            out << "  {\"size\": " << r.size << ", \"threads\": " << r.threads << ", \"alloc\": ";
+            writeStats(out, r.alloc, tpn);
+            out << ", \"free\": ";
+            writeStats(out, r.free, tpn);
+            out << "}" << (i + 1 < results.size() ? ",\n" : "\n");
+        }
+        out << "]}\n";
+        std::cout << "Wrote " << jsonPath << "\n";
+    }
+}
@@ -0,0 +1,75 @@
+// Free-list vs bitmap span layout. Threads allocate large sets of blocks and
+// free them in random order, so free lists get long and interleaved across
+// spans (the case where tryReclaimSpans has to walk them) while the bitmap
+// layout only flips bits in span metadata.
+//
+// Layouts are fixed per size class for the life of the process, so run once
+// per layout (python dev.py layout does both, under perf stat if available):
+//   bench_layout --layout list|bitmap [--threads N] [--objects N] [--rounds N]
+#include "benchmarks.h"
+#include "../include/MemoryPool.h"
+#include <random>
+#include <string>
+
+int main(int argc, char** argv)
+{
+    std::string layoutName = "list";
+    size_t numThreads = 4;
+    size_t objects = 50000;
+    size_t rounds = 20;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--layout") layoutName = argv[i + 1];
+        else if (arg == "--threads") numThreads = std::stoul(argv[i + 1]);
+        else if (arg == "--objects") objects = std::stoul(argv[i + 1]);
+        else if (arg == "--rounds") rounds = std::stoul(argv[i + 1]);
+    }
+
+    const size_t SIZES[] = { 16, 48, 64, 128, 256, 512 };
+    SpanLayout layout = layoutName == "bitmap" ? SpanLayout::Bitmap : SpanLayout::FreeList;
+    for (size_t s : SIZES)
+        MemoryPool::setSpanLayout(s, layout);
+
+    std::atomic<long long> allocNs{ 0 }, freeNs{ 0 };
+    auto threadBody = [&](size_t t) {
+        std::mt19937 rng(static_cast<unsigned>(t + 1));
+        std::vector<std::pair<void*, size_t>> live;
+        live.reserve(objects);
+        for (size_t r = 0; r < rounds; ++r) {
+            auto t0 = steady_clock::now();
+            for (size_t i = 0; i < objects; ++i) {
+                size_t s = SIZES[rng() % std::size(SIZES)];
+                void* p = MemoryPool::allocate(s);
+                *static_cast<char*>(p) = 1;
+                live.emplace_back(p, s);
+            }
+            auto t1 = steady_clock::now();
+            std::shuffle(live.begin(), live.end(), rng);
+            for (auto& [p, s] : live) MemoryPool::deallocate(p, s);
+            auto t2 = steady_clock::now();
+            live.clear();
+            allocNs += duration_cast<nanoseconds>(t1 - t0).count();
+            freeNs += duration_cast<nanoseconds>(t2 - t1).count();
+        }
+    };
+
+    PoolStats before = MemoryPool::getStats();
+    Timer timer;
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < numThreads; ++t)
+        threads.emplace_back(threadBody, t);
+    for (auto& th : threads) th.join();
+    double ms = timer.elapsed();
+    PoolStats after = MemoryPool::getStats();
+
+    double ops = double(numThreads) * rounds * objects;
+    std::cout << "Span layout: " << layoutName << " (" << numThreads << " threads, " << rounds
+              << " rounds x " << objects << " objects)\n"
+              << std::fixed << std::setprecision(2)
+              << "  total          " << ms << " ms\n"
+              << "  alloc          " << allocNs / ops << " ns/op\n"
+              << "  free           " << freeNs / ops << " ns/op (includes span reclaim)\n"
+              << "  spans released " << after.centralSpansReleased - before.centralSpansReleased << "\n"
+              << "  mapped at end  " << after.mappedBytes / (1024.0 * 1024.0) << " MB\n"
+              << "  central free   " << after.centralFreeBytes / (1024.0 * 1024.0) << " MB\n";
+}
@@ -0,0 +1,216 @@
+// Memory-efficiency benchmark: drives a ramp-up / steady / ramp-down workload
+// and samples RSS (/proc/self/statm) plus, for the pool, its own counters.
+// Reports per phase the peak RSS and the fragmentation ratio (RSS over live
+// bytes, and the pool's mapped bytes over the live bytes it serves itself),
+// and what is still held once the workload has freed most of its objects.
+//
+// Usage:
+//   bench_memory_<alloc> [--threads N] [--live-mb N] [--keep PCT] [--csv FILE]
+//                        [--maintenance MS]   (mempool: background trim period)
+#include "benchmarks.h"
+#include "allocators.h"
+#include "../include/Size.h"
+#include "../include/Stats.h"
+#include <mutex>
+#include <random>
+#include <string>
+
+using Block = std::pair<void*, size_t>;
+
+enum Phase { RAMP_UP, STEADY, RAMP_DOWN, IDLE, NUM_PHASES };
+static const char* PHASE_NAMES[NUM_PHASES] = { "ramp-up", "steady", "ramp-down", "after" };
+
+struct Sample
+{
+    double ms;
+    Phase phase;
+    size_t rss;
+    size_t live;
+    size_t poolLive; // the part of live at most Size::MAX_ALLOC_SIZE per object
+    PoolStats pool;
+};
+
+static size_t pickSize(std::mt19937& rng)
+{
+    size_t c = rng() % 100;
+    if (c < 70) return 8 + rng() % 249;
+    if (c < 95) return 257 + rng() % 1792;
+    return 2049 + rng() % 14336;
+}
+
+static PoolStats poolStats()
+{
+#ifdef BENCH_USE_MEMPOOL
+    return MemoryPool::getStats();
+#else
+    return {};
+#endif
+}
+
+int main(int argc, char** argv)
+{
+    if (!benchAllocatorAvailable())
+        return 1;
+
+    size_t numThreads = 4;
+    size_t liveTarget = size_t(128) << 20;
+    size_t keepPct = 10;
+    std::string csvPath;
+    [[maybe_unused]] size_t maintenanceMs = 0; // pool variant only
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--threads") numThreads = std::stoul(argv[i + 1]);
+        else if (arg == "--live-mb") liveTarget = std::stoul(argv[i + 1]) << 20;
+        else if (arg == "--keep") keepPct = std::stoul(argv[i + 1]);
+        else if (arg == "--csv") csvPath = argv[i + 1];
+        else if (arg == "--maintenance") maintenanceMs = std::stoul(argv[i + 1]);
+    }
+#ifdef BENCH_USE_MEMPOOL
+    if (maintenanceMs)
+        MemoryPool::startMaintenance(milliseconds(maintenanceMs));
+#endif
+
+    // objects above Size::MAX_ALLOC_SIZE go to malloc even in the pool
+    // variant, so the pool's own counters are set against the rest
+    std::atomic<size_t> liveBytes{ 0 };
+    std::atomic<size_t> poolLiveBytes{ 0 };
+    auto addLive = [&](size_t s) {
+        liveBytes.fetch_add(s, std::memory_order_relaxed);
+        if (s <= Size::MAX_ALLOC_SIZE) poolLiveBytes.fetch_add(s, std::memory_order_relaxed);
+    };
+    auto subLive = [&](size_t s) {
+        liveBytes.fetch_sub(s, std::memory_order_relaxed);
+        if (s <= Size::MAX_ALLOC_SIZE) poolLiveBytes.fetch_sub(s, std::memory_order_relaxed);
+    };
+    std::atomic<int> phase{ RAMP_UP };
+    std::atomic<size_t> arrived{ 0 };
+    std::vector<std::vector<Block>> owned(numThreads);
+
+    // each phase ends at a barrier so the sampler sees clean boundaries
+    auto barrier = [&](size_t generation) {
+        arrived.fetch_add(1);
+        while (arrived.load() < generation * numThreads) std::this_thread::yield();
+    };
+
+    auto threadBody = [&](size_t t) {
+        std::mt19937 rng(static_cast<unsigned>(t + 1));
+        auto& mine = owned[t];
+        size_t perThread = liveTarget / numThreads;
+        size_t myLive = 0;
+
+        while (myLive < perThread) {
+            size_t s = pickSize(rng);
+            void* p = benchAlloc(s);
+            for (size_t off = 0; off < s; off += 4096) static_cast<char*>(p)[off] = 1;
+            mine.push_back({ p, s });
+            myLive += s;
+            addLive(s);
+        }
+        barrier(1);
+
+        // steady: replace random objects, keeping live bytes roughly constant
+        for (size_t i = 0; i < 4 * mine.size(); ++i) {
+            Block& b = mine[rng() % mine.size()];
+            benchDealloc(b.first, b.second);
+            subLive(b.second);
+            b.second = pickSize(rng);
+            b.first = benchAlloc(b.second);
+            for (size_t off = 0; off < b.second; off += 4096) static_cast<char*>(b.first)[off] = 1;
+            addLive(b.second);
+        }
+        barrier(2);
+
+        // ramp-down: free random objects until only keepPct remain
+        std::shuffle(mine.begin(), mine.end(), rng);
+        size_t keep = mine.size() * keepPct / 100;
+        while (mine.size() > keep) {
+            benchDealloc(mine.back().first, mine.back().second);
+            subLive(mine.back().second);
+            mine.pop_back();
+        }
+        barrier(3);
+    };
+
+    size_t baselineRss = currentRssBytes();
+    std::vector<Sample> samples;
+    std::mutex samplesLock;
+    std::atomic<bool> sampling{ true };
+    Timer timer;
+    std::thread sampler([&]() {
+        while (sampling.load()) {
+            Sample s{ timer.elapsed(), static_cast<Phase>(phase.load()), currentRssBytes(),
+                      liveBytes.load(std::memory_order_relaxed), poolLiveBytes.load(std::memory_order_relaxed),
+                      poolStats() };
+            {
+                std::lock_guard<std::mutex> g(samplesLock);
+                samples.push_back(s);
+            }
+            std::this_thread::sleep_for(milliseconds(2));
+        }
+    });
+
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < numThreads; ++t)
+        threads.emplace_back(threadBody, t);
+    for (int p = STEADY; p <= IDLE; ++p) {
+        while (arrived.load() < p * numThreads) std::this_thread::yield();
+        phase = p;
+    }
+    for (auto& th : threads) th.join();
+
+    // let any background trimming happen, then take the final picture
+    std::this_thread::sleep_for(milliseconds(50));
+    sampling = false;
+    sampler.join();
+    samples.push_back({ timer.elapsed(), IDLE, currentRssBytes(), liveBytes.load(), poolLiveBytes.load(), poolStats() });
+
+    auto mb = [](size_t bytes) { return bytes / (1024.0 * 1024.0); };
+    auto over = [&](size_t rss) { return rss > baselineRss ? rss - baselineRss : 0; };
+
+    std::cout << BENCH_ALLOC_NAME << " memory efficiency (" << numThreads << " threads, "
+              << mb(liveTarget) << " MB live target, keep " << keepPct << "%)\n"
+              << std::fixed << std::setprecision(2)
+              << std::left << std::setw(11) << "phase" << std::right
+              << std::setw(14) << "peak RSS MB" << std::setw(14) << "live MB"
+              << std::setw(12) << "RSS/live" << std::setw(14) << "mapped MB" << std::setw(14) << "mapped/live" << "\n";
+    for (int p = RAMP_UP; p < NUM_PHASES; ++p) {
+        const Sample* peak = nullptr;
+        for (const Sample& s : samples)
+            if (s.phase == p && (!peak || s.rss > peak->rss)) peak = &s;
+        if (!peak) continue;
+        double live = static_cast<double>(std::max<size_t>(peak->live, 1));
+        double poolLive = static_cast<double>(std::max<size_t>(peak->poolLive, 1));
+        std::cout << std::left << std::setw(11) << PHASE_NAMES[p] << std::right
+                  << std::setw(14) << mb(over(peak->rss)) << std::setw(14) << mb(peak->live)
+                  << std::setw(12) << over(peak->rss) / live
+                  << std::setw(14) << mb(peak->pool.mappedBytes)
+                  << std::setw(14) << peak->pool.mappedBytes / poolLive << "\n";
+    }
+
+    const Sample& last = samples.back();
+    std::cout << "retained after ramp-down: " << mb(over(last.rss)) << " MB RSS for "
+              << mb(last.live) << " MB live\n";
+#ifdef BENCH_USE_MEMPOOL
+    size_t cached = last.pool.threadHeldBytes > last.poolLive ? last.pool.threadHeldBytes - last.poolLive : 0;
+    std::cout << "  pool: mapped " << mb(last.pool.mappedBytes)
+              << " MB, PageCache free " << mb(last.pool.pageFreeBytes)
+              << " MB (span cache " << mb(last.pool.pageCachedBytes) << " MB)"
+              << ", CentralCache spans " << mb(last.pool.centralSpanBytes)
+              << " MB (free blocks " << mb(last.pool.centralFreeBytes)
+              << " MB), ThreadCaches ~" << mb(cached) << " MB\n"
+              << "  (objects above " << Size::MAX_ALLOC_SIZE << " B come from malloc: mapped/live and the"
+              << " ThreadCache estimate leave them out of live)\n";
+#endif
+
+    if (!csvPath.empty()) {
+        std::ofstream csv(csvPath);
+        csv << "allocator,ms,phase,rss,live,pool_live,mapped,page_free,central_span,central_free,thread_held\n";
+        for (const Sample& s : samples)
+            csv << BENCH_ALLOC_NAME << "," << s.ms << "," << PHASE_NAMES[s.phase] << "," << over(s.rss) << ","
+                << s.live << "," << s.poolLive << "," << s.pool.mappedBytes << "," << s.pool.pageFreeBytes << ","
+                << s.pool.centralSpanBytes << "," << s.pool.centralFreeBytes << "," << s.pool.threadHeldBytes << "\n";
+    }
+
+    for (auto& mine : owned)
+        for (auto& [p, s] : mine) benchDealloc(p, s);
+}
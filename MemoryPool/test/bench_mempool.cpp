@@ -6,6 +6,7 @@ int main()
     auto alloc   = MemoryPool::allocate;
     auto dealloc = MemoryPool::deallocate;
 
+    testColdStart      ("Memory Pool:", alloc, dealloc);
     runWarmup(alloc, dealloc);
     testSmallAllocation("Memory Pool:", alloc, dealloc);
     testMultiThreaded  ("Memory Pool:", alloc, dealloc);
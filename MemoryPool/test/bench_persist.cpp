@@ -0,0 +1,215 @@
+// Warm restart of an in-memory cache: a builder process fills a hash table of
+// --entries values (--value bytes each) and exits; the restarted process then
+// gets the cache back either way:
+//   persistent  reopen the file-backed mpool::SharedHeap the builder used and
+//               find the table through root(); nothing is rebuilt
+//   snapshot    read the snapshot file the builder wrote and insert every
+//               record into a fresh heap
+// "ready" is the time until the first lookup can be answered, "scan" a lookup
+// of every key afterwards (the persistent heap faults its pages in here).
+// The persistent heap is also reopened after a builder that died without
+// close(), which makes the open check every free list.
+//
+//   bench_persist [--entries N] [--value N] [--dir PATH]
+#include "benchmarks.h"
+#include "../include/SharedHeap.h"
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <sys/wait.h>
+
+namespace
+{
+    // Everything in the heap links by offset, so it is valid at any address.
+    struct Entry
+    {
+        uint64_t key;
+        uint64_t next; // offset of the next entry in the bucket, 0 at the end
+        uint32_t length;
+        char value[1];
+    };
+
+    struct Table
+    {
+        uint64_t buckets;
+        uint64_t count;
+        uint64_t heads[1];
+    };
+
+    size_t tableBytes(uint64_t buckets)
+    {
+        return sizeof(Table) + (buckets - 1) * sizeof(uint64_t);
+    }
+
+    size_t heapBytes(size_t entries, size_t valueSize)
+    {
+        return entries * (valueSize + 64) + tableBytes(entries * 2) + (16 << 20);
+    }
+
+    uint64_t bucketOf(const Table* table, uint64_t key)
+    {
+        return (key * 0x9E3779B97F4A7C15ull) >> 20 & (table->buckets - 1);
+    }
+
+    Table* createTable(mpool::SharedHeap& heap, size_t entries)
+    {
+        uint64_t buckets = 1;
+        while (buckets < entries) buckets <<= 1;
+        Table* table = static_cast<Table*>(heap.allocate(tableBytes(buckets)));
+        std::memset(table, 0, tableBytes(buckets));
+        table->buckets = buckets;
+        heap.setRoot(heap.toOffset(table));
+        return table;
+    }
+
+    void insert(mpool::SharedHeap& heap, Table* table, uint64_t key, const char* value, uint32_t length)
+    {
+        Entry* e = static_cast<Entry*>(heap.allocate(offsetof(Entry, value) + length));
+        e->key = key;
+        e->length = length;
+        std::memcpy(e->value, value, length);
+        uint64_t& head = table->heads[bucketOf(table, key)];
+        e->next = head;
+        head = heap.toOffset(e);
+        ++table->count;
+    }
+
+    const Entry* find(const mpool::SharedHeap& heap, const Table* table, uint64_t key)
+    {
+        for (uint64_t off = table->heads[bucketOf(table, key)]; off;) {
+            const Entry* e = static_cast<const Entry*>(heap.fromOffset(off));
+            if (e->key == key) return e;
+            off = e->next;
+        }
+        return nullptr;
+    }
+
+    void makeValue(std::string& value, uint64_t key, size_t length)
+    {
+        value.assign(length, static_cast<char>('a' + key % 26));
+        std::memcpy(value.data(), &key, std::min(length, sizeof(key)));
+    }
+
+    // Builds the cache in the file heap and writes the snapshot, in a child
+    // process that exits like a service shutting down (or crashing).
+    bool build(const std::string& heapPath, const std::string& snapPath, size_t entries, size_t valueSize, bool crash)
+    {
+        pid_t child = fork();
+        if (child == 0) {
+            mpool::SharedHeap heap;
+            if (!heap.openFile(heapPath.c_str(), heapBytes(entries, valueSize))) _exit(1);
+            Table* table = createTable(heap, entries);
+            std::FILE* snap = std::fopen(snapPath.c_str(), "wb");
+            if (!snap) _exit(1);
+            std::string value;
+            for (uint64_t key = 0; key < entries; ++key) {
+                makeValue(value, key, valueSize);
+                uint32_t length = static_cast<uint32_t>(value.size());
+                insert(heap, table, key, value.data(), length);
+                std::fwrite(&key, sizeof(key), 1, snap);
+                std::fwrite(&length, sizeof(length), 1, snap);
+                std::fwrite(value.data(), 1, length, snap);
+            }
+            std::fclose(snap);
+            if (!crash) heap.close();
+            _exit(0);
+        }
+        int status = 0;
+        waitpid(child, &status, 0);
+        return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+
+    // Looks every key up; returns the number found with the right value.
+    size_t scan(const mpool::SharedHeap& heap, const Table* table, size_t entries)
+    {
+        size_t found = 0;
+        for (uint64_t key = 0; key < entries; ++key) {
+            const Entry* e = find(heap, table, key);
+            uint64_t stored = 0;
+            if (e) std::memcpy(&stored, e->value, std::min<size_t>(e->length, sizeof(stored)));
+            found += e && (e->length < sizeof(stored) || stored == key);
+        }
+        return found;
+    }
+
+    void report(const char* name, double readyMs, double scanMs, size_t found, size_t entries)
+    {
+        std::cout << std::left << std::setw(22) << name << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(12) << readyMs << std::setw(12) << scanMs
+                  << (found == entries ? "" : "  (entries missing)") << "\n";
+    }
+
+    bool reopen(const char* name, const std::string& heapPath, size_t entries)
+    {
+        Timer t;
+        mpool::SharedHeap heap;
+        if (!heap.openFile(heapPath.c_str(), 0)) {
+            std::cout << name << ": open refused\n";
+            return false;
+        }
+        const Table* table = static_cast<const Table*>(heap.fromOffset(heap.root()));
+        volatile bool first = find(heap, table, 0) != nullptr;
+        (void)first;
+        double readyMs = t.elapsed();
+        Timer s;
+        size_t found = scan(heap, table, entries);
+        report(name, readyMs, s.elapsed(), found, entries);
+        return found == entries;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    size_t entries = 1000000;
+    size_t valueSize = 100;
+    std::string dir = "/tmp";
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--entries") entries = std::stoul(argv[i + 1]);
+        else if (arg == "--value") valueSize = std::stoul(argv[i + 1]);
+        else if (arg == "--dir") dir = argv[i + 1];
+    }
+    std::string heapPath = dir + "/bench_persist.heap";
+    std::string snapPath = dir + "/bench_persist.snap";
+    std::remove(heapPath.c_str());
+
+    std::cout << "Warm restart of " << entries << " entries of " << valueSize << " bytes\n"
+              << std::left << std::setw(22) << "restart" << std::right << std::setw(12) << "ready ms"
+              << std::setw(12) << "scan ms" << "\n";
+
+    bool ok = build(heapPath, snapPath, entries, valueSize, false);
+    ok = ok && reopen("persistent", heapPath, entries);
+
+    if (ok) {
+        Timer t;
+        mpool::SharedHeap heap;
+        ok = heap.create(nullptr, heapBytes(entries, valueSize));
+        std::FILE* snap = ok ? std::fopen(snapPath.c_str(), "rb") : nullptr;
+        if (snap) {
+            Table* table = createTable(heap, entries);
+            std::vector<char> value;
+            uint64_t key;
+            uint32_t length;
+            while (std::fread(&key, sizeof(key), 1, snap) == 1 && std::fread(&length, sizeof(length), 1, snap) == 1) {
+                value.resize(length);
+                if (std::fread(value.data(), 1, length, snap) != length) break;
+                insert(heap, table, key, value.data(), length);
+            }
+            std::fclose(snap);
+            double readyMs = t.elapsed();
+            Timer s;
+            size_t found = scan(heap, table, entries);
+            report("snapshot", readyMs, s.elapsed(), found, entries);
+            ok = found == entries;
+        }
+    }
+
+    std::remove(heapPath.c_str());
+    ok = ok && build(heapPath, snapPath, entries, valueSize, true);
+    ok = ok && reopen("persistent (crashed)", heapPath, entries);
+
+    std::remove(heapPath.c_str());
+    std::remove(snapPath.c_str());
+    return ok ? 0 : 1;
+}
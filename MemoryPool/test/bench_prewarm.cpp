@@ -0,0 +1,79 @@
+// Latency of the first N allocations in a fresh process, with and without
+// setting the pool up beforehand. Each mode needs its own process (python
+// dev.py prewarm runs all of them):
+//   cold      no setup: refills go to PageCache and mmap, pages fault on touch
+//   reserve   MemoryPool::reserve maps the pages up front (no populate)
+//   populate  MemoryPool::reserve with MAP_POPULATE
+//   prewarm   populate + MemoryPool::prewarm of every size used, including
+//             the calling thread's cache
+//
+//   bench_prewarm --mode cold|reserve|populate|prewarm [--count N]
+#include "benchmarks.h"
+#include "histogram.h"
+#include "../include/MemoryPool.h"
+#include <random>
+#include <string>
+
+int main(int argc, char** argv)
+{
+    std::string mode = "cold";
+    size_t count = 20000;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--mode") mode = argv[i + 1];
+        else if (arg == "--count") count = std::stoul(argv[i + 1]);
+    }
+
+    const size_t SIZES[] = { 16, 32, 64, 128, 256, 512, 1024, 2048 };
+    std::mt19937 rng(42);
+    std::vector<size_t> sizes(count);
+    size_t totalBytes = 0;
+    for (auto& s : sizes) {
+        s = SIZES[rng() % std::size(SIZES)];
+        totalBytes += s;
+    }
+    std::vector<void*> live(count);
+    LatencyClock::ticksPerNs(); // calibrate before anything is timed
+
+    long faults = minorPageFaults();
+    Timer setup;
+    if (mode != "cold") {
+        // spans round block sizes up, so leave headroom
+        MemoryPool::reserve(totalBytes * 2, mode != "reserve");
+    }
+    if (mode == "prewarm") {
+        for (size_t s : SIZES) {
+            size_t n = std::count(sizes.begin(), sizes.end(), s);
+            MemoryPool::prewarm(s, n, true);
+        }
+    }
+    double setupMs = setup.elapsed();
+    long setupFaults = minorPageFaults() - faults;
+
+    LatencyHistogram hist;
+    faults = minorPageFaults();
+    Timer run;
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t t0 = LatencyClock::now();
+        void* p = MemoryPool::allocate(sizes[i]);
+        *static_cast<char*>(p) = 1;
+        uint64_t t1 = LatencyClock::now();
+        hist.record(t1 - t0);
+        live[i] = p;
+    }
+    double runMs = run.elapsed();
+    long runFaults = minorPageFaults() - faults;
+
+    for (size_t i = 0; i < count; ++i)
+        MemoryPool::deallocate(live[i], sizes[i]);
+
+    double perNs = LatencyClock::ticksPerNs();
+    std::cout << "First " << count << " allocations, mode " << mode << " (" << LatencyClock::name() << ")\n"
+              << std::fixed << std::setprecision(1)
+              << "  setup   " << setupMs << " ms, " << setupFaults << " minor faults\n"
+              << "  run     " << runMs << " ms, " << runFaults << " minor faults\n"
+              << "  p50     " << hist.percentile(0.50) / perNs << " ns\n"
+              << "  p99     " << hist.percentile(0.99) / perNs << " ns\n"
+              << "  p99.9   " << hist.percentile(0.999) / perNs << " ns\n"
+              << "  max     " << hist.max() / perNs << " ns\n";
+}
@@ -0,0 +1,132 @@
+// Worst-case latency of the allocation path: --threads threads each run --ops
+// allocate/free operations over a window of live objects of random sizes up to
+// MAX_ALLOC_SIZE, timing every call, while the maintenance thread trims the
+// pool every 10 ms and a churn thread (not real-time) allocates and frees in
+// bursts to contend for CentralCache. Modes:
+//   normal    the pool as configured by default
+//   realtime  MemoryPool::startRealTime(--reserve-mb) first, and the measured
+//             threads marked with enterRealTimeThread()
+// Reports the latency percentiles and maximum and the allocations that
+// returned nullptr. In realtime mode it exits with status 1 if the maximum
+// exceeds --bound-us. The measured threads ask for SCHED_FIFO, without which
+// the bound also has to cover being preempted; it says whether they got it.
+// Each thread first times --ops empty regions the same way: that maximum is
+// what the machine itself (interrupts, a hypervisor) adds, and a bound below
+// it cannot hold on that machine however short the allocation path is.
+//
+//   bench_realtime [--mode normal|realtime] [--threads N] [--ops N]
+//                  [--reserve-mb N] [--bound-us N]
+#include "benchmarks.h"
+#include "histogram.h"
+#include "../include/MemoryPool.h"
+#include <pthread.h>
+#include <random>
+#include <sched.h>
+#include <string>
+
+int main(int argc, char** argv)
+{
+    std::string mode = "realtime";
+    size_t numThreads = 1;
+    size_t ops = 5000000;
+    size_t reserveMb = 64;
+    double boundUs = 100;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--mode") mode = argv[i + 1];
+        else if (arg == "--threads") numThreads = std::stoul(argv[i + 1]);
+        else if (arg == "--ops") ops = std::stoul(argv[i + 1]);
+        else if (arg == "--reserve-mb") reserveMb = std::stoul(argv[i + 1]);
+        else if (arg == "--bound-us") boundUs = std::stod(argv[i + 1]);
+    }
+    bool realTime = mode == "realtime";
+    if (realTime && !MemoryPool::startRealTime(reserveMb << 20)) {
+        std::cout << "could not reserve " << reserveMb << " MB\n";
+        return 1;
+    }
+    MemoryPool::startMaintenance(std::chrono::milliseconds(10));
+
+    constexpr size_t LIVE = 4096;
+    std::atomic<bool> stop{ false };
+    std::thread churn([&] {
+        std::mt19937 rng(7);
+        std::vector<std::pair<void*, size_t>> burst;
+        while (!stop.load(std::memory_order_relaxed)) {
+            for (int i = 0; i < 2000; ++i) {
+                size_t size = 8 + rng() % (Size::MAX_ALLOC_SIZE - 7);
+                if (void* p = MemoryPool::allocate(size)) burst.emplace_back(p, size);
+            }
+            for (auto& [p, size] : burst) MemoryPool::deallocate(p, size);
+            burst.clear();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+
+    std::vector<LatencyHistogram> hist(numThreads), noise(numThreads);
+    std::vector<size_t> failed(numThreads);
+    std::atomic<size_t> fifoThreads{ 0 };
+    auto body = [&](size_t t) {
+        sched_param param{};
+        param.sched_priority = sched_get_priority_min(SCHED_FIFO);
+        if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0) ++fifoThreads;
+        if (realTime) MemoryPool::enterRealTimeThread();
+
+        for (size_t i = 0; i < ops; ++i) {
+            uint64_t t0 = LatencyClock::now();
+            uint64_t t1 = LatencyClock::now();
+            noise[t].record(t1 - t0);
+        }
+
+        std::mt19937 rng(static_cast<unsigned>(t + 1));
+        std::vector<std::pair<void*, size_t>> live(LIVE, { nullptr, 0 });
+        LatencyHistogram& h = hist[t];
+        for (size_t i = 0; i < ops; ++i) {
+            auto& slot = live[rng() % LIVE];
+            size_t size = 8 + rng() % (Size::MAX_ALLOC_SIZE - 7);
+            uint64_t t0 = LatencyClock::now();
+            if (slot.first) MemoryPool::deallocate(slot.first, slot.second);
+            void* p = MemoryPool::allocate(size);
+            uint64_t t1 = LatencyClock::now();
+            h.record(t1 - t0);
+            slot = { p, size };
+            if (p) *static_cast<char*>(p) = 1;
+            else ++failed[t];
+        }
+        for (auto& [p, size] : live)
+            if (p) MemoryPool::deallocate(p, size);
+        if (realTime) MemoryPool::leaveRealTimeThread();
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < numThreads; ++t)
+        threads.emplace_back(body, t);
+    for (auto& th : threads) th.join();
+    stop = true;
+    churn.join();
+    MemoryPool::stopMaintenance();
+
+    LatencyHistogram all, empty;
+    size_t nulls = 0;
+    for (size_t t = 0; t < numThreads; ++t) {
+        all.merge(hist[t]);
+        empty.merge(noise[t]);
+        nulls += failed[t];
+    }
+    double perUs = LatencyClock::ticksPerNs() * 1e3;
+    double maxUs = all.max() / perUs;
+    std::cout << "mode " << mode << ", " << numThreads << " threads x " << ops << " free+allocate ("
+              << fifoThreads.load() << " with SCHED_FIFO), " << LatencyClock::name() << "\n"
+              << std::fixed << std::setprecision(2)
+              << "  p50 " << all.percentile(0.5) / perUs << " us  p99.99 " << all.percentile(0.9999) / perUs
+              << " us  max " << maxUs << " us\n"
+              << "  empty region: p99.99 " << empty.percentile(0.9999) / perUs << " us  max "
+              << empty.max() / perUs << " us\n"
+              << "  nullptr " << nulls << "  real-time lock misses " << RealTime::lockMisses()
+              << " (waited " << RealTime::contentionWaits() << ")"
+              << "  mapped " << MemoryPool::getStats().mappedBytes / (1 << 20) << " MB\n";
+    if (realTime && maxUs > boundUs) {
+        std::cout << "FAIL: max " << maxUs << " us exceeds the " << boundUs << " us bound\n";
+        return 1;
+    }
+    return 0;
+}
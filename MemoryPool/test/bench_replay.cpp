@@ -0,0 +1,243 @@
+// Trace replay benchmark: runs a recorded allocation trace against one allocator.
+//
+// Trace format (text, one op per line, '#' starts a comment):
+//   <thread> a <id> <size>    thread allocates object <id> of <size> bytes
+//   <thread> f <id>           thread frees object <id>
+// Each thread replays its own ops in file order. Any thread may free any
+// object; a free whose allocation belongs to another thread waits until that
+// allocation has happened, so every allocator sees the same schedule. Object
+// ids may be reused once freed.
+//
+// Usage:
+//   bench_replay_<alloc> <trace>
+//   bench_replay_<alloc> --generate <trace> [threads] [opsPerThread]
+#include "benchmarks.h"
+#include "allocators.h"
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+
+struct TraceOp
+{
+    uint32_t obj;   // dense object index
+    bool isFree;
+};
+
+struct Trace
+{
+    std::vector<std::vector<TraceOp>> threads;
+    std::vector<uint32_t> sizes;    // by dense object index
+    size_t numOps{ 0 };
+    size_t crossThreadFrees{ 0 };
+    size_t peakLiveBytes{ 0 };
+};
+
+static bool loadTrace(const char* path, Trace& trace)
+{
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Cannot open trace " << path << "\n";
+        return false;
+    }
+
+    std::unordered_map<uint64_t, uint32_t> liveIds;    // trace id -> dense index
+    std::vector<uint32_t> owner;
+    size_t liveBytes = 0;
+    std::string line;
+    size_t lineNo = 0;
+    while (std::getline(in, line)) {
+        ++lineNo;
+        if (line.empty() || line[0] == '#') continue;
+
+        std::istringstream ls(line);
+        size_t tid;
+        char op;
+        uint64_t id;
+        if (!(ls >> tid >> op >> id) || (op != 'a' && op != 'f')) {
+            std::cerr << path << ":" << lineNo << ": malformed op\n";
+            return false;
+        }
+        if (tid >= trace.threads.size()) trace.threads.resize(tid + 1);
+
+        if (op == 'a') {
+            uint32_t size;
+            if (!(ls >> size) || size == 0 || liveIds.count(id)) {
+                std::cerr << path << ":" << lineNo << ": bad allocation\n";
+                return false;
+            }
+            uint32_t obj = static_cast<uint32_t>(trace.sizes.size());
+            trace.sizes.push_back(size);
+            owner.push_back(static_cast<uint32_t>(tid));
+            liveIds[id] = obj;
+            trace.threads[tid].push_back({ obj, false });
+            liveBytes += size;
+            trace.peakLiveBytes = std::max(trace.peakLiveBytes, liveBytes);
+        } else {
+            auto it = liveIds.find(id);
+            if (it == liveIds.end()) {
+                std::cerr << path << ":" << lineNo << ": free of unknown id " << id << "\n";
+                return false;
+            }
+            uint32_t obj = it->second;
+            liveIds.erase(it);
+            trace.threads[tid].push_back({ obj, true });
+            liveBytes -= trace.sizes[obj];
+            if (owner[obj] != tid) ++trace.crossThreadFrees;
+        }
+        ++trace.numOps;
+    }
+    if (!liveIds.empty())
+        std::cerr << "Note: " << liveIds.size() << " objects are never freed by the trace\n";
+    return true;
+}
+
+// Synthetic server-like trace: mostly small objects, a tail of large ones,
+// and ~20% of objects handed to another thread to be freed there.
+static bool generateTrace(const char* path, size_t numThreads, size_t opsPerThread)
+{
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "Cannot write trace " << path << "\n";
+        return false;
+    }
+    out << "# synthetic trace: " << numThreads << " threads, " << opsPerThread << " ops each\n";
+
+    std::mt19937 rng(12345);
+    std::uniform_int_distribution<int> pct(0, 99);
+    auto pickSize = [&]() -> uint32_t {
+        int c = pct(rng);
+        if (c < 70) return 8 + rng() % 249;
+        if (c < 95) return 257 + rng() % 1792;
+        return 2049 + rng() % 14336;
+    };
+
+    std::vector<std::vector<uint64_t>> live(numThreads);
+    std::vector<size_t> done(numThreads, 0);
+    uint64_t nextId = 0;
+    size_t remaining = numThreads;
+    while (remaining) {
+        size_t t = rng() % numThreads;
+        if (done[t] == opsPerThread) continue;
+        if (++done[t] == opsPerThread) --remaining;
+
+        auto& mine = live[t];
+        if (mine.empty() || pct(rng) < 55) {
+            uint64_t id = nextId++;
+            out << t << " a " << id << " " << pickSize() << "\n";
+            size_t dst = pct(rng) < 20 ? rng() % numThreads : t;
+            live[dst].push_back(id);
+        } else {
+            size_t k = rng() % mine.size();
+            out << t << " f " << mine[k] << "\n";
+            mine[k] = mine.back();
+            mine.pop_back();
+        }
+    }
+    for (size_t t = 0; t < numThreads; ++t)
+        for (uint64_t id : live[t]) out << t << " f " << id << "\n";
+    return true;
+}
+
+static void printLatency(const char* label, std::vector<uint64_t>& ns)
+{
+    std::cout << "  " << std::left << std::setw(15) << label
+              << "p50 " << percentile(ns, 0.50)
+              << "  p99 " << percentile(ns, 0.99)
+              << "  p99.9 " << percentile(ns, 0.999)
+              << "  max " << percentile(ns, 1.0) << " ns\n";
+}
+
+int main(int argc, char** argv)
+{
+    if (argc >= 3 && std::string(argv[1]) == "--generate") {
+        size_t threads = argc > 3 ? std::stoul(argv[3]) : 4;
+        size_t ops = argc > 4 ? std::stoul(argv[4]) : 200000;
+        return generateTrace(argv[2], threads, ops) ? 0 : 1;
+    }
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0] << " <trace> | --generate <trace> [threads] [opsPerThread]\n";
+        return 2;
+    }
+    if (!benchAllocatorAvailable())
+        return 1;
+
+    Trace trace;
+    if (!loadTrace(argv[1], trace))
+        return 1;
+
+    size_t numThreads = trace.threads.size();
+    std::cout << "Replaying " << argv[1] << ": " << trace.numOps << " ops, " << numThreads
+              << " threads, " << trace.crossThreadFrees << " cross-thread frees\n";
+
+    std::vector<std::atomic<void*>> slots(trace.sizes.size());
+    std::vector<std::vector<uint64_t>> allocNs(numThreads), freeNs(numThreads);
+    std::atomic<size_t> ready{ 0 };
+    std::atomic<bool> go{ false };
+    std::atomic<size_t> failures{ 0 };
+
+    auto threadBody = [&](size_t t) {
+        allocNs[t].reserve(trace.threads[t].size());
+        freeNs[t].reserve(trace.threads[t].size());
+        ready.fetch_add(1);
+        while (!go.load(std::memory_order_acquire)) std::this_thread::yield();
+
+        for (const TraceOp& op : trace.threads[t]) {
+            size_t size = trace.sizes[op.obj];
+            if (!op.isFree) {
+                auto t0 = steady_clock::now();
+                void* p = benchAlloc(size);
+                auto t1 = steady_clock::now();
+                allocNs[t].push_back(duration_cast<nanoseconds>(t1 - t0).count());
+                if (!p) { failures.fetch_add(1); p = &slots[op.obj]; }
+                else {
+                    // touch every page so RSS reflects what the trace uses
+                    for (size_t off = 0; off < size; off += 4096) static_cast<char*>(p)[off] = 1;
+                }
+                slots[op.obj].store(p, std::memory_order_release);
+            } else {
+                void* p;
+                while (!(p = slots[op.obj].load(std::memory_order_acquire)))
+                    std::this_thread::yield();
+                if (p == &slots[op.obj]) continue;
+                auto t0 = steady_clock::now();
+                benchDealloc(p, size);
+                auto t1 = steady_clock::now();
+                freeNs[t].push_back(duration_cast<nanoseconds>(t1 - t0).count());
+            }
+        }
+    };
+
+    size_t baselineRss = currentRssBytes();
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < numThreads; ++t)
+        threads.emplace_back(threadBody, t);
+    while (ready.load() < numThreads) std::this_thread::yield();
+
+    RssSampler rss;
+    Timer timer;
+    go.store(true, std::memory_order_release);
+    for (auto& th : threads) th.join();
+    double ms = timer.elapsed();
+    rss.stop();
+
+    std::vector<uint64_t> allAlloc, allFree;
+    for (size_t t = 0; t < numThreads; ++t) {
+        allAlloc.insert(allAlloc.end(), allocNs[t].begin(), allocNs[t].end());
+        allFree.insert(allFree.end(), freeNs[t].begin(), freeNs[t].end());
+    }
+
+    size_t peakRss = rss.peak() > baselineRss ? rss.peak() - baselineRss : 0;
+    std::cout << std::fixed << std::setprecision(3) << BENCH_ALLOC_NAME << ":\n"
+              << "  elapsed        " << ms << " ms\n"
+              << "  throughput     " << trace.numOps / ms / 1000.0 << " Mops/s\n";
+    printLatency("alloc latency", allAlloc);
+    printLatency("free latency", allFree);
+    std::cout << "  peak RSS       " << peakRss / (1024.0 * 1024.0) << " MB over baseline\n"
+              << "  peak live      " << trace.peakLiveBytes / (1024.0 * 1024.0) << " MB requested\n"
+              << "  fragmentation  " << (trace.peakLiveBytes ? double(peakRss) / trace.peakLiveBytes : 0.0)
+              << " (peak RSS / peak live)\n";
+    if (failures)
+        std::cout << "  allocation failures: " << failures << "\n";
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,233 @@
+// Scalability sweep: runs each allocation pattern at increasing thread counts
+// (1 .. 2x cores by default) and reports total ops/sec. The pool variant also
+// reports CentralCache spin-lock and PageCache mutex acquisitions/contention.
+//
+// Patterns:
+//   churn      thread-local alloc/free of mixed small sizes
+//   prodcons   threads form a ring; each frees the batches its neighbour allocated
+//   sameclass  every thread hammers the 64 B class with central-sized batches
+//   larson     random slot replacement; slot arrays rotate between threads
+//   threadtest allocate N objects of one size, free them all, repeat
+//
+// Usage:
+//   bench_scale_<alloc> [--max-threads N] [--ops N] [--pattern NAME] [--csv FILE]
+#include "benchmarks.h"
+#include "allocators.h"
+#include "../include/Stats.h"
+#include <functional>
+#include <mutex>
+#include <random>
+#include <string>
+
+using Block = std::pair<void*, size_t>;
+
+static void churn(size_t, size_t, size_t ops)
+{
+    const size_t SIZES[] = { 16, 32, 48, 64, 96, 128, 256, 512 };
+    std::vector<Block> live;
+    live.reserve(64);
+    for (size_t i = 0; i < ops; i += 64) {
+        for (size_t j = 0; j < 64; ++j) {
+            size_t s = SIZES[(i + j) % std::size(SIZES)];
+            live.push_back({ benchAlloc(s), s });
+        }
+        for (auto& [p, s] : live) benchDealloc(p, s);
+        live.clear();
+    }
+}
+
+static void sameClass(size_t, size_t, size_t ops)
+{
+    constexpr size_t BATCH = 1024;
+    std::vector<void*> live;
+    live.reserve(BATCH);
+    for (size_t i = 0; i < ops; i += BATCH) {
+        for (size_t j = 0; j < BATCH; ++j) live.push_back(benchAlloc(64));
+        for (void* p : live) benchDealloc(p, 64);
+        live.clear();
+    }
+}
+
+static void threadTest(size_t, size_t, size_t ops)
+{
+    constexpr size_t OBJECTS = 10000;
+    std::vector<void*> live(OBJECTS);
+    for (size_t i = 0; i < ops; i += OBJECTS) {
+        for (auto& p : live) p = benchAlloc(40);
+        for (void* p : live) benchDealloc(p, 40);
+    }
+}
+
+// Ring of single-slot mailboxes: thread t hands its batch to thread t+1 and
+// frees whatever thread t-1 handed over, so every free is cross-thread
+// (with one thread it degenerates to local churn).
+struct Mailbox
+{
+    std::mutex lock;
+    std::vector<std::vector<Block>> batches;
+};
+
+static std::vector<Mailbox>* mailboxes;
+
+static void prodCons(size_t t, size_t numThreads, size_t ops)
+{
+    constexpr size_t BATCH = 256;
+    Mailbox& out = (*mailboxes)[(t + 1) % numThreads];
+    Mailbox& in = (*mailboxes)[t];
+    for (size_t i = 0; i < ops; i += BATCH) {
+        std::vector<Block> batch;
+        batch.reserve(BATCH);
+        for (size_t j = 0; j < BATCH; ++j) {
+            size_t s = 16 + ((i + j) % 8) * 32;
+            batch.push_back({ benchAlloc(s), s });
+        }
+        {
+            std::lock_guard<std::mutex> g(out.lock);
+            out.batches.push_back(std::move(batch));
+        }
+        std::vector<std::vector<Block>> received;
+        {
+            std::lock_guard<std::mutex> g(in.lock);
+            received.swap(in.batches);
+        }
+        for (auto& b : received)
+            for (auto& [p, s] : b) benchDealloc(p, s);
+    }
+}
+
+// Larson: each thread owns SLOTS live objects and replaces random ones.
+// After every round it trades its whole slot array for one parked by
+// another thread, so objects are routinely freed by a thread that did not
+// allocate them (the server-like succession of the original benchmark).
+struct LarsonSlots
+{
+    std::mutex lock;
+    std::vector<Block> slots;
+};
+
+static std::vector<LarsonSlots>* larsonSlots;
+constexpr size_t LARSON_SLOTS = 1000;
+
+static void larson(size_t t, size_t numThreads, size_t ops)
+{
+    constexpr size_t ROUND = 10000;
+    std::mt19937 rng(static_cast<unsigned>(t * 7919 + 1));
+    std::vector<Block> mine;
+    for (size_t i = 0; i < LARSON_SLOTS; ++i) {
+        size_t s = 16 + rng() % 1009;
+        mine.push_back({ benchAlloc(s), s });
+    }
+    for (size_t i = 0, round = 1; i < ops; i += ROUND, ++round) {
+        for (size_t j = 0; j < ROUND; ++j) {
+            Block& b = mine[rng() % LARSON_SLOTS];
+            benchDealloc(b.first, b.second);
+            b.second = 16 + rng() % 1009;
+            b.first = benchAlloc(b.second);
+        }
+        LarsonSlots& spot = (*larsonSlots)[(t + round) % numThreads];
+        std::lock_guard<std::mutex> g(spot.lock);
+        mine.swap(spot.slots);
+    }
+    for (auto& [p, s] : mine) benchDealloc(p, s);
+}
+
+struct Pattern
+{
+    const char* name;
+    std::function<void(size_t, size_t, size_t)> body;
+};
+
+int main(int argc, char** argv)
+{
+    if (!benchAllocatorAvailable())
+        return 1;
+
+    size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    size_t maxThreads = 2 * cores;
+    size_t opsPerThread = 400000;
+    std::string only, csvPath;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--max-threads") maxThreads = std::stoul(argv[i + 1]);
+        else if (arg == "--ops") opsPerThread = std::stoul(argv[i + 1]);
+        else if (arg == "--pattern") only = argv[i + 1];
+        else if (arg == "--csv") csvPath = argv[i + 1];
+    }
+
+    std::vector<size_t> threadCounts;
+    for (size_t n = 1; n < maxThreads; n *= 2) threadCounts.push_back(n);
+    if (cores < maxThreads && std::find(threadCounts.begin(), threadCounts.end(), cores) == threadCounts.end())
+        threadCounts.push_back(cores);
+    threadCounts.push_back(maxThreads);
+    std::sort(threadCounts.begin(), threadCounts.end());
+
+    const Pattern patterns[] = {
+        { "churn", churn },
+        { "prodcons", prodCons },
+        { "sameclass", sameClass },
+        { "larson", larson },
+        { "threadtest", threadTest },
+    };
+
+    std::ofstream csv;
+    if (!csvPath.empty()) {
+        csv.open(csvPath);
+        csv << std::fixed << std::setprecision(0)
+            << "allocator,pattern,threads,ops_per_sec,central_acquires,central_contended,page_acquires,page_contended\n";
+    }
+
+    runWarmup(benchAlloc, benchDealloc);
+    std::cout << BENCH_ALLOC_NAME << " scaling (" << opsPerThread << " ops/thread, " << cores << " cores)\n"
+              << std::left << std::setw(12) << "pattern" << std::right << std::setw(8) << "threads"
+              << std::setw(14) << "Mops/s" << std::setw(14) << "central acq" << std::setw(12) << "contended"
+              << std::setw(12) << "page acq" << std::setw(12) << "contended" << "\n";
+
+    for (const Pattern& pattern : patterns) {
+        if (!only.empty() && only != pattern.name) continue;
+        for (size_t n : threadCounts) {
+            std::vector<Mailbox> boxes(n);
+            std::vector<LarsonSlots> slots(n);
+            mailboxes = &boxes;
+            larsonSlots = &slots;
+            for (auto& ls : slots)
+                for (size_t i = 0; i < LARSON_SLOTS; ++i) {
+                    size_t s = 16 + i % 1009;
+                    ls.slots.push_back({ benchAlloc(s), s });
+                }
+
+            PoolStats before{};
+#ifdef BENCH_USE_MEMPOOL
+            before = MemoryPool::getStats();
+#endif
+            Timer t;
+            std::vector<std::thread> threads;
+            for (size_t i = 0; i < n; ++i)
+                threads.emplace_back([&, i]() { pattern.body(i, n, opsPerThread); });
+            for (auto& th : threads) th.join();
+            double ms = t.elapsed();
+            PoolStats after{};
+#ifdef BENCH_USE_MEMPOOL
+            after = MemoryPool::getStats();
+#endif
+
+            for (auto& box : boxes)
+                for (auto& b : box.batches)
+                    for (auto& [p, s] : b) benchDealloc(p, s);
+            for (auto& ls : slots)
+                for (auto& [p, s] : ls.slots) benchDealloc(p, s);
+
+            double opsPerSec = n * opsPerThread / (ms / 1000.0);
+            size_t cAcq = after.centralLockAcquires - before.centralLockAcquires;
+            size_t cCont = after.centralLockContended - before.centralLockContended;
+            size_t pAcq = after.pageLockAcquires - before.pageLockAcquires;
+            size_t pCont = after.pageLockContended - before.pageLockContended;
+            std::cout << std::left << std::setw(12) << pattern.name << std::right << std::setw(8) << n
+                      << std::setw(14) << std::fixed << std::setprecision(2) << opsPerSec / 1e6
+                      << std::setw(14) << cAcq << std::setw(12) << cCont
+                      << std::setw(12) << pAcq << std::setw(12) << pCont << "\n";
+            if (csv.is_open())
+                csv << BENCH_ALLOC_NAME << "," << pattern.name << "," << n << ","
+                    << opsPerSec << "," << cAcq << "," << cCont << "," << pAcq << "," << pCont << "\n";
+        }
+    }
+}
@@ -0,0 +1,264 @@
+// Inter-process message passing: a producer process sends --msgs messages to
+// a consumer process, which reads every byte of each one.
+//   shm    the producer allocates each message in an mpool::SharedHeap, fills
+//          it in place and passes only its offset through a ring in the same
+//          region; the consumer maps the region on its own (at another
+//          address), reads the message and frees it back into the heap
+//   pipe   the producer fills a local buffer and copies it through a pipe
+//          into the consumer's buffer
+// Both run for every size in --sizes (default 64, 1024 and 16384 bytes; the
+// last is above MAX_ALLOC_SIZE and takes the page tier). The shm ring holds at
+// most --window-kb of messages in flight (default 64, a Linux pipe's
+// capacity), so neither side gets to run further ahead of the other.
+//
+//   bench_shm [--msgs N] [--sizes 64,1024,16384] [--window-kb N]
+#include "benchmarks.h"
+#include "../include/SharedHeap.h"
+#include <climits>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+namespace
+{
+    constexpr size_t RING_SLOTS = 1024;
+
+    // A counter in shared memory one process advances and the other waits
+    // on: the waiter spins briefly, then sleeps on a process-shared futex.
+    // publish() only wakes it when asked, so wake-ups can be batched.
+    struct Counter
+    {
+        std::atomic<uint32_t> value{ 0 };
+        std::atomic<uint32_t> sleeping{ 0 };
+
+        void publish(uint32_t v, bool wake = true)
+        {
+            value.store(v, std::memory_order_seq_cst);
+            if (wake && sleeping.load(std::memory_order_seq_cst))
+                syscall(SYS_futex, &value, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+        }
+
+        uint32_t waitWhile(uint32_t v)
+        {
+            for (int i = 0; i < 128; ++i) {
+                uint32_t current = value.load(std::memory_order_acquire);
+                if (current != v) return current;
+            }
+            uint32_t current;
+            while (true) {
+                sleeping.store(1, std::memory_order_seq_cst);
+                current = value.load(std::memory_order_seq_cst);
+                if (current != v) break;
+                syscall(SYS_futex, &value, FUTEX_WAIT, v, nullptr, nullptr, 0);
+            }
+            sleeping.store(0, std::memory_order_relaxed);
+            return current;
+        }
+    };
+
+    // single-producer single-consumer ring of offsets, kept in the shared heap
+    struct Ring
+    {
+        alignas(64) Counter head; // messages consumed
+        alignas(64) Counter tail; // messages published
+        alignas(64) Counter ready;
+        Counter done;
+        std::atomic<uint64_t> checksum{ 0 };
+        uint64_t slots[RING_SLOTS];
+    };
+
+    void fill(char* msg, size_t size, size_t seq)
+    {
+        std::memset(msg, static_cast<int>(seq & 0x7f), size);
+    }
+
+    uint64_t sum(const char* msg, size_t size)
+    {
+        uint64_t s = 0;
+        for (size_t i = 0; i < size; ++i)
+            s += static_cast<unsigned char>(msg[i]);
+        return s;
+    }
+
+    uint64_t expectedSum(size_t msgs, size_t size)
+    {
+        uint64_t s = 0;
+        for (size_t i = 0; i < msgs; ++i)
+            s += (i & 0x7f) * size;
+        return s;
+    }
+
+    void consumeShm(int fd, size_t msgs, size_t size, size_t window)
+    {
+        mpool::SharedHeap heap;
+        if (!heap.attach(fd))
+            _exit(1);
+        Ring* ring = static_cast<Ring*>(heap.fromOffset(heap.root()));
+        ring->ready.publish(1);
+
+        uint32_t batch = static_cast<uint32_t>(std::max<size_t>(window / 2, 1));
+        uint64_t checksum = 0;
+        uint32_t head = 0, tail = 0;
+        for (size_t i = 0; i < msgs; ++i) {
+            if (head == tail)
+                tail = ring->tail.waitWhile(head);
+            char* msg = static_cast<char*>(heap.fromOffset(ring->slots[head % RING_SLOTS]));
+            checksum += sum(msg, size);
+            heap.deallocate(msg, size);
+            // a blocked producer waits for room: wake it once half the window
+            // is free or the ring runs empty, not for every slot
+            ++head;
+            ring->head.publish(head, head % batch == 0 || head == ring->tail.value.load(std::memory_order_seq_cst));
+        }
+        ring->checksum.store(checksum, std::memory_order_relaxed);
+        ring->done.publish(1);
+        _exit(0);
+    }
+
+    double runShm(size_t msgs, size_t size, size_t window, bool& ok)
+    {
+        mpool::SharedHeap heap;
+        // room for a full ring of messages plus the spans that carry them
+        if (!heap.create(nullptr, (64 << 20) + 2 * RING_SLOTS * (size + 4096))) {
+            std::cerr << "cannot create shared heap\n";
+            ok = false;
+            return 0;
+        }
+        Ring* ring = new (heap.allocate(sizeof(Ring))) Ring;
+        heap.setRoot(heap.toOffset(ring));
+
+        pid_t child = fork();
+        if (child == 0)
+            consumeShm(heap.fd(), msgs, size, window);
+        ring->ready.waitWhile(0);
+
+        uint32_t batch = static_cast<uint32_t>(std::max<size_t>(window / 2, 1));
+        Timer t;
+        uint32_t head = 0, tail = 0;
+        for (size_t i = 0; i < msgs; ++i) {
+            char* msg;
+            while (!(msg = static_cast<char*>(heap.allocate(size))))
+                std::this_thread::yield(); // region full until the consumer frees
+            fill(msg, size, i);
+            if (tail - head == window)
+                head = ring->head.waitWhile(tail - window);
+            ring->slots[tail % RING_SLOTS] = heap.toOffset(msg);
+            ++tail;
+            uint32_t pending = tail - ring->head.value.load(std::memory_order_seq_cst);
+            ring->tail.publish(tail, pending >= batch || i + 1 == msgs);
+        }
+        ring->done.waitWhile(0);
+        double ms = t.elapsed();
+
+        int status = 0;
+        waitpid(child, &status, 0);
+        ok = WIFEXITED(status) && WEXITSTATUS(status) == 0
+            && ring->checksum.load(std::memory_order_relaxed) == expectedSum(msgs, size);
+        return ms;
+    }
+
+    bool readAll(int fd, void* buf, size_t size)
+    {
+        char* p = static_cast<char*>(buf);
+        while (size > 0) {
+            ssize_t n = read(fd, p, size);
+            if (n <= 0) return false;
+            p += n;
+            size -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    bool writeAll(int fd, const void* buf, size_t size)
+    {
+        const char* p = static_cast<const char*>(buf);
+        while (size > 0) {
+            ssize_t n = write(fd, p, size);
+            if (n <= 0) return false;
+            p += n;
+            size -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    double runPipe(size_t msgs, size_t size, bool& ok)
+    {
+        int data[2], reply[2];
+        if (pipe(data) != 0 || pipe(reply) != 0) {
+            ok = false;
+            return 0;
+        }
+
+        pid_t child = fork();
+        if (child == 0) {
+            close(data[1]);
+            close(reply[0]);
+            std::vector<char> buf(size);
+            uint64_t checksum = 0;
+            for (size_t i = 0; i < msgs; ++i) {
+                if (!readAll(data[0], buf.data(), size)) _exit(1);
+                checksum += sum(buf.data(), size);
+            }
+            _exit(writeAll(reply[1], &checksum, sizeof(checksum)) ? 0 : 1);
+        }
+        close(data[0]);
+        close(reply[1]);
+
+        std::vector<char> buf(size);
+        uint64_t checksum = 0;
+        Timer t;
+        for (size_t i = 0; i < msgs; ++i) {
+            fill(buf.data(), size, i);
+            if (!writeAll(data[1], buf.data(), size)) break;
+        }
+        bool replied = readAll(reply[0], &checksum, sizeof(checksum));
+        double ms = t.elapsed();
+
+        close(data[1]);
+        close(reply[0]);
+        int status = 0;
+        waitpid(child, &status, 0);
+        ok = replied && WIFEXITED(status) && WEXITSTATUS(status) == 0 && checksum == expectedSum(msgs, size);
+        return ms;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    size_t msgs = 200000;
+    size_t windowKb = 64;
+    std::vector<size_t> sizes = { 64, 1024, 16384 };
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--msgs") msgs = std::stoul(argv[i + 1]);
+        else if (arg == "--window-kb") windowKb = std::stoul(argv[i + 1]);
+        else if (arg == "--sizes") {
+            sizes.clear();
+            std::stringstream list(argv[i + 1]);
+            for (std::string item; std::getline(list, item, ',');)
+                sizes.push_back(std::stoul(item));
+        }
+    }
+
+    std::cout << "Two-process message passing, " << msgs << " messages per run\n"
+              << std::left << std::setw(8) << "mode" << std::right << std::setw(8) << "size"
+              << std::setw(12) << "ms" << std::setw(12) << "ns/msg" << std::setw(10) << "GB/s" << "\n";
+
+    bool allOk = true;
+    for (size_t size : sizes) {
+        for (int mode = 0; mode < 2; ++mode) {
+            bool ok = false;
+            size_t window = std::clamp<size_t>((windowKb << 10) / size, 1, RING_SLOTS);
+            double ms = mode == 0 ? runShm(msgs, size, window, ok) : runPipe(msgs, size, ok);
+            allOk = allOk && ok;
+            std::cout << std::left << std::setw(8) << (mode == 0 ? "shm" : "pipe") << std::right
+                      << std::setw(8) << size << std::fixed << std::setprecision(1) << std::setw(12) << ms
+                      << std::setw(12) << ms * 1e6 / msgs << std::setprecision(2) << std::setw(10)
+                      << msgs * size / (ms * 1e6) << (ok ? "" : "  (checksum mismatch)") << "\n";
+        }
+    }
+    return allOk ? 0 : 1;
+}
@@ -0,0 +1,81 @@
+// Span churn: threads allocate and free whole spans through an mpool::Heap,
+// whose objects above MAX_ALLOC_SIZE go straight to its PageCache, so every
+// operation is an allocateSpan or deallocateSpan. Each thread keeps a few
+// spans live and replaces one at random per operation:
+//   mixed    lengths of 1-16 pages, the range PageToCentralStrategy produces
+//   fixed    always 4 pages
+// Run with PageCache's per-CPU span cache on and off, for thread counts
+// doubling up to --max-threads. Reports operations per second and how often
+// the PageCache mutex was taken, waited for, and bypassed by a cache hit.
+//
+//   bench_spans [--max-threads N] [--ops N]
+#include "benchmarks.h"
+#include "../include/Heap.h"
+#include <random>
+#include <string>
+
+int main(int argc, char** argv)
+{
+    size_t maxThreads = 32;
+    size_t opsPerThread = 200000;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--max-threads") maxThreads = std::stoul(argv[i + 1]);
+        else if (arg == "--ops") opsPerThread = std::stoul(argv[i + 1]);
+    }
+
+    constexpr size_t LIVE = 8;
+    struct Pattern
+    {
+        const char* name;
+        size_t minPages, maxPages;
+    };
+    const Pattern PATTERNS[] = { { "mixed", 1, 16 }, { "fixed", 4, 4 } };
+
+    std::cout << "Span churn, " << opsPerThread << " ops per thread\n"
+              << std::left << std::setw(8) << "pattern" << std::setw(7) << "cache" << std::right
+              << std::setw(8) << "threads" << std::setw(12) << "Mops/s" << std::setw(12) << "lock acq"
+              << std::setw(12) << "contended" << std::setw(12) << "cache hits" << "\n";
+
+    for (const Pattern& pattern : PATTERNS) {
+        for (bool cache : { true, false }) {
+            for (size_t n = 1; n <= maxThreads; n *= 2) {
+                mpool::Heap heap;
+                heap.setSpanCache(cache);
+                auto body = [&](size_t seed) {
+                    std::mt19937 rng(static_cast<unsigned>(seed));
+                    std::uniform_int_distribution<size_t> pages(pattern.minPages, pattern.maxPages);
+                    std::pair<void*, size_t> live[LIVE];
+                    for (auto& slot : live) {
+                        size_t size = pages(rng) * Size::PAGE_SIZE;
+                        slot = { heap.allocate(size), size };
+                    }
+                    for (size_t i = 0; i < opsPerThread; ++i) {
+                        auto& slot = live[rng() % LIVE];
+                        heap.deallocate(slot.first, slot.second);
+                        size_t size = pages(rng) * Size::PAGE_SIZE;
+                        slot = { heap.allocate(size), size };
+                        *static_cast<char*>(slot.first) = 1;
+                    }
+                    for (auto& slot : live) heap.deallocate(slot.first, slot.second);
+                };
+
+                PoolStats before = heap.getStats();
+                Timer t;
+                std::vector<std::thread> threads;
+                for (size_t i = 0; i < n; ++i)
+                    threads.emplace_back(body, i + 1);
+                for (auto& th : threads) th.join();
+                double ms = t.elapsed();
+                PoolStats after = heap.getStats();
+
+                std::cout << std::left << std::setw(8) << pattern.name << std::setw(7) << (cache ? "on" : "off")
+                          << std::right << std::setw(8) << n << std::setw(12) << std::fixed << std::setprecision(2)
+                          << 2.0 * n * opsPerThread / (ms * 1e3)
+                          << std::setw(12) << after.pageLockAcquires - before.pageLockAcquires
+                          << std::setw(12) << after.pageLockContended - before.pageLockContended
+                          << std::setw(12) << after.spanCacheHits - before.spanCacheHits << "\n";
+            }
+        }
+    }
+}
@@ -13,6 +13,7 @@ int main()
     auto alloc   = tc_malloc;
     auto dealloc = [](void* p, size_t) { tc_free(p); };
 
+    testColdStart      ("TCMalloc:", alloc, dealloc);
     runWarmup(alloc, dealloc);
     testSmallAllocation("TCMalloc:", alloc, dealloc);
     testMultiThreaded  ("TCMalloc:", alloc, dealloc);
@@ -8,6 +8,14 @@
 #include <cstdlib>
 #include <ctime>
 #include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include "perfcounters.h"
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/resource.h>
+#endif
 
 using namespace std::chrono;
 
@@ -22,6 +30,118 @@ public:
     }
 };
 
+// Current resident set size from /proc/self/statm (0 where unavailable).
+inline size_t currentRssBytes()
+{
+#ifdef __linux__
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0, resident = 0;
+    statm >> pages >> resident;
+    return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#else
+    return 0;
+#endif
+}
+
+// Polls currentRssBytes() on a background thread and keeps the peak, so a
+// workload's high-water mark can be measured without VmHWM's process lifetime.
+class RssSampler
+{
+    std::atomic<bool> running{ true };
+    std::atomic<size_t> peakBytes{ 0 };
+    std::thread worker;
+public:
+    explicit RssSampler(milliseconds period = milliseconds(1))
+        : peakBytes(currentRssBytes())
+    {
+        worker = std::thread([this, period]() {
+            while (running.load(std::memory_order_relaxed)) {
+                size_t rss = currentRssBytes();
+                if (rss > peakBytes.load(std::memory_order_relaxed))
+                    peakBytes.store(rss, std::memory_order_relaxed);
+                std::this_thread::sleep_for(period);
+            }
+        });
+    }
+    ~RssSampler() { stop(); }
+
+    void stop()
+    {
+        running = false;
+        if (worker.joinable()) worker.join();
+        size_t rss = currentRssBytes();
+        if (rss > peakBytes) peakBytes = rss;
+    }
+    size_t peak() const { return peakBytes.load(); }
+};
+
+// Counters shared by the test phases below, opened on first use; says once
+// when none could be opened.
+inline PerfCounters& benchCounters()
+{
+    static PerfCounters counters;
+    static bool noted = false;
+    if (!noted && !counters.available() && !counters.error().empty())
+        std::cout << "(hardware counters unavailable: " << counters.error() << ")\n";
+    noted = true;
+    return counters;
+}
+
+// q in [0, 1]; sorts the samples in place.
+inline uint64_t percentile(std::vector<uint64_t>& samples, double q)
+{
+    if (samples.empty()) return 0;
+    size_t k = std::min(samples.size() - 1, static_cast<size_t>(q * samples.size()));
+    std::nth_element(samples.begin(), samples.begin() + k, samples.end());
+    return samples[k];
+}
+
+// Minor page faults taken by the process so far (0 where unavailable).
+inline long minorPageFaults()
+{
+#ifdef __linux__
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_minflt;
+#else
+    return 0;
+#endif
+}
+
+// Must run first in a fresh process: times the first allocations of each size
+// class (the refill -> PageCache -> mmap path) and counts the page faults they
+// take. Only a few objects per class are requested, like a service that has
+// just started.
+template<typename Alloc, typename Dealloc>
+void testColdStart(const char* name, Alloc alloc, Dealloc dealloc)
+{
+    constexpr size_t PER_SIZE = 64;
+    const size_t SIZES[] = { 8, 16, 32, 64, 128, 256, 512, 1024, 2048 };
+
+    std::cout << "\nTesting cold start (first " << PER_SIZE << " allocations of "
+              << std::size(SIZES) << " sizes):\n";
+
+    std::vector<std::pair<void*, size_t>> ptrs;
+    ptrs.reserve(PER_SIZE * std::size(SIZES));
+    long faults = minorPageFaults();
+    benchCounters().start();
+    Timer t;
+    for (size_t s : SIZES)
+        for (size_t i = 0; i < PER_SIZE; ++i) {
+            void* p = alloc(s);
+            *static_cast<char*>(p) = 1;
+            ptrs.emplace_back(p, s);
+        }
+    double ms = t.elapsed();
+    benchCounters().stop();
+    faults = minorPageFaults() - faults;
+    for (auto& [p, s] : ptrs) dealloc(p, s);
+
+    std::cout << std::left << std::setw(14) << name
+              << std::fixed << std::setprecision(3) << ms << " ms, " << faults << " page faults\n";
+    benchCounters().report(PER_SIZE * std::size(SIZES));
+}
+
 template<typename Alloc, typename Dealloc>
 void runWarmup(Alloc alloc, Dealloc dealloc)
 {
@@ -43,6 +163,7 @@ void testSmallAllocation(const char* name, Alloc alloc, Dealloc dealloc)
 
     std::cout << "\nTesting small allocations (" << NUM_ALLOCS << " allocations of fixed sizes):\n";
 
+    benchCounters().start();
     Timer t;
     std::array<std::vector<std::pair<void*, size_t>>, NUM_SIZES> sizePtrs;
     for (auto& v : sizePtrs) v.reserve(NUM_ALLOCS / NUM_SIZES);
@@ -63,8 +184,11 @@ void testSmallAllocation(const char* name, Alloc alloc, Dealloc dealloc)
     for (auto& v : sizePtrs)
         for (auto& [p, s] : v) dealloc(p, s);
 
+    double ms = t.elapsed();
+    benchCounters().stop();
     std::cout << std::left << std::setw(14) << name
-              << std::fixed << std::setprecision(3) << t.elapsed() << " ms\n";
+              << std::fixed << std::setprecision(3) << ms << " ms\n";
+    benchCounters().report(NUM_ALLOCS);
 }
 
 template<typename Alloc, typename Dealloc>
@@ -116,14 +240,18 @@ void testMultiThreaded(const char* name, Alloc alloc, Dealloc dealloc)
             for (auto& [p, s] : v) dealloc(p, s);
     };
 
+    benchCounters().start();
     Timer t;
     std::vector<std::thread> threads;
     for (size_t i = 0; i < NUM_THREADS; ++i)
         threads.emplace_back([=]() { threadBody(alloc, dealloc); });
     for (auto& th : threads) th.join();
 
+    double ms = t.elapsed();
+    benchCounters().stop();
     std::cout << std::left << std::setw(14) << name
-              << std::fixed << std::setprecision(3) << t.elapsed() << " ms\n";
+              << std::fixed << std::setprecision(3) << ms << " ms\n";
+    benchCounters().report(NUM_THREADS * ALLOCS_PER_THREAD);
 }
 
 template<typename Alloc, typename Dealloc>
@@ -137,6 +265,7 @@ void testMixedSizes(const char* name, Alloc alloc, Dealloc dealloc)
 
     std::cout << "\nTesting mixed size allocations (" << NUM_ALLOCS << " allocations):\n";
 
+    benchCounters().start();
     Timer t;
     std::array<std::vector<std::pair<void*, size_t>>, NG> groups;
     for (auto& v : groups) v.reserve(NUM_ALLOCS / NG);
@@ -167,6 +296,9 @@ void testMixedSizes(const char* name, Alloc alloc, Dealloc dealloc)
     for (auto& v : groups)
         for (auto& [p, s] : v) dealloc(p, s);
 
+    double ms = t.elapsed();
+    benchCounters().stop();
     std::cout << std::left << std::setw(14) << name
-              << std::fixed << std::setprecision(3) << t.elapsed() << " ms\n";
+              << std::fixed << std::setprecision(3) << ms << " ms\n";
+    benchCounters().report(NUM_ALLOCS);
 }
@@ -0,0 +1,120 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <thread>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAVE_RDTSC 1
+#endif
+
+// Per-call tick source: rdtsc where available, steady_clock nanoseconds
+// otherwise. ticksPerNs() converts recorded ticks for reporting.
+namespace LatencyClock
+{
+    inline uint64_t now()
+    {
+#ifdef BENCH_HAVE_RDTSC
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+        uint64_t t = __rdtsc();
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+        return t;
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    inline const char* name()
+    {
+#ifdef BENCH_HAVE_RDTSC
+        return "rdtsc";
+#else
+        return "steady_clock";
+#endif
+    }
+
+    // measured once against steady_clock (~20 ms)
+    inline double ticksPerNs()
+    {
+#ifdef BENCH_HAVE_RDTSC
+        static const double ratio = []() {
+            auto c0 = std::chrono::steady_clock::now();
+            uint64_t t0 = now();
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            auto c1 = std::chrono::steady_clock::now();
+            uint64_t t1 = now();
+            double ns = std::chrono::duration<double, std::nano>(c1 - c0).count();
+            return (t1 - t0) / ns;
+        }();
+        return ratio;
+#else
+        return 1.0;
+#endif
+    }
+}
+
+// HDR-style log-linear histogram: values below 2^SUB_BITS are exact, above
+// that every power of two is split into 2^SUB_BITS buckets (~1.6% error).
+// Recording is a couple of bit operations and one increment.
+class LatencyHistogram
+{
+    static constexpr int SUB_BITS = 6;
+    static constexpr uint64_t SUB_COUNT = uint64_t(1) << SUB_BITS;
+    static constexpr size_t NUM_BUCKETS = (64 - SUB_BITS + 1) << SUB_BITS;
+
+    std::array<uint64_t, NUM_BUCKETS> counts_{};
+    uint64_t total_{ 0 };
+    uint64_t max_{ 0 };
+
+    static size_t bucketOf(uint64_t v)
+    {
+        if (v < SUB_COUNT) return static_cast<size_t>(v);
+        int shift = 63 - std::countl_zero(v) - SUB_BITS;
+        return (static_cast<size_t>(shift + 1) << SUB_BITS) + ((v >> shift) & (SUB_COUNT - 1));
+    }
+
+    // highest value that lands in bucket b
+    static uint64_t bucketHigh(size_t b)
+    {
+        if (b < SUB_COUNT) return b;
+        int shift = static_cast<int>(b >> SUB_BITS) - 1;
+        uint64_t low = ((b & (SUB_COUNT - 1)) | SUB_COUNT) << shift;
+        return low + (uint64_t(1) << shift) - 1;
+    }
+
+public:
+    void record(uint64_t v)
+    {
+        ++counts_[bucketOf(v)];
+        ++total_;
+        max_ = std::max(max_, v);
+    }
+
+    void merge(const LatencyHistogram& other)
+    {
+        for (size_t i = 0; i < NUM_BUCKETS; ++i) counts_[i] += other.counts_[i];
+        total_ += other.total_;
+        max_ = std::max(max_, other.max_);
+    }
+
+    uint64_t count() const { return total_; }
+    uint64_t max() const { return max_; }
+
+    // q in [0, 1]
+    uint64_t percentile(double q) const
+    {
+        if (total_ == 0) return 0;
+        uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(q * total_ + 0.5));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < NUM_BUCKETS; ++i) {
+            seen += counts_[i];
+            if (seen >= rank) return std::min(bucketHigh(i), max_);
+        }
+        return max_;
+    }
+};
@@ -0,0 +1,152 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Hardware counters around one benchmark phase, through perf_event_open on
+// the calling thread and every thread it starts while counting (inherit), so
+// multi-threaded phases are covered once their threads have been joined.
+// User-space events only, which perf_event_paranoid <= 2 allows unprivileged.
+// Each event is opened on its own: one the CPU or VM lacks reads as missing
+// instead of taking the others down, and counts multiplexed by the kernel are
+// scaled up by enabled/running time. Elsewhere, or with
+// MPOOL_BENCH_COUNTERS=0, nothing is opened and report() prints nothing.
+class PerfCounters
+{
+public:
+    enum Event { CYCLES, INSTRUCTIONS, L1D_MISSES, LLC_MISSES, DTLB_MISSES, BRANCH_MISSES, NUM_EVENTS };
+
+    PerfCounters()
+    {
+        fds_.fill(-1);
+#ifdef __linux__
+        const char* env = std::getenv("MPOOL_BENCH_COUNTERS");
+        if (env && std::strcmp(env, "0") == 0) return;
+        for (int e = 0; e < NUM_EVENTS; ++e) {
+            perf_event_attr attr{};
+            attr.size = sizeof(attr);
+            setEvent(attr, static_cast<Event>(e));
+            attr.disabled = 1;
+            attr.inherit = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            fds_[e] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+            if (fds_[e] < 0 && error_.empty()) error_ = std::strerror(errno);
+        }
+#endif
+    }
+    ~PerfCounters()
+    {
+#ifdef __linux__
+        for (int fd : fds_)
+            if (fd >= 0) close(fd);
+#endif
+    }
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool available() const
+    {
+        for (int fd : fds_)
+            if (fd >= 0) return true;
+        return false;
+    }
+    // Why the first event failed to open, if one did.
+    const std::string& error() const { return error_; }
+
+    void start()
+    {
+#ifdef __linux__
+        for (int fd : fds_) {
+            if (fd < 0) continue;
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    void stop()
+    {
+        values_.fill(-1);
+#ifdef __linux__
+        for (int e = 0; e < NUM_EVENTS; ++e) {
+            if (fds_[e] < 0) continue;
+            ioctl(fds_[e], PERF_EVENT_IOC_DISABLE, 0);
+            uint64_t data[3] = {};
+            if (read(fds_[e], data, sizeof(data)) != sizeof(data) || data[2] == 0) continue;
+            values_[e] = static_cast<double>(data[0]) * data[1] / data[2];
+        }
+#endif
+    }
+
+    // The count of the last start()/stop() phase, -1 if the event is missing.
+    double value(Event e) const { return values_[e]; }
+
+    // One line of per-operation counts for the last phase, indented under the
+    // phase's timing line; "-" for missing events.
+    void report(size_t ops) const
+    {
+        if (!available()) return;
+        static const char* const NAMES[NUM_EVENTS] = { "cycles", "instr", "L1D miss", "LLC miss", "dTLB miss", "br miss" };
+        std::cout << "    per op:";
+        for (int e = 0; e < NUM_EVENTS; ++e) {
+            std::cout << "  " << NAMES[e] << " ";
+            if (values_[e] < 0) std::cout << "-";
+            else std::cout << std::fixed << std::setprecision(values_[e] / ops < 10 ? 3 : 1) << values_[e] / ops;
+        }
+        if (values_[CYCLES] > 0 && values_[INSTRUCTIONS] >= 0)
+            std::cout << "  IPC " << std::setprecision(2) << values_[INSTRUCTIONS] / values_[CYCLES];
+        std::cout << "\n";
+    }
+
+private:
+#ifdef __linux__
+    static void setEvent(perf_event_attr& attr, Event e)
+    {
+        auto cache = [](uint64_t id, uint64_t op, uint64_t result) { return id | (op << 8) | (result << 16); };
+        switch (e) {
+        case CYCLES:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case INSTRUCTIONS:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case L1D_MISSES:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = cache(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS);
+            break;
+        case LLC_MISSES:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = cache(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS);
+            break;
+        case DTLB_MISSES:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = cache(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS);
+            break;
+        default:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+        }
+    }
+#endif
+
+    std::array<int, NUM_EVENTS> fds_;
+    std::array<double, NUM_EVENTS> values_{ -1, -1, -1, -1, -1, -1 };
+    std::string error_;
+};
@@ -0,0 +1,50 @@
+// alloc-test (OLTP-style, after mimalloc-bench's alloc-test): every thread
+// keeps --slots live objects and replaces random ones, with sizes drawn
+// like a transaction-processing heap: mostly under 64 bytes, some up to
+// 1 KB and a tail of larger buffers up to 64 KB, so the pool's
+// above-MAX_ALLOC_SIZE path is exercised too. The first and last byte of
+// each object are written.
+//
+//   suite_alloc_test_<alloc> [--threads N] [--slots N] [--ops N] [--csv FILE]
+#include "suite.h"
+#include <random>
+
+namespace
+{
+    size_t drawSize(std::mt19937& rng)
+    {
+        unsigned r = rng() % 1000;
+        if (r < 800) return 8 + rng() % 57;        // 8..64
+        if (r < 950) return 65 + rng() % 960;      // 65..1024
+        if (r < 995) return 1025 + rng() % 7168;   // 1 KB..8 KB
+        return 8193 + rng() % 57344;               // 8 KB..64 KB
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (!benchAllocatorAvailable())
+        return 1;
+    SuiteArgs args(argc, argv);
+    size_t slots = args.get("--slots", 10000);
+    size_t ops = args.get("--ops", 2000000); // per thread
+
+    SuiteRun run;
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < args.threads; ++t)
+        threads.emplace_back([&, t] {
+            std::mt19937 rng(static_cast<unsigned>(t + 1));
+            std::vector<std::pair<char*, size_t>> live(slots, { nullptr, 0 });
+            for (size_t i = 0; i < ops; ++i) {
+                auto& [p, s] = live[rng() % slots];
+                if (p) benchDealloc(p, s);
+                s = drawSize(rng);
+                p = static_cast<char*>(benchAlloc(s));
+                p[0] = p[s - 1] = 1;
+            }
+            for (auto& [p, s] : live)
+                if (p) benchDealloc(p, s);
+        });
+    for (auto& th : threads) th.join();
+    run.finish("alloc-test", args);
+}
@@ -0,0 +1,37 @@
+// cache-scratch (Hoard): passive false sharing. The main thread allocates one
+// small object per worker back to back, so they share cache lines, and hands
+// object t to worker t. Each worker frees it, then repeatedly allocates an
+// object of the same size, writes it --repetitions times and frees it. An
+// allocator that gives the freed object (or its neighbours) to the worker
+// that freed it keeps the workers writing into each other's cache lines.
+//
+//   suite_cache_scratch_<alloc> [--threads N] [--iterations N] [--size N]
+//                               [--repetitions N] [--csv FILE]
+#include "suite.h"
+
+int main(int argc, char** argv)
+{
+    if (!benchAllocatorAvailable())
+        return 1;
+    SuiteArgs args(argc, argv);
+    size_t iterations = args.get("--iterations", 1000);
+    size_t size = args.get("--size", 8);
+    size_t repetitions = args.get("--repetitions", 20000);
+
+    std::vector<char*> handed(args.threads);
+    for (auto& p : handed) p = static_cast<char*>(benchAlloc(size));
+
+    SuiteRun run;
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < args.threads; ++t)
+        threads.emplace_back([&, t] {
+            benchDealloc(handed[t], size);
+            for (size_t i = 0; i < iterations; ++i) {
+                char* p = static_cast<char*>(benchAlloc(size));
+                writeRepeatedly(p, size, repetitions);
+                benchDealloc(p, size);
+            }
+        });
+    for (auto& th : threads) th.join();
+    run.finish("cache-scratch", args);
+}
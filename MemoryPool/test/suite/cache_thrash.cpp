@@ -0,0 +1,32 @@
+// cache-thrash (Hoard): active false sharing. Every worker repeatedly
+// allocates a small object, writes it --repetitions times and frees it. An
+// allocator that serves concurrent requests from one cache line (a shared
+// free list, 8-byte blocks carved next to each other for different threads)
+// makes every write miss.
+//
+//   suite_cache_thrash_<alloc> [--threads N] [--iterations N] [--size N]
+//                              [--repetitions N] [--csv FILE]
+#include "suite.h"
+
+int main(int argc, char** argv)
+{
+    if (!benchAllocatorAvailable())
+        return 1;
+    SuiteArgs args(argc, argv);
+    size_t iterations = args.get("--iterations", 1000);
+    size_t size = args.get("--size", 8);
+    size_t repetitions = args.get("--repetitions", 20000);
+
+    SuiteRun run;
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < args.threads; ++t)
+        threads.emplace_back([&] {
+            for (size_t i = 0; i < iterations; ++i) {
+                char* p = static_cast<char*>(benchAlloc(size));
+                writeRepeatedly(p, size, repetitions);
+                benchDealloc(p, size);
+            }
+        });
+    for (auto& th : threads) th.join();
+    run.finish("cache-thrash", args);
+}
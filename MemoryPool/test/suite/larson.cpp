@@ -0,0 +1,57 @@
+// larson (Larson & Krishnan): a server whose worker threads come and go. Each
+// of --threads lanes owns --slots live objects of --min-size..--max-size
+// bytes and replaces random ones --ops times; then a new thread takes over
+// the lane's objects once the old one has exited, --generations times. Objects
+// are therefore mostly freed by a thread that did not allocate them, and
+// every generation starts with a cold thread cache.
+//
+//   suite_larson_<alloc> [--threads N] [--slots N] [--ops N] [--generations N]
+//                        [--min-size N] [--max-size N] [--csv FILE]
+#include "suite.h"
+#include <random>
+
+using Block = std::pair<void*, size_t>;
+
+int main(int argc, char** argv)
+{
+    if (!benchAllocatorAvailable())
+        return 1;
+    SuiteArgs args(argc, argv);
+    size_t slots = args.get("--slots", 1000);
+    size_t ops = args.get("--ops", 50000);
+    size_t generations = args.get("--generations", 20);
+    size_t minSize = args.get("--min-size", 8);
+    size_t maxSize = args.get("--max-size", 1000);
+
+    std::vector<std::vector<Block>> lanes(args.threads);
+    std::mt19937 seed(4141);
+    for (auto& lane : lanes)
+        for (size_t i = 0; i < slots; ++i) {
+            size_t s = minSize + seed() % (maxSize - minSize + 1);
+            lane.push_back({ benchAlloc(s), s });
+        }
+
+    SuiteRun run;
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < args.threads; ++t)
+        threads.emplace_back([&, t] {
+            // each generation is a thread of its own, exiting before the next
+            for (size_t g = 0; g < generations; ++g)
+                std::thread([&, g] {
+                    std::mt19937 rng(static_cast<unsigned>(t * 7919 + g));
+                    auto& lane = lanes[t];
+                    for (size_t i = 0; i < ops; ++i) {
+                        Block& b = lane[rng() % lane.size()];
+                        benchDealloc(b.first, b.second);
+                        b.second = minSize + rng() % (maxSize - minSize + 1);
+                        b.first = benchAlloc(b.second);
+                        static_cast<char*>(b.first)[0] = 1;
+                    }
+                }).join();
+        });
+    for (auto& th : threads) th.join();
+    run.finish("larson", args);
+
+    for (auto& lane : lanes)
+        for (auto& [p, s] : lane) benchDealloc(p, s);
+}
@@ -0,0 +1,42 @@
+// sh6bench-like (MicroQuill SmartHeap): per thread, rounds of --count
+// allocations whose sizes step through 1..--max-size, freed in the orders
+// that stress a free list differently: every other one in reverse (LIFO),
+// then the array refilled and freed front to back (FIFO), then the rest
+// from the back. Churn across every size class at once; each thread works
+// alone, without cross-thread frees.
+//
+//   suite_sh6bench_<alloc> [--threads N] [--rounds N] [--count N]
+//                          [--max-size N] [--csv FILE]
+#include "suite.h"
+
+int main(int argc, char** argv)
+{
+    if (!benchAllocatorAvailable())
+        return 1;
+    SuiteArgs args(argc, argv);
+    size_t rounds = args.get("--rounds", 200);
+    size_t count = args.get("--count", 10000);
+    size_t maxSize = args.get("--max-size", 1000);
+
+    SuiteRun run;
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < args.threads; ++t)
+        threads.emplace_back([&] {
+            std::vector<std::pair<char*, size_t>> blocks(count);
+            auto fill = [&](size_t i, size_t round) {
+                size_t s = 1 + (i * 7 + round) % maxSize;
+                blocks[i] = { static_cast<char*>(benchAlloc(s)), s };
+                blocks[i].first[0] = 1;
+            };
+            for (size_t round = 0; round < rounds; ++round) {
+                for (size_t i = 0; i < count; ++i) fill(i, round);
+                for (size_t i = count; i-- > 0;)
+                    if (i % 2) benchDealloc(blocks[i].first, blocks[i].second);
+                for (size_t i = 1; i < count; i += 2) fill(i, round + 1);
+                for (size_t i = 0; i < count / 2; ++i) benchDealloc(blocks[i].first, blocks[i].second);
+                for (size_t i = count; i-- > count / 2;) benchDealloc(blocks[i].first, blocks[i].second);
+            }
+        });
+    for (auto& th : threads) th.join();
+    run.finish("sh6bench", args);
+}
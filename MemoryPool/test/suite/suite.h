@@ -0,0 +1,88 @@
+#pragma once
+// Shared harness for the workload suite (test/suite/*.cpp): standard
+// allocator workloads after mimalloc-bench, each built once per allocator by
+// add_bench_variants(). Every workload does a fixed amount of work and
+// reports its wall time, so lower is better; the pool variant also reports
+// how often the CentralCache and PageCache locks had to wait. With --csv the
+// result is appended as one row for `python dev.py suite` to tabulate.
+#include "../benchmarks.h"
+#include "../allocators.h"
+#include "../../include/Stats.h"
+#include <fstream>
+#include <string>
+
+// The write loop of cache-scratch and cache-thrash, kept out of line so it
+// compiles the same for every allocator variant (inlined, the stores through
+// p may alias whatever the loop reads from memory, differently per variant).
+__attribute__((noinline)) inline void writeRepeatedly(volatile char* p, size_t size, size_t repetitions)
+{
+    for (size_t r = 0; r < repetitions; ++r)
+        for (size_t b = 0; b < size; ++b) p[b] = static_cast<char>(p[b] + 1);
+}
+
+// --threads and --csv, common to every workload; the rest are workload
+// parameters looked up by name.
+struct SuiteArgs
+{
+    size_t threads = 4;
+    std::string csvPath;
+    std::vector<std::pair<std::string, std::string>> rest;
+
+    SuiteArgs(int argc, char** argv)
+    {
+        for (int i = 1; i + 1 < argc; i += 2) {
+            std::string arg = argv[i];
+            if (arg == "--threads") threads = std::stoul(argv[i + 1]);
+            else if (arg == "--csv") csvPath = argv[i + 1];
+            else rest.emplace_back(arg, argv[i + 1]);
+        }
+    }
+
+    size_t get(const char* name, size_t fallback) const
+    {
+        for (auto& [arg, value] : rest)
+            if (arg == name) return std::stoul(value);
+        return fallback;
+    }
+};
+
+// Started just before the timed part of a workload.
+class SuiteRun
+{
+public:
+    void finish(const char* workload, const SuiteArgs& args)
+    {
+        double seconds = timer_.elapsed() / 1000.0;
+        PoolStats after = poolStats();
+        size_t centralWaits = after.centralLockContended - before_.centralLockContended;
+        size_t pageWaits = after.pageLockContended - before_.pageLockContended;
+        std::cout << std::left << std::setw(14) << workload << std::setw(12) << BENCH_ALLOC_NAME << std::right
+                  << std::setw(4) << args.threads << " threads" << std::fixed << std::setprecision(3)
+                  << std::setw(10) << seconds << " s";
+#ifdef BENCH_USE_MEMPOOL
+        std::cout << "   lock waits: central " << centralWaits << ", page " << pageWaits;
+#endif
+        std::cout << "\n";
+
+        if (args.csvPath.empty()) return;
+        bool fresh = !std::ifstream(args.csvPath).good();
+        std::ofstream csv(args.csvPath, std::ios::app);
+        if (fresh) csv << "workload,allocator,threads,seconds,central_waits,page_waits\n";
+        csv << workload << "," << BENCH_ALLOC_NAME << "," << args.threads << "," << std::fixed
+            << std::setprecision(4) << seconds << "," << centralWaits << "," << pageWaits << "\n";
+    }
+
+private:
+    static PoolStats poolStats()
+    {
+#ifdef BENCH_USE_MEMPOOL
+        return MemoryPool::getStats();
+#else
+        return {};
+#endif
+    }
+
+    // in this order: the timer starts after the counters are read
+    PoolStats before_ = poolStats();
+    Timer timer_;
+};
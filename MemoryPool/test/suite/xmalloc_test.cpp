@@ -0,0 +1,61 @@
+// xmalloc-test (Lever & Boreham): producer/consumer frees. --threads
+// allocating threads each fill batches of --batch objects of --size bytes
+// and push them on one shared stack; as many freeing threads pop batches and
+// free every object, so no object is freed by the thread that allocated it.
+// The allocators' cross-thread free paths (and for the pool, the batches a
+// freeing thread's cache returns to CentralCache) carry the whole load.
+//
+//   suite_xmalloc_test_<alloc> [--threads N] [--objects N] [--batch N]
+//                              [--size N] [--csv FILE]
+#include "suite.h"
+#include <condition_variable>
+#include <mutex>
+
+int main(int argc, char** argv)
+{
+    if (!benchAllocatorAvailable())
+        return 1;
+    SuiteArgs args(argc, argv);
+    size_t objects = args.get("--objects", 1000000); // per allocating thread
+    size_t batchSize = args.get("--batch", 100);
+    size_t size = args.get("--size", 64);
+
+    std::mutex lock;
+    std::condition_variable ready;
+    std::vector<std::vector<void*>> stack;
+    size_t producing = args.threads;
+
+    SuiteRun run;
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < args.threads; ++t)
+        threads.emplace_back([&] {
+            for (size_t i = 0; i < objects; i += batchSize) {
+                std::vector<void*> batch(batchSize);
+                for (auto& p : batch) {
+                    p = benchAlloc(size);
+                    *static_cast<char*>(p) = 1;
+                }
+                std::lock_guard<std::mutex> g(lock);
+                stack.push_back(std::move(batch));
+                ready.notify_one();
+            }
+            std::lock_guard<std::mutex> g(lock);
+            if (--producing == 0) ready.notify_all();
+        });
+    for (size_t t = 0; t < args.threads; ++t)
+        threads.emplace_back([&] {
+            for (;;) {
+                std::vector<void*> batch;
+                {
+                    std::unique_lock<std::mutex> g(lock);
+                    ready.wait(g, [&] { return !stack.empty() || producing == 0; });
+                    if (stack.empty()) return;
+                    batch = std::move(stack.back());
+                    stack.pop_back();
+                }
+                for (void* p : batch) benchDealloc(p, size);
+            }
+        });
+    for (auto& th : threads) th.join();
+    run.finish("xmalloc-test", args);
+}
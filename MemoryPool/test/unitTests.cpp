@@ -1,4 +1,7 @@
 #include "../include/ThreadCache.h"   
+#include "../include/MemoryPool.h"
+#include "../include/PooledPromise.h"
+#include "../include/SharedHeap.h"
 #include <iostream>
 #include <vector>
 #include <thread>
@@ -7,11 +10,34 @@
 #include <random>
 #include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <coroutine>
+#include <bit>
+#ifdef __linux__
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 using std::size_t;
 
 
+// Counts operator new calls, so tests can check the pool's own paths never
+// reach the system allocator for bookkeeping.
+static std::atomic<size_t> systemNewCalls{ 0 };
+void* operator new(size_t size) {
+    systemNewCalls.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
 static inline void* MP_allocate(size_t size) {
     return ThreadCache::getInstance().allocate(size);
 }
@@ -144,15 +170,1035 @@ void testStress() {
     std::cout << "Stress test passed!" << std::endl;
 }
 
+// Must run before anything else touches the 200 B class.
+void testBitmapLayout() {
+    std::cout << "Running bitmap layout test..." << std::endl;
+
+    const size_t size = 200;
+    bool layoutSet = MemoryPool::setSpanLayout(size, SpanLayout::Bitmap);
+    assert(layoutSet);
+    size_t releasedBefore = MemoryPool::getStats().centralSpansReleased;
+
+    std::vector<char*> ptrs;
+    for (int i = 0; i < 5000; ++i) {
+        char* p = static_cast<char*>(MP_allocate(size));
+        assert(p != nullptr);
+        std::memset(p, i & 0xFF, size);
+        ptrs.push_back(p);
+    }
+    for (int i = 0; i < 5000; ++i)
+        assert(ptrs[i][0] == static_cast<char>(i & 0xFF) && ptrs[i][size - 1] == static_cast<char>(i & 0xFF));
+
+    std::sort(ptrs.begin(), ptrs.end());
+    assert(std::adjacent_find(ptrs.begin(), ptrs.end()) == ptrs.end());
+
+    // freed in address order: the blocks this thread's cache keeps (the most
+    // recent ones) pin only the last spans, the rest must go back to PageCache
+    for (char* p : ptrs) MP_deallocate(p, size);
+    assert(MemoryPool::getStats().centralSpansReleased > releasedBefore);
+    bool layoutChanged = MemoryPool::setSpanLayout(size, SpanLayout::FreeList);
+    assert(!layoutChanged);
+
+    std::cout << "Bitmap layout test passed!" << std::endl;
+}
+
+// Sampled objects must be usable, show up in the dump while live and vanish
+// from it once freed.
+void testHeapProfiler() {
+    std::cout << "Running heap profiler test..." << std::endl;
+
+    const char* path = "mp_heap_profile.txt";
+    auto countSamples = [&]() {
+        std::ifstream in(path);
+        std::string line;
+        std::getline(in, line);
+        assert(line.rfind("heap profile:", 0) == 0 && line.find("heap_v2/4096") != std::string::npos);
+        return std::stoul(line.substr(line.find(':') + 1));
+    };
+
+    MemoryPool::setProfileSampleRate(4096);
+    std::vector<char*> ptrs;
+    for (int i = 0; i < 8000; ++i) {
+        char* p = static_cast<char*>(MemoryPool::allocate(256));
+        std::memset(p, i & 0xFF, 256);
+        ptrs.push_back(p);
+    }
+    for (int i = 0; i < 8000; ++i)
+        assert(ptrs[i][0] == static_cast<char>(i & 0xFF) && ptrs[i][255] == static_cast<char>(i & 0xFF));
+
+    // 2 MB allocated at one sample per 4 KB; the first MB may still fall in
+    // the long interval drawn while sampling was off
+    bool dumped = MemoryPool::dumpHeapProfile(path);
+    assert(dumped);
+    size_t sampled = countSamples();
+    assert(sampled > 20 && sampled < 1000);
+
+    for (int i = 0; i < 8000; ++i) MemoryPool::deallocate(ptrs[i], 256);
+#ifdef MPOOL_HEAP_DEBUG
+    HeapDebug::flushQuarantine();
+#endif
+    dumped = MemoryPool::dumpHeapProfile(path);
+    assert(dumped && countSamples() == 0);
+
+    MemoryPool::setProfileSampleRate(0);
+    std::remove(path);
+    std::cout << "Heap profiler test passed!" << std::endl;
+}
+
+// With maintenance running, free spans go back to PageCache and the OS and an
+// idle thread cache shrinks on its next call, without any further frees.
+void testMaintenance() {
+    std::cout << "Running maintenance test..." << std::endl;
+
+    const size_t size = 512;
+    std::vector<void*> ptrs;
+    for (int i = 0; i < 4000; ++i) ptrs.push_back(MP_allocate(size));
+    std::sort(ptrs.begin(), ptrs.end());
+    for (void* p : ptrs) MP_deallocate(p, size);
+    PoolStats before = MemoryPool::getStats();
+
+    MemoryPool::startMaintenance(std::chrono::milliseconds(10));
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    MP_deallocate(MP_allocate(8), 8); // picks up the trim request
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    MemoryPool::stopMaintenance();
+    PoolStats after = MemoryPool::getStats();
+
+    assert(after.threadHeldBytes < before.threadHeldBytes);
+    assert(after.centralSpansReleased > before.centralSpansReleased);
+    assert(after.pageReleasedBytes > before.pageReleasedBytes);
+
+    std::cout << "Maintenance test passed!" << std::endl;
+}
+
+// Heaps own their memory: traffic on them leaves the default tiers alone, and
+// destroy() gives everything back at once, after which the heap is reusable.
+void testHeapInstances() {
+    std::cout << "Running heap instances test..." << std::endl;
+
+    size_t globalMapped = MemoryPool::getStats().mappedBytes;
+    mpool::Heap a, b;
+
+    auto fill = [](mpool::Heap& heap, char tag, std::vector<std::pair<char*, size_t>>& out) {
+        std::mt19937 rng(tag);
+        for (int i = 0; i < 2000; ++i) {
+            size_t sz = 8 + rng() % 4096; // includes sizes above MAX_ALLOC_SIZE
+            char* p = static_cast<char*>(heap.allocate(sz));
+            assert(p != nullptr);
+            std::memset(p, tag, sz);
+            out.push_back({ p, sz });
+        }
+    };
+
+    std::vector<std::pair<char*, size_t>> fromA[4], fromB[4];
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+        threads.emplace_back([&, t]() {
+            fill(a, 'a', fromA[t]);
+            fill(b, 'b', fromB[t]);
+            // free half of A's blocks before the heap is torn down
+            for (size_t i = 0; i < fromA[t].size(); i += 2) a.deallocate(fromA[t][i].first, fromA[t][i].second);
+        });
+    for (auto& th : threads) th.join();
+
+    for (int t = 0; t < 4; ++t) {
+        for (size_t i = 1; i < fromA[t].size(); i += 2)
+            assert(fromA[t][i].first[0] == 'a' && fromA[t][i].first[fromA[t][i].second - 1] == 'a');
+        for (auto& [p, sz] : fromB[t])
+            assert(p[0] == 'b' && p[sz - 1] == 'b');
+    }
+    assert(MemoryPool::getStats().mappedBytes == globalMapped);
+    assert(a.getStats().mappedBytes > 0 && b.getStats().mappedBytes > 0);
+
+    a.destroy();
+    assert(a.getStats().mappedBytes == 0);
+    assert(b.getStats().mappedBytes > 0);
+    char* again = static_cast<char*>(a.allocate(64));
+    std::memset(again, 1, 64);
+    a.deallocate(again, 64);
+
+    std::cout << "Heap instances test passed!" << std::endl;
+}
+
+// destroy() cannot reach the caches other threads keep for the heap; such a
+// thread frees them when it next creates a cache for a heap.
+void testHeapStaleCaches() {
+    std::cout << "Running heap stale caches test..." << std::endl;
+
+    mpool::Heap a, b;
+    std::atomic<int> step{ 0 };
+    auto waitFor = [&](int s) {
+        while (step.load() != s) std::this_thread::yield();
+    };
+    std::thread user([&] {
+        a.deallocate(a.allocate(64), 64);
+        step = 1;
+        waitFor(2);
+        b.deallocate(b.allocate(64), 64); // a new cache: drops the one for a
+        step = 3;
+        waitFor(4); // still alive, so its exit frees nothing yet
+    });
+    waitFor(1);
+    size_t caches = mpool::Heap::threadCaches();
+    a.destroy();
+    step = 2;
+    waitFor(3);
+    assert(mpool::Heap::threadCaches() == caches);
+    step = 4;
+    user.join();
+    assert(mpool::Heap::threadCaches() == caches - 1);
+
+    std::cout << "Heap stale caches test passed!" << std::endl;
+}
+
+// Spans of up to 16 pages freed on a CPU are handed out again from its
+// span-cache slot without the PageCache mutex.
+void testSpanCache() {
+    std::cout << "Running span cache test..." << std::endl;
+
+    mpool::Heap heap;
+    const size_t SIZE = 4 * Size::PAGE_SIZE;
+    heap.deallocate(heap.allocate(SIZE), SIZE);
+    PoolStats before = heap.getStats();
+    assert(before.pageCachedBytes == SIZE);
+    for (int i = 0; i < 100; ++i) {
+        void* p = heap.allocate(SIZE);
+        std::memset(p, i, SIZE);
+        heap.deallocate(p, SIZE);
+    }
+    PoolStats after = heap.getStats();
+    // only a migration to another CPU between a free and the next allocation
+    // can miss
+    assert(after.spanCacheHits - before.spanCacheHits > 90);
+    assert(after.pageLockAcquires - before.pageLockAcquires < 20);
+
+    // too long for the cache: straight to the free lists
+    heap.deallocate(heap.allocate(64 * Size::PAGE_SIZE), 64 * Size::PAGE_SIZE);
+    assert(heap.getStats().pageCachedBytes <= SIZE * 2);
+
+    heap.setSpanCache(false);
+    PoolStats flushed = heap.getStats();
+    assert(flushed.pageCachedBytes == 0 && flushed.pageFreeBytes >= after.pageFreeBytes + SIZE);
+    heap.deallocate(heap.allocate(SIZE), SIZE);
+    assert(heap.getStats().pageCachedBytes == 0);
+
+    std::cout << "Span cache test passed!" << std::endl;
+}
+
+// Free spans merge with their neighbours even after releaseToOS has marked
+// them released and zero, so the pages stay reusable as one run.
+void testReleasedSpanCoalescing() {
+    std::cout << "Running released span coalescing test..." << std::endl;
+
+    mpool::Heap heap;
+    heap.setSpanCache(false);
+    const size_t RUN = 32 * Size::PAGE_SIZE, PART = 8 * Size::PAGE_SIZE;
+    heap.deallocate(heap.allocate(RUN), RUN);
+    size_t mapped = heap.getStats().mappedBytes;
+    assert(mapped == RUN);
+
+    // carve the run into adjacent parts, dirty them and give them back
+    char* parts[4];
+    for (char*& p : parts) {
+        p = static_cast<char*>(heap.allocate(PART));
+        std::memset(p, 1, PART);
+    }
+    for (char* p : parts) heap.deallocate(p, PART);
+    size_t released = heap.releaseToOS();
+    assert(released == RUN / Size::PAGE_SIZE);
+
+    // a part freed next to the released rest merges back into it
+    char* part = static_cast<char*>(heap.allocate(PART));
+    std::memset(part, 2, PART);
+    heap.deallocate(part, PART);
+    char* whole = static_cast<char*>(heap.allocate(RUN));
+    assert(whole != nullptr);
+    std::memset(whole, 3, RUN);
+    assert(heap.getStats().mappedBytes == mapped);
+    heap.deallocate(whole, RUN);
+
+    std::cout << "Released span coalescing test passed!" << std::endl;
+}
+
+// With cache coloring, the first block of successive spans of a class starts
+// at different 64-byte offsets, in both span layouts, and every block still
+// maps back to its class.
+void testCacheColoring() {
+    std::cout << "Running cache coloring test..." << std::endl;
+
+    for (SpanLayout layout : { SpanLayout::FreeList, SpanLayout::Bitmap }) {
+        mpool::Heap heap;
+        const size_t SIZE = 1024;
+        bool set = heap.setSpanLayout(SIZE, layout);
+        assert(set);
+        heap.setCacheColoring(true);
+
+        std::vector<void*> ptrs;
+        size_t offsets = 0; // bitmask of page offsets seen, in cache lines
+        for (int i = 0; i < 4000; ++i) {
+            void* p = heap.allocate(SIZE);
+            assert(p);
+            uintptr_t addr = reinterpret_cast<uintptr_t>(p);
+            assert(addr % Size::CACHE_LINE == 0);
+            offsets |= size_t(1) << (addr % SIZE / Size::CACHE_LINE);
+            std::memset(p, i, SIZE);
+            ptrs.push_back(p);
+        }
+        assert(std::popcount(offsets) > 4);
+        for (size_t i = 0; i < ptrs.size(); ++i)
+            assert(*static_cast<unsigned char*>(ptrs[i]) == static_cast<unsigned char>(i));
+        for (void* p : ptrs) heap.deallocate(p, SIZE);
+    }
+
+    // off: power-of-two blocks stay naturally aligned
+    mpool::Heap heap;
+    std::vector<void*> ptrs;
+    for (int i = 0; i < 1000; ++i) {
+        ptrs.push_back(heap.allocate(512));
+        assert(reinterpret_cast<uintptr_t>(ptrs.back()) % 512 == 0);
+    }
+    for (void* p : ptrs) heap.deallocate(p, 512);
+
+    std::cout << "Cache coloring test passed!" << std::endl;
+}
+
+// The soft limit trims the pool once it is crossed; the hard limit fails
+// allocations unless the handler (or std::new_handler) makes room; a cgroup
+// pressure file over its threshold makes the watcher trim.
+namespace
+{
+    int limitHandlerCalls = 0;
+    bool raiseLimit(size_t bytes)
+    {
+        ++limitHandlerCalls;
+        MemoryLimit::setHardLimit(MemoryLimit::hardLimit() + bytes + (1 << 20));
+        return true;
+    }
+    bool refuse(size_t)
+    {
+        ++limitHandlerCalls;
+        return false;
+    }
+    void raiseLimitNewHandler()
+    {
+        raiseLimit(0);
+    }
+}
+
+void testMemoryLimit() {
+    std::cout << "Running memory limit test..." << std::endl;
+
+    const size_t SIZE = 1024;
+    std::vector<void*> ptrs;
+    auto release = [&] {
+        for (void* p : ptrs) MP_deallocate(p, SIZE);
+        ptrs.clear();
+    };
+
+    // soft: growing 4 MB past a limit 1 MB away flushes on a later refill
+    MemoryPool::trim();
+    size_t flushes = MemoryLimit::flushes();
+    MemoryPool::setMemoryLimits(MemoryLimit::footprint() + (1 << 20), 0);
+    for (size_t i = 0; i < (4 << 20) / SIZE; ++i) ptrs.push_back(MP_allocate(SIZE));
+    assert(MemoryLimit::flushes() > flushes);
+    release();
+
+    // the flush frees retired blocks into the very list the refill running it
+    // fills: they are handed out again rather than lost
+    const size_t RETIRED = 88;
+    std::vector<void*> retired;
+    for (int i = 0; i < 100; ++i) retired.push_back(MemoryPool::allocate(RETIRED));
+    for (void* r : retired) MemoryPool::retire(r, RETIRED);
+    std::sort(retired.begin(), retired.end());
+    flushes = MemoryLimit::flushes();
+    MemoryPool::setMemoryLimits(1, 0);
+    size_t reused = 0;
+    std::vector<void*> again;
+    for (int i = 0; i < 10000; ++i) {
+        again.push_back(MemoryPool::allocate(RETIRED));
+        reused += std::binary_search(retired.begin(), retired.end(), again.back());
+    }
+    assert(MemoryLimit::flushes() > flushes);
+#ifndef MPOOL_HEAP_DEBUG
+    // (the quarantine holds freed blocks back)
+    assert(reused == retired.size());
+#endif
+
+    // a limit below what is live backs off instead of flushing on every
+    // sixteenth of it
+    for (size_t i = 0; i < (16 << 20) / SIZE; ++i) ptrs.push_back(MP_allocate(SIZE));
+    assert(MemoryLimit::flushes() - flushes < 24);
+    MemoryPool::setMemoryLimits(0, 0);
+
+    // heaps count towards the footprint, so the flush empties theirs too
+    mpool::Heap heap;
+    heap.setSpanCache(false);
+    heap.deallocate(heap.allocate(64 * Size::PAGE_SIZE), 64 * Size::PAGE_SIZE);
+    size_t heapReleased = heap.getStats().pageReleasedBytes;
+    MemoryLimit::flush();
+    assert(heap.getStats().pageReleasedBytes > heapReleased);
+    for (void* r : again) MemoryPool::deallocate(r, RETIRED);
+    release();
+
+    // hard: allocation fails once the limit is reached...
+    MemoryPool::trim();
+    MemoryPool::setMemoryLimits(0, MemoryLimit::footprint() + (256 << 10));
+    MemoryPool::setMemoryLimitHandler(refuse);
+    void* p = nullptr;
+    for (size_t i = 0; i < (8 << 20) / SIZE && (p = MP_allocate(SIZE)); ++i) ptrs.push_back(p);
+    assert(p == nullptr && limitHandlerCalls > 0);
+    assert(MemoryLimit::footprint() <= MemoryLimit::hardLimit());
+
+    // ...unless the handler raises it
+    MemoryPool::setMemoryLimitHandler(raiseLimit);
+    for (size_t i = 0; i < (1 << 20) / SIZE; ++i) {
+        p = MP_allocate(SIZE);
+        assert(p);
+        ptrs.push_back(p);
+    }
+
+    // without a handler, std::new_handler gets the same chance
+    MemoryPool::setMemoryLimitHandler(nullptr);
+    MemoryLimit::setHardLimit(MemoryLimit::footprint());
+    std::set_new_handler(raiseLimitNewHandler);
+    int calls = limitHandlerCalls;
+    for (size_t i = 0; i < (1 << 20) / SIZE; ++i) {
+        p = MP_allocate(SIZE);
+        assert(p);
+        ptrs.push_back(p);
+    }
+    assert(limitHandlerCalls > calls);
+    std::set_new_handler(nullptr);
+    MemoryPool::setMemoryLimits(0, 0);
+    release();
+
+#ifdef __linux__
+    // pressure: a fake cgroup directory reporting 55% "some" stall
+    char dir[] = "/tmp/mp_cgroupXXXXXX";
+    bool made = mkdtemp(dir) != nullptr;
+    assert(made);
+    std::string pressure = std::string(dir) + "/memory.pressure";
+    std::ofstream(pressure) << "some avg10=55.00 avg60=20.00 avg300=5.00 total=1000\n"
+                            << "full avg10=0.00 avg60=0.00 avg300=0.00 total=0\n";
+    assert(!MemoryPool::watchMemoryPressure("/nonexistent", 10.0));
+    flushes = MemoryLimit::flushes();
+    bool watching = MemoryLimit::watchPressure(dir, 50.0, 0, std::chrono::milliseconds(5));
+    assert(watching);
+    for (int i = 0; i < 400 && MemoryLimit::flushes() == flushes; ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    assert(MemoryLimit::flushes() > flushes);
+    MemoryPool::stopWatchingMemoryPressure();
+    std::remove(pressure.c_str());
+    rmdir(dir);
+#endif
+
+    std::cout << "Memory limit test passed!" << std::endl;
+}
+
+// reserve() maps pages the later spans are carved from; prewarm() fills a
+// size class, and with fillThreadCache the first allocations need no refill.
+void testPrewarm() {
+    std::cout << "Running prewarm test..." << std::endl;
+
+    PoolStats before = MemoryPool::getStats();
+    bool reserved = MemoryPool::reserve(8 << 20, true);
+    assert(reserved);
+    PoolStats afterReserve = MemoryPool::getStats();
+    assert(afterReserve.mappedBytes >= before.mappedBytes + (8 << 20));
+    assert(afterReserve.pageFreeBytes >= before.pageFreeBytes + (8 << 20));
+
+    const size_t size = 768;
+    size_t available = MemoryPool::prewarm(size, 3000);
+    assert(available >= 3000);
+    size_t cached = ThreadCache::getInstance().prewarm(Size::sizeToIndex(size), 256);
+    assert(cached >= 256);
+    assert(MemoryPool::prewarm(0, 10) == 0 && MemoryPool::prewarm(Size::MAX_ALLOC_SIZE + 1, 10) == 0);
+
+    std::vector<void*> ptrs;
+#ifndef MPOOL_HEAP_DEBUG
+    // served from the filled thread cache: no CentralCache lock taken
+    size_t acquires = MemoryPool::getStats().centralLockAcquires;
+    for (int i = 0; i < 256; ++i) ptrs.push_back(MP_allocate(size));
+    assert(MemoryPool::getStats().centralLockAcquires == acquires);
+#endif
+    for (int i = 0; i < 2000; ++i) ptrs.push_back(MP_allocate(size));
+    for (void* p : ptrs) std::memset(p, 0x5a, size);
+    assert(MemoryPool::getStats().mappedBytes == afterReserve.mappedBytes);
+    for (void* p : ptrs) MP_deallocate(p, size);
+
+    // prewarmed spans are all free, but reclaim keeps them until used
+    const size_t spare = 1536;
+    CentralCache::getInstance().reclaimAll();
+    size_t warmed = MemoryPool::prewarm(spare, 500);
+    assert(warmed >= 500);
+    CentralCache::getInstance().reclaimAll();
+    size_t kept = MemoryPool::prewarm(spare, 0);
+    assert(kept == warmed);
+
+    std::cout << "Prewarm test passed!" << std::endl;
+}
+
+// allocateZeroed must return zero memory whether the block is fresh from a
+// zero span, recycled after being written, or above MAX_ALLOC_SIZE.
+void testAllocateZeroed() {
+    std::cout << "Running allocate zeroed test..." << std::endl;
+
+    auto isZero = [](const void* p, size_t n) {
+        const unsigned char* c = static_cast<const unsigned char*>(p);
+        return std::all_of(c, c + n, [](unsigned char b) { return b == 0; });
+    };
+
+    const size_t SIZES[] = { 8, 136, 1200, Size::MAX_ALLOC_SIZE + 100 };
+    for (size_t size : SIZES) {
+        std::vector<void*> ptrs;
+        for (int round = 0; round < 3; ++round) {
+            for (int i = 0; i < 3000; ++i) {
+                void* p = MemoryPool::allocateZeroed(size);
+                assert(p != nullptr);
+                assert(isZero(p, size));
+                ptrs.push_back(p);
+            }
+            // dirty them, and free half so the next round mixes recycled
+            // blocks in front of fresh ones
+            for (void* p : ptrs) std::memset(p, 0xab, size);
+            for (size_t i = 0; i < ptrs.size(); i += 2) MemoryPool::deallocate(ptrs[i], size);
+            std::vector<void*> kept;
+            for (size_t i = 1; i < ptrs.size(); i += 2) kept.push_back(ptrs[i]);
+            ptrs.swap(kept);
+        }
+        for (void* p : ptrs) MemoryPool::deallocate(p, size);
+    }
+    assert(MemoryPool::allocateZeroed(0) == nullptr);
+
+    std::cout << "Allocate zeroed test passed!" << std::endl;
+}
+
+// allocateAtLeast reports the size-class slack, usableSize reads it back from
+// span metadata (or the profile record of a sampled block), and the block can
+// be freed with either size.
+void testAllocateAtLeast() {
+    std::cout << "Running allocate at least test..." << std::endl;
+
+    const size_t SIZES[] = { 1, 100, 130, 1100, Size::MAX_ALLOC_SIZE };
+    for (size_t size : SIZES) {
+        AllocationResult r = MemoryPool::allocateAtLeast(size);
+        assert(r.ptr && r.size >= size);
+#ifndef MPOOL_HEAP_DEBUG
+        assert(r.size == Size::indexToBlockSize(Size::sizeToIndex(size)));
+#endif
+        assert(MemoryPool::usableSize(r.ptr) == r.size);
+        std::memset(r.ptr, 0xab, r.size);
+        MemoryPool::deallocate(r.ptr, r.size);
+
+        void* p = MemoryPool::allocate(size);
+        assert(MemoryPool::usableSize(p) == r.size);
+        MemoryPool::deallocate(p, size);
+    }
+
+    AllocationResult r = MemoryPool::allocateAtLeast(130);
+    MemoryPool::deallocate(r.ptr, 130);
+    assert(MemoryPool::allocateAtLeast(0).ptr == nullptr);
+
+    r = MemoryPool::allocateAtLeast(Size::MAX_ALLOC_SIZE + 100);
+    assert(r.ptr && r.size == Size::MAX_ALLOC_SIZE + 100);
+    std::memset(r.ptr, 0xab, r.size);
+    MemoryPool::deallocate(r.ptr, r.size);
+
+    // sampled blocks report the same slack
+    MemoryPool::setProfileSampleRate(1024);
+    std::vector<AllocationResult> blocks;
+    size_t sampled = 0;
+    for (int i = 0; i < 20000; ++i) {
+        blocks.push_back(MemoryPool::allocateAtLeast(130));
+        assert(MemoryPool::usableSize(blocks.back().ptr) == blocks.back().size);
+        sampled += HeapProfiler::isSampled(blocks.back().ptr);
+    }
+    assert(sampled > 0);
+    MemoryPool::setProfileSampleRate(0);
+    for (auto& b : blocks) MemoryPool::deallocate(b.ptr, b.size);
+
+    std::cout << "Allocate at least test passed!" << std::endl;
+}
+
+// Minimal coroutine whose frame comes from the pool; it runs to its final
+// suspend point when resumed and is destroyed by its owner.
+struct PooledTask {
+    struct promise_type : mpool::pooled_promise {
+        int value = 0;
+        PooledTask get_return_object() { return { std::coroutine_handle<promise_type>::from_promise(*this) }; }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_value(int v) { value = v; }
+        void unhandled_exception() { std::terminate(); }
+    };
+    std::coroutine_handle<promise_type> handle;
+};
+
+PooledTask smallFrame(int x) {
+    co_return x * 2;
+}
+
+PooledTask largeFrame(int x) {
+    char buf[3000];
+    std::memset(buf, x, sizeof(buf));
+    co_await std::suspend_always{};
+    co_return buf[sizeof(buf) - 1];
+}
+
+void testPooledPromise() {
+    std::cout << "Running pooled promise test..." << std::endl;
+
+    PooledTask small = smallFrame(21);
+#ifndef MPOOL_HEAP_DEBUG
+    assert(CentralCache::getInstance().blockSizeOf(small.handle.address()) != 0);
+#endif
+    small.handle.resume();
+    assert(small.handle.done() && small.handle.promise().value == 42);
+    small.handle.destroy();
+
+    // frames above MAX_ALLOC_SIZE take the large-object tier
+    PooledTask large = largeFrame(7);
+#ifndef MPOOL_HEAP_DEBUG
+    assert(CentralCache::getInstance().blockSizeOf(large.handle.address()) == 0);
+#endif
+    large.handle.resume();
+    large.handle.resume();
+    assert(large.handle.done() && large.handle.promise().value == 7);
+    large.handle.destroy();
+
+    // frames may be destroyed on another thread than the one creating them
+    std::vector<PooledTask> tasks;
+    for (int i = 0; i < 1000; ++i) tasks.push_back(smallFrame(i));
+    std::thread([&tasks]() {
+        for (PooledTask& t : tasks) {
+            t.handle.resume();
+            t.handle.destroy();
+        }
+    }).join();
+
+    std::cout << "Pooled promise test passed!" << std::endl;
+}
+
+// A retired block waits for every reader that entered before it was retired,
+// and blocks retired by exited threads are still freed.
+void testEpochRetire() {
+    std::cout << "Running epoch retire test..." << std::endl;
+
+    size_t waiting = MemoryPool::flushRetired();
+    assert(waiting == 0);
+
+    std::atomic<int> stage{ 0 };
+    std::thread reader([&stage]() {
+        mpool::EpochGuard guard;
+        stage = 1;
+        while (stage.load() != 2) std::this_thread::yield();
+    });
+    while (stage.load() != 1) std::this_thread::yield();
+
+    for (int i = 0; i < 100; ++i) MemoryPool::retire(MemoryPool::allocate(48), 48);
+    waiting = MemoryPool::flushRetired();
+    assert(waiting == 100);
+    stage = 2;
+    reader.join();
+    waiting = MemoryPool::flushRetired();
+    assert(waiting == 0);
+
+    // nested guards announce once; the outer exit ends the critical section
+    {
+        mpool::EpochGuard outer;
+        {
+            mpool::EpochGuard inner;
+        }
+        assert(Epoch::record->epoch.load() != 0);
+    }
+    assert(Epoch::record->epoch.load() == 0);
+
+    std::thread([]() {
+        for (int i = 0; i < 1000; ++i) MemoryPool::retire(MemoryPool::allocate(24), 24);
+    }).join();
+    waiting = MemoryPool::flushRetired();
+    assert(waiting == 0);
+
+    std::cout << "Epoch retire test passed!" << std::endl;
+}
+
+#ifdef __linux__
+// Blocks are named by offsets, so two mappings of one region (here in one
+// process, at different addresses, and in a forked child) share the heap.
+void testSharedHeap() {
+    std::cout << "Running shared heap test..." << std::endl;
+
+    mpool::SharedHeap a, b;
+    bool created = a.create(nullptr, 1 << 20);
+    assert(created);
+    bool attached = b.attach(a.fd());
+    assert(attached);
+    assert(a.fromOffset(0) != b.fromOffset(0));
+
+    // allocated through one mapping, read and freed through the other
+    char* msg = static_cast<char*>(a.allocate(100));
+    std::memset(msg, 0x5a, 100);
+    uint64_t offset = a.toOffset(msg);
+    char* seen = static_cast<char*>(b.fromOffset(offset));
+    assert(seen[0] == 0x5a && seen[99] == 0x5a);
+    b.deallocate(seen, 100);
+    char* again = static_cast<char*>(a.allocate(100));
+    assert(again == msg);
+    a.deallocate(again, 100);
+
+    void* big = b.allocate(10000);
+    assert(big != nullptr);
+    uint64_t bigOffset = b.toOffset(big);
+    a.deallocate(a.fromOffset(bigOffset), 10000);
+    big = a.allocate(10000);
+    assert(a.toOffset(big) == bigOffset);
+    a.deallocate(big, 10000);
+
+    // a child process publishes a message through the root word
+    pid_t child = fork();
+    if (child == 0) {
+        mpool::SharedHeap heap;
+        if (!heap.attach(a.fd())) _exit(1);
+        char* reply = static_cast<char*>(heap.allocate(64));
+        if (!reply) _exit(1);
+        std::strcpy(reply, "from child");
+        heap.setRoot(heap.toOffset(reply));
+        _exit(0);
+    }
+    int status = 0;
+    waitpid(child, &status, 0);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    char* reply = static_cast<char*>(b.fromOffset(b.root()));
+    assert(std::strcmp(reply, "from child") == 0);
+    b.deallocate(reply, 64);
+
+    // runs out instead of growing
+    std::vector<void*> blocks;
+    while (void* p = a.allocate(2048)) blocks.push_back(p);
+    void* none = a.allocate(16);
+    assert(!blocks.empty() && none == nullptr);
+    for (void* p : blocks) a.deallocate(p, 2048);
+    void* reused = a.allocate(2048);
+    assert(reused == blocks.back());
+
+    std::cout << "Shared heap test passed!" << std::endl;
+}
+
+// A file heap keeps its objects across close/reopen and across an owner
+// that dies without closing; a damaged free list makes the reopen fail.
+void testPersistentHeap() {
+    std::cout << "Running persistent heap test..." << std::endl;
+
+    char path[] = "/tmp/mp_tests_heapXXXXXX";
+    int tmp = mkstemp(path);
+    assert(tmp >= 0);
+    close(tmp); // empty file: openFile initializes it
+
+    struct Node { uint64_t next; uint64_t value; };
+    {
+        mpool::SharedHeap heap;
+        bool opened = heap.openFile(path, 1 << 20);
+        assert(opened);
+        mpool::SharedHeap second;
+        bool locked = second.openFile(path, 1 << 20);
+        assert(!locked);
+        uint64_t head = 0;
+        for (uint64_t i = 1; i <= 100; ++i) {
+            Node* n = static_cast<Node*>(heap.allocate(sizeof(Node)));
+            *n = { head, i };
+            head = heap.toOffset(n);
+        }
+        heap.setRoot(head);
+    }
+
+    auto sumList = [](mpool::SharedHeap& heap) {
+        uint64_t sum = 0;
+        for (uint64_t off = heap.root(); off;) {
+            Node* n = static_cast<Node*>(heap.fromOffset(off));
+            sum += n->value;
+            off = n->next;
+        }
+        return sum;
+    };
+    {
+        mpool::SharedHeap heap;
+        bool opened = heap.openFile(path, 0);
+        assert(opened && heap.check());
+        assert(sumList(heap) == 5050);
+    }
+
+    // the owner dies holding the heap open, with free blocks on its lists
+    pid_t child = fork();
+    if (child == 0) {
+        mpool::SharedHeap heap;
+        if (!heap.openFile(path, 0)) _exit(1);
+        heap.deallocate(heap.allocate(300), 300);
+        _exit(0);
+    }
+    int status = 0;
+    waitpid(child, &status, 0);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    {
+        mpool::SharedHeap heap;
+        bool opened = heap.openFile(path, 0);
+        assert(opened);
+        assert(sumList(heap) == 5050);
+    }
+
+    // ... and once more after scribbling over a free block's link
+    child = fork();
+    if (child == 0) {
+        mpool::SharedHeap heap;
+        if (!heap.openFile(path, 0)) _exit(1);
+        void* block = heap.allocate(300);
+        heap.deallocate(block, 300);
+        *static_cast<uint64_t*>(block) = uint64_t(1) << 36;
+        _exit(0);
+    }
+    waitpid(child, &status, 0);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    {
+        mpool::SharedHeap heap;
+        bool opened = heap.openFile(path, 0);
+        assert(!opened);
+    }
+    unlink(path);
+
+    std::cout << "Persistent heap test passed!" << std::endl;
+}
+
+// The published page follows the pool's counters, reads consistently from
+// another process, and disappears once publishing stops.
+void testStatsPage() {
+    std::cout << "Running stats page test..." << std::endl;
+
+    bool published = MemoryPool::publishStats(std::chrono::milliseconds(5));
+    assert(published);
+    const StatsPage::Page* page = StatsPage::attach(getpid());
+    assert(page && page->pid == static_cast<uint32_t>(getpid()));
+
+    auto refills = [](const StatsPage::Snapshot& s) {
+        size_t total = 0;
+        for (const ClassStats& c : s.classes) total += c.refills;
+        return total;
+    };
+    auto nextSnapshot = [&](const StatsPage::Snapshot& after) {
+        StatsPage::Snapshot s{};
+        do {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            bool read = StatsPage::read(*page, s);
+            assert(read);
+        } while (s.publishes < after.publishes + 2);
+        return s;
+    };
+
+    StatsPage::Snapshot before{};
+    before = nextSnapshot(before);
+    std::vector<void*> ptrs;
+    for (int i = 0; i < 5000; ++i) ptrs.push_back(MP_allocate(96));
+    StatsPage::Snapshot after = nextSnapshot(before);
+    assert(refills(after) > refills(before));
+    assert(after.publishedNs > before.publishedNs);
+    assert(after.pool.mappedBytes > 0 && after.pool.threadHeldBytes >= 5000 * 96);
+    assert(after.classes[Size::sizeToIndex(96)].blockSize == 96);
+
+    pid_t child = fork();
+    if (child == 0) {
+        const StatsPage::Page* theirs = StatsPage::attach(getppid());
+        StatsPage::Snapshot s{};
+        _exit(theirs && StatsPage::read(*theirs, s) && s.publishes > 0 ? 0 : 1);
+    }
+    int status = 0;
+    waitpid(child, &status, 0);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    for (void* p : ptrs) MP_deallocate(p, 96);
+    MemoryPool::stopPublishingStats();
+    StatsPage::detach(page);
+    const StatsPage::Page* gone = StatsPage::attach(getpid());
+    assert(gone == nullptr);
+
+    std::cout << "Stats page test passed!" << std::endl;
+}
+#endif
+
+#ifndef MPOOL_HEAP_DEBUG
+// Span fetch, reclaim and release must not allocate through new/malloc: the
+// metadata lives in the pool's own arena.
+void testNoSystemAllocation() {
+    std::cout << "Running no-system-allocation test..." << std::endl;
+
+    const size_t SIZES[] = { 8, 72, 200, 640, 2048 };
+    void* ptrs[6000];
+    size_t before = systemNewCalls.load();
+    for (int round = 0; round < 3; ++round) {
+        for (int i = 0; i < 6000; ++i) ptrs[i] = MP_allocate(SIZES[i % 5]);
+        for (int i = 0; i < 6000; ++i) MP_deallocate(ptrs[i], SIZES[i % 5]);
+    }
+    MemoryPool::trim();
+    assert(systemNewCalls.load() == before);
+
+    std::cout << "No-system-allocation test passed!" << std::endl;
+}
+#endif
+
+#ifdef MPOOL_HEAP_DEBUG
+static std::vector<HeapDebug::Error> reportedErrors;
+
+void testHeapDebug() {
+    std::cout << "Running heap debug test..." << std::endl;
+
+    HeapDebug::setErrorHandler([](HeapDebug::Error e, void*, size_t) { reportedErrors.push_back(e); });
+
+    char* p = static_cast<char*>(MemoryPool::allocate(24));
+    MemoryPool::deallocate(p, 24);
+    MemoryPool::deallocate(p, 24);
+    assert(reportedErrors.size() == 1 && reportedErrors[0] == HeapDebug::Error::DoubleFree);
+
+    char* q = static_cast<char*>(MemoryPool::allocate(24));
+    q[24] = 'x';
+    MemoryPool::deallocate(q, 24);
+    assert(reportedErrors.size() == 2 && reportedErrors[1] == HeapDebug::Error::BufferOverflow);
+
+    char* r = static_cast<char*>(MemoryPool::allocate(100));
+    MemoryPool::deallocate(r, 1000);
+    assert(reportedErrors.size() == 3 && reportedErrors[2] == HeapDebug::Error::WrongSizeClass);
+    MemoryPool::deallocate(r, 100);
+
+    char* u = static_cast<char*>(MemoryPool::allocate(64));
+    MemoryPool::deallocate(u, 64);
+    u[10] = 'x';
+    HeapDebug::flushQuarantine();
+    assert(reportedErrors.size() == 4 && reportedErrors[3] == HeapDebug::Error::UseAfterFree);
+
+    HeapDebug::setErrorHandler(nullptr);
+    std::cout << "Heap debug test passed!" << std::endl;
+}
+#endif
+
+// Real-time mode freezes the global pool: allocations on a real-time thread
+// come from the reserve, fail with nullptr once it is used up instead of
+// mapping more, and nothing is released to the OS. Runs last, since the pool
+// stays frozen.
+void testRealTime() {
+    std::cout << "Running real-time mode test..." << std::endl;
+
+    bool started = MemoryPool::startRealTime(16 << 20);
+    assert(started && RealTime::active());
+    size_t mapped = MemoryPool::getStats().mappedBytes;
+
+    std::thread rt([&] {
+        MemoryPool::enterRealTimeThread();
+        assert(MP_allocate(Size::MAX_ALLOC_SIZE + 1) == nullptr);
+
+        std::vector<void*> ptrs;
+        for (size_t i = 0; i < (64 << 20) / 64; ++i) {
+            void* p = MP_allocate(64);
+            if (!p) break;
+            *static_cast<char*>(p) = 1;
+            ptrs.push_back(p);
+        }
+        // the reserve ran out before 64 MB, without growing
+        assert(ptrs.size() < (64 << 20) / 64 && ptrs.size() >= (8 << 20) / 64);
+        assert(MemoryPool::getStats().mappedBytes == mapped);
+
+        // freed blocks are reusable right away; trim requests are ignored
+        MP_deallocate(ptrs.back(), 64);
+        ThreadCache::requestTrim();
+        ptrs.back() = MP_allocate(64);
+        assert(ptrs.back());
+        for (void* p : ptrs) MP_deallocate(p, 64);
+        MemoryPool::leaveRealTimeThread();
+    });
+    rt.join();
+
+    size_t released = PageCache::getInstance().releaseToOS();
+    assert(released == 0);
+    MemoryPool::trim();
+    void* p = MP_allocate(128);
+    assert(p);
+    MP_deallocate(p, 128);
+    assert(MemoryPool::getStats().mappedBytes == mapped);
+
+    std::cout << "Real-time mode test passed!" << std::endl;
+}
+
+// Maintenance passes running next to a real-time thread never make its
+// allocations fail while the reserve has room: a refill that misses a lock
+// takes the thread's stash, and waits for the lock once that is used up.
+// Runs on the pool testRealTime froze.
+void testRealTimeMaintenance() {
+    std::cout << "Running real-time maintenance test..." << std::endl;
+
+    Maintenance::getInstance().runOnce(); // hands testRealTime's empty spans back
+    size_t mapped = MemoryPool::getStats().mappedBytes;
+
+    std::atomic<bool> done{ false };
+    std::thread maintenance([&] {
+        while (!done.load(std::memory_order_relaxed)) Maintenance::getInstance().runOnce();
+    });
+    std::thread rt([&] {
+        MemoryPool::enterRealTimeThread();
+        const size_t SIZES[] = { 24, 200, 640, 1800 };
+        std::vector<std::pair<void*, size_t>> ptrs;
+        for (int round = 0; round < 200; ++round) {
+            for (int i = 0; i < 2000; ++i) {
+                size_t size = SIZES[i % 4];
+                void* p = MP_allocate(size);
+                assert(p != nullptr);
+                *static_cast<char*>(p) = 1;
+                ptrs.push_back({ p, size });
+            }
+            for (auto& [p, size] : ptrs) MP_deallocate(p, size);
+            ptrs.clear();
+        }
+        MemoryPool::leaveRealTimeThread();
+    });
+    rt.join();
+    done = true;
+    maintenance.join();
+
+    assert(MemoryPool::getStats().mappedBytes == mapped);
+
+    std::cout << "Real-time maintenance test passed!" << std::endl;
+}
+
 int main() {
     try {
         std::cout << "Starting memory pool tests..." << std::endl;
 
+        testBitmapLayout();
         testBasicAllocation();
         testMemoryWriting();
         testMultiThreading();
         testEdgeCases();
         testStress();
+        testHeapProfiler();
+        testMaintenance();
+        testHeapInstances();
+        testHeapStaleCaches();
+        testSpanCache();
+        testReleasedSpanCoalescing();
+        testCacheColoring();
+        testMemoryLimit();
+        testPrewarm();
+        testAllocateZeroed();
+        testAllocateAtLeast();
+        testPooledPromise();
+        testEpochRetire();
+#ifdef __linux__
+        testSharedHeap();
+        testPersistentHeap();
+        testStatsPage();
+#endif
+#ifndef MPOOL_HEAP_DEBUG
+        testNoSystemAllocation();
+#endif
+#ifdef MPOOL_HEAP_DEBUG
+        testHeapDebug();
+#endif
+        testRealTime();
+        testRealTimeMaintenance();
 
         std::cout << "All tests passed successfully!" << std::endl;
         return 0;
@@ -0,0 +1,132 @@
+// Live view of another process's pool, read from the stats page it publishes
+// with MemoryPool::publishStats() (see StatsPage.h): memory by tier, lock
+// traffic and contention, and per size class the blocks held by threads and
+// parked in CentralCache with the refill/drain rates of the thread caches.
+// Rates are per second over the interval between two published snapshots.
+// Size classes with nothing held, parked or moving are hidden unless --all.
+//
+//   mpooltop <pid> [--interval ms] [--count N] [--all]
+#include "../include/StatsPage.h"
+#include <cerrno>
+#include <csignal>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+namespace
+{
+    bool alive(int pid)
+    {
+        return ::kill(pid, 0) == 0 || errno == EPERM;
+    }
+
+    std::string mb(size_t bytes)
+    {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(1) << bytes / 1048576.0 << " MB";
+        return out.str();
+    }
+
+    double rate(size_t now, size_t before, double seconds)
+    {
+        return seconds > 0 ? static_cast<double>(now - before) / seconds : 0;
+    }
+
+    std::string percent(size_t part, size_t whole)
+    {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(1) << (whole ? 100.0 * part / whole : 0) << "%";
+        return out.str();
+    }
+
+    void show(const StatsPage::Snapshot& now, const StatsPage::Snapshot& before, const StatsPage::Page& page,
+              int pid, bool all)
+    {
+        double seconds = (now.publishedNs - before.publishedNs) / 1e9;
+        const PoolStats& p = now.pool;
+        const PoolStats& q = before.pool;
+        std::cout << "mpooltop  pid " << pid << "  published every " << page.periodNs / 1000000 << " ms, "
+                  << now.publishes << " snapshots" << (seconds > 0 ? "" : "  (stale)") << "\n\n"
+                  << "mapped " << mb(p.mappedBytes) << "   page free " << mb(p.pageFreeBytes) << "   span cache "
+                  << mb(p.pageCachedBytes) << "   released " << mb(p.pageReleasedBytes) << "   metadata "
+                  << mb(p.metadataBytes) << "\n"
+                  << "central spans " << mb(p.centralSpanBytes) << "   central free " << mb(p.centralFreeBytes)
+                  << "   held by threads " << mb(p.threadHeldBytes) << "\n"
+                  << std::fixed << std::setprecision(0) << "central lock "
+                  << rate(p.centralLockAcquires, q.centralLockAcquires, seconds) << "/s (contended "
+                  << percent(p.centralLockContended - q.centralLockContended,
+                             p.centralLockAcquires - q.centralLockAcquires)
+                  << ")   page lock " << rate(p.pageLockAcquires, q.pageLockAcquires, seconds) << "/s (contended "
+                  << percent(p.pageLockContended - q.pageLockContended, p.pageLockAcquires - q.pageLockAcquires)
+                  << ")   span cache hits " << rate(p.spanCacheHits, q.spanCacheHits, seconds)
+                  << "/s   spans released " << rate(p.centralSpansReleased, q.centralSpansReleased, seconds)
+                  << "/s\n\n"
+                  << std::setw(6) << "size" << std::setw(12) << "held KB" << std::setw(12) << "central KB"
+                  << std::setw(12) << "refills/s" << std::setw(12) << "drains/s" << std::setw(12) << "lock/s"
+                  << std::setw(12) << "contended" << "\n";
+        for (size_t i = 0; i < Size::FREE_LIST_SIZE; ++i) {
+            const ClassStats& c = now.classes[i];
+            const ClassStats& d = before.classes[i];
+            if (!all && c.heldBlocks == 0 && c.freeBlocks == 0 && c.lockAcquires == d.lockAcquires)
+                continue;
+            std::cout << std::setw(6) << c.blockSize << std::setw(12) << c.heldBlocks * c.blockSize / 1024
+                      << std::setw(12) << c.freeBlocks * c.blockSize / 1024 << std::setw(12)
+                      << rate(c.refills, d.refills, seconds) << std::setw(12) << rate(c.drains, d.drains, seconds)
+                      << std::setw(12) << rate(c.lockAcquires, d.lockAcquires, seconds) << std::setw(12)
+                      << percent(c.lockContended - d.lockContended, c.lockAcquires - d.lockAcquires) << "\n";
+        }
+        std::cout.flush();
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        std::cerr << "usage: mpooltop <pid> [--interval ms] [--count N] [--all]\n";
+        return 2;
+    }
+    int pid = std::stoi(argv[1]);
+    size_t intervalMs = 1000;
+    size_t count = 0; // 0: until the process exits or mpooltop is interrupted
+    bool all = false;
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--all") all = true;
+        else if (arg == "--interval" && i + 1 < argc) intervalMs = std::stoul(argv[++i]);
+        else if (arg == "--count" && i + 1 < argc) count = std::stoul(argv[++i]);
+    }
+
+    const StatsPage::Page* page = StatsPage::attach(pid);
+    if (!page) {
+        std::cerr << "no stats page for pid " << pid << " (it must call MemoryPool::publishStats())\n";
+        return 1;
+    }
+    if (!alive(pid)) {
+        std::cerr << "pid " << pid << " is gone; its stats page was left behind by a crash\n";
+        StatsPage::detach(page);
+        return 1;
+    }
+
+    bool clear = ::isatty(STDOUT_FILENO);
+    StatsPage::Snapshot before{}, now{};
+    while (!StatsPage::read(*page, before))
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    for (size_t shown = 0; count == 0 || shown < count; ++shown) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(intervalMs));
+        if (!alive(pid)) {
+            std::cout << "pid " << pid << " exited\n";
+            break;
+        }
+        if (!StatsPage::read(*page, now))
+            continue;
+        if (clear) std::cout << "\033[H\033[2J";
+        else if (shown) std::cout << "\n";
+        show(now, before, *page, pid, all);
+        before = now;
+    }
+    StatsPage::detach(page);
+    return 0;
+}
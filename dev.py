@@ -1,5 +1,5 @@
 #!/usr/bin/env python3
-import subprocess, sys, argparse
+import subprocess, sys, argparse, json, csv
 from pathlib import Path
 import shutil
 
@@ -32,6 +32,244 @@ def cmd_perf(args):
             sys.exit(1)
         subprocess.run(["perf", "stat", "-e", "task-clock,context-switches,page-faults", "-r", str(args.repeat), binary])
 
+def cmd_replay(args):
+    names = ["bench_replay_mempool", "bench_replay_newdelete", "bench_replay_tcmalloc"]
+    for name in names:
+        binary = BUILD/name
+        if not binary.exists():
+            print("[ERROR] target:", binary, "does not exist, Run: python dev.py build")
+            sys.exit(1)
+    if not Path(args.trace).exists():
+        print("[INFO] trace", args.trace, "not found, generating a synthetic one")
+        subprocess.run([BUILD/names[0], "--generate", args.trace])
+    for name in names:
+        subprocess.run([BUILD/name, args.trace])
+
+def load_latency(path):
+    with open(path) as f:
+        data = json.load(f)
+    return {(r["size"], r["threads"], op): r[op] for r in data["results"] for op in ("alloc", "free")}
+
+def cmd_latency(args):
+    names = ["bench_latency_mempool", "bench_latency_newdelete", "bench_latency_tcmalloc"]
+    outputs = []
+    for name in names:
+        binary = BUILD/name
+        if not binary.exists():
+            print("[ERROR] target:", binary, "does not exist, Run: python dev.py build")
+            sys.exit(1)
+        out = BUILD / (name + ".json")
+        cmd = [binary, "--json", str(out)]
+        if args.threads:
+            cmd += ["--threads", args.threads]
+        if subprocess.run(cmd).returncode == 0:
+            outputs.append(out)
+
+    if args.save and outputs:
+        shutil.copy(outputs[0], args.save)
+        print(f"[OK] Saved {outputs[0].name} as baseline {args.save}")
+
+    if args.baseline:
+        base = load_latency(args.baseline)
+        for out in outputs:
+            cur = load_latency(out)
+            print(f"\n{out.name} vs {args.baseline} (ns, + is slower)")
+            print(f"{'size':>6}{'thr':>5}{'op':>7}{'p50':>16}{'p99':>16}{'p99.9':>16}{'max':>18}")
+            for key in sorted(cur):
+                if key not in base:
+                    continue
+                row = f"{key[0]:>6}{key[1]:>5}{key[2]:>7}"
+                for stat, width in (("p50", 16), ("p99", 16), ("p999", 16), ("max", 18)):
+                    c, b = cur[key][stat], base[key][stat]
+                    pct = (c - b) / b * 100 if b else 0.0
+                    row += f"{c:>{width - 9}.0f} ({pct:+5.0f}%)"
+                print(row)
+
+def cmd_scale(args):
+    names = ["bench_scale_mempool", "bench_scale_newdelete", "bench_scale_tcmalloc"]
+    rows = []
+    for name in names:
+        binary = BUILD/name
+        if not binary.exists():
+            print("[ERROR] target:", binary, "does not exist, Run: python dev.py build")
+            sys.exit(1)
+        out = BUILD / (name + ".csv")
+        cmd = [binary, "--csv", str(out)]
+        if args.max_threads:
+            cmd += ["--max-threads", str(args.max_threads)]
+        if subprocess.run(cmd).returncode == 0:
+            with open(out) as f:
+                rows += list(csv.DictReader(f))
+
+    allocators = list(dict.fromkeys(r["allocator"] for r in rows))
+    table = {}
+    for r in rows:
+        table.setdefault((r["pattern"], int(r["threads"])), {})[r["allocator"]] = float(r["ops_per_sec"])
+    print(f"\n{'pattern':<12}{'threads':>8}" + "".join(f"{a + ' Mops/s':>22}" for a in allocators))
+    for (pattern, threads), byAlloc in table.items():
+        print(f"{pattern:<12}{threads:>8}" + "".join(f"{byAlloc.get(a, 0) / 1e6:>22.2f}" for a in allocators))
+
+def cmd_memory(args):
+    names = ["bench_memory_mempool", "bench_memory_newdelete", "bench_memory_tcmalloc"]
+    for name in names:
+        binary = BUILD/name
+        if not binary.exists():
+            print("[ERROR] target:", binary, "does not exist, Run: python dev.py build")
+            sys.exit(1)
+    for name in names:
+        subprocess.run([BUILD/name, "--threads", str(args.threads), "--live-mb", str(args.live_mb),
+                        "--csv", str(BUILD / (name + ".csv"))])
+
+def cmd_layout(args):
+    binary = BUILD/"bench_layout"
+    if not binary.exists():
+        print("[ERROR] target:", binary, "does not exist, Run: python dev.py build")
+        sys.exit(1)
+    for layout in ("list", "bitmap"):
+        cmd = [binary, "--layout", layout, "--threads", str(args.threads)]
+        if shutil.which("perf"):
+            cmd = ["perf", "stat", "-e", "task-clock,cache-references,cache-misses,L1-dcache-load-misses"] + cmd
+        subprocess.run(cmd)
+
+def cmd_prewarm(args):
+    binary = BUILD/"bench_prewarm"
+    if not binary.exists():
+        print("[ERROR] target:", binary, "does not exist, Run: python dev.py build")
+        sys.exit(1)
+    for mode in ("cold", "reserve", "populate", "prewarm"):
+        subprocess.run([binary, "--mode", mode, "--count", str(args.count)])
+
+def cmd_calloc(args):
+    names = ["bench_calloc_mempool", "bench_calloc_newdelete", "bench_calloc_tcmalloc"]
+    for name in names:
+        binary = BUILD/name
+        if not binary.exists():
+            print("[ERROR] target:", binary, "does not exist, Run: python dev.py build")
+            sys.exit(1)
+    subprocess.run([BUILD/names[0], "--mb", str(args.mb), "--memset"])
+    subprocess.run([BUILD/names[0], "--mb", str(args.mb), "--memset", "--reserve"])
+    subprocess.run([BUILD/names[0], "--mb", str(args.mb), "--reserve"])
+    for name in names:
+        subprocess.run([BUILD/name, "--mb", str(args.mb)])
+
+def cmd_coroutine(args):
+    names = ["bench_coroutine_mempool", "bench_coroutine_newdelete", "bench_coroutine_tcmalloc"]
+    for name in names:
+        binary = BUILD/name
+        if not binary.exists():
+            print("[ERROR] target:", binary, "does not exist, Run: python dev.py build")
+            sys.exit(1)
+    for name in names:
+        subprocess.run([BUILD/name, "--tasks", str(args.tasks), "--threads", str(args.threads)])
+
+def cmd_epoch(args):
+    binary = BUILD/"bench_epoch"
+    if not binary.exists():
+        print("[ERROR] target:", binary, "does not exist, Run: python dev.py build")
+        sys.exit(1)
+    subprocess.run([binary, "--threads", str(args.threads), "--ops", str(args.ops)])
+
+def cmd_shm(args):
+    binary = BUILD/"bench_shm"
+    if not binary.exists():
+        print("[ERROR] target:", binary, "does not exist, Run: python dev.py build")
+        sys.exit(1)
+    subprocess.run([binary, "--msgs", str(args.msgs), "--sizes", args.sizes])
+
+def cmd_persist(args):
+    binary = BUILD/"bench_persist"
+    if not binary.exists():
+        print("[ERROR] target:", binary, "does not exist, Run: python dev.py build")
+        sys.exit(1)
+    subprocess.run([binary, "--entries", str(args.entries), "--value", str(args.value)])
+
+def cmd_spans(args):
+    binary = BUILD/"bench_spans"
+    if not binary.exists():
+        print("[ERROR] target:", binary, "does not exist, Run: python dev.py build")
+        sys.exit(1)
+    subprocess.run([binary, "--max-threads", str(args.max_threads), "--ops", str(args.ops)])
+
+def cmd_coloring(args):
+    binary = BUILD/"bench_coloring"
+    if not binary.exists():
+        print("[ERROR] target:", binary, "does not exist, Run: python dev.py build")
+        sys.exit(1)
+    subprocess.run([binary, "--objects", str(args.objects), "--accesses", str(args.accesses)])
+
+def cmd_realtime(args):
+    binary = BUILD/"bench_realtime"
+    if not binary.exists():
+        print("[ERROR] target:", binary, "does not exist, Run: python dev.py build")
+        sys.exit(1)
+    status = 0
+    for mode in ("normal", "realtime"):
+        result = subprocess.run([binary, "--mode", mode, "--threads", str(args.threads), "--ops", str(args.ops),
+                                 "--bound-us", str(args.bound_us)])
+        status = status or result.returncode
+    sys.exit(status)
+
+def cmd_growth(args):
+    binary = BUILD/"bench_growth"
+    if not binary.exists():
+        print("[ERROR] target:", binary, "does not exist, Run: python dev.py build")
+        sys.exit(1)
+    subprocess.run([binary, "--buffers", str(args.buffers), "--max-len", str(args.max_len)])
+
+def cmd_top(args):
+    binary = BUILD/"mpooltop"
+    if not binary.exists():
+        print("[ERROR] target:", binary, "does not exist, Run: python dev.py build")
+        sys.exit(1)
+    cmd = [binary, str(args.pid), "--interval", str(args.interval), "--count", str(args.count)]
+    if args.all:
+        cmd.append("--all")
+    try:
+        subprocess.run(cmd)
+    except KeyboardInterrupt:
+        pass
+
+SUITE_WORKLOADS = ["cache_scratch", "cache_thrash", "larson", "xmalloc_test", "alloc_test", "sh6bench"]
+
+def cmd_suite(args):
+    workloads = args.workload.split(",") if args.workload else SUITE_WORKLOADS
+    names = [f"suite_{w}_{a}" for w in workloads for a in ("mempool", "newdelete", "tcmalloc")]
+    for name in names:
+        binary = BUILD/name
+        if not binary.exists():
+            print("[ERROR] target:", binary, "does not exist, Run: python dev.py build")
+            sys.exit(1)
+    out = BUILD / "suite.csv"
+    out.unlink(missing_ok=True)
+    for threads in args.threads.split(","):
+        for name in names:
+            subprocess.run([BUILD/name, "--threads", threads, "--csv", str(out)])
+    if not out.exists():
+        return
+
+    with open(out) as f:
+        rows = list(csv.DictReader(f))
+    allocators = list(dict.fromkeys(r["allocator"] for r in rows))
+    table = {}
+    for r in rows:
+        table.setdefault((r["workload"], int(r["threads"])), {})[r["allocator"]] = r
+    # seconds (lower is better), and each allocator relative to the first
+    print(f"\n{'workload':<14}{'threads':>8}" + "".join(f"{a + ' s':>18}" for a in allocators) +
+          f"{'pool lock waits':>18}")
+    order = list(dict.fromkeys(r["workload"] for r in rows))
+    for (workload, threads), byAlloc in sorted(table.items(), key=lambda kv: (order.index(kv[0][0]), kv[0][1])):
+        line = f"{workload:<14}{threads:>8}"
+        first = float(byAlloc[allocators[0]]["seconds"]) if allocators[0] in byAlloc else 0
+        for a in allocators:
+            if a not in byAlloc:
+                line += f"{'-':>18}"
+                continue
+            secs = float(byAlloc[a]["seconds"])
+            line += f"{secs:>10.3f} ({secs / first if first else 0:4.2f}x)"
+        pool = byAlloc.get("Memory Pool")
+        waits = int(pool["central_waits"]) + int(pool["page_waits"]) if pool else 0
+        print(line + f"{waits:>18}")
+
 def cmd_clean(args):
     if BUILD.exists():
         shutil.rmtree(BUILD)
@@ -54,6 +292,90 @@ def main():
     p_perf.add_argument("-r", "--repeat", type=int, default=3)
     p_perf.set_defaults(func=cmd_perf)
 
+    p_replay = sub.add_parser("replay")
+    p_replay.add_argument("trace")
+    p_replay.set_defaults(func=cmd_replay)
+
+    p_latency = sub.add_parser("latency")
+    p_latency.add_argument("--threads", help="comma-separated thread counts, e.g. 1,4,16")
+    p_latency.add_argument("--baseline", help="bench_latency JSON to compare against")
+    p_latency.add_argument("--save", help="save this run's pool results as a baseline JSON")
+    p_latency.set_defaults(func=cmd_latency)
+
+    p_scale = sub.add_parser("scale")
+    p_scale.add_argument("--max-threads", type=int, help="sweep up to this many threads (default 2x cores)")
+    p_scale.set_defaults(func=cmd_scale)
+
+    p_memory = sub.add_parser("memory")
+    p_memory.add_argument("--threads", type=int, default=4)
+    p_memory.add_argument("--live-mb", type=int, default=128)
+    p_memory.set_defaults(func=cmd_memory)
+
+    p_layout = sub.add_parser("layout")
+    p_layout.add_argument("--threads", type=int, default=4)
+    p_layout.set_defaults(func=cmd_layout)
+
+    p_prewarm = sub.add_parser("prewarm")
+    p_prewarm.add_argument("--count", type=int, default=20000)
+    p_prewarm.set_defaults(func=cmd_prewarm)
+
+    p_calloc = sub.add_parser("calloc")
+    p_calloc.add_argument("--mb", type=int, default=64)
+    p_calloc.set_defaults(func=cmd_calloc)
+
+    p_coroutine = sub.add_parser("coroutine")
+    p_coroutine.add_argument("--tasks", type=int, default=1000000)
+    p_coroutine.add_argument("--threads", type=int, default=1)
+    p_coroutine.set_defaults(func=cmd_coroutine)
+
+    p_epoch = sub.add_parser("epoch")
+    p_epoch.add_argument("--threads", type=int, default=4)
+    p_epoch.add_argument("--ops", type=int, default=1000000)
+    p_epoch.set_defaults(func=cmd_epoch)
+
+    p_shm = sub.add_parser("shm")
+    p_shm.add_argument("--msgs", type=int, default=200000)
+    p_shm.add_argument("--sizes", default="64,1024,16384")
+    p_shm.set_defaults(func=cmd_shm)
+
+    p_persist = sub.add_parser("persist")
+    p_persist.add_argument("--entries", type=int, default=1000000)
+    p_persist.add_argument("--value", type=int, default=100)
+    p_persist.set_defaults(func=cmd_persist)
+
+    p_spans = sub.add_parser("spans")
+    p_spans.add_argument("--max-threads", type=int, default=32)
+    p_spans.add_argument("--ops", type=int, default=200000)
+    p_spans.set_defaults(func=cmd_spans)
+
+    p_coloring = sub.add_parser("coloring")
+    p_coloring.add_argument("--objects", type=int, default=512)
+    p_coloring.add_argument("--accesses", type=int, default=20000000)
+    p_coloring.set_defaults(func=cmd_coloring)
+
+    p_realtime = sub.add_parser("realtime")
+    p_realtime.add_argument("--threads", type=int, default=1)
+    p_realtime.add_argument("--ops", type=int, default=5000000)
+    p_realtime.add_argument("--bound-us", type=float, default=100)
+    p_realtime.set_defaults(func=cmd_realtime)
+
+    p_growth = sub.add_parser("growth")
+    p_growth.add_argument("--buffers", type=int, default=200000)
+    p_growth.add_argument("--max-len", type=int, default=2048)
+    p_growth.set_defaults(func=cmd_growth)
+
+    p_top = sub.add_parser("top")
+    p_top.add_argument("pid", type=int)
+    p_top.add_argument("--interval", type=int, default=1000)
+    p_top.add_argument("--count", type=int, default=0)
+    p_top.add_argument("--all", action="store_true")
+    p_top.set_defaults(func=cmd_top)
+
+    p_suite = sub.add_parser("suite")
+    p_suite.add_argument("--threads", default="1,4")
+    p_suite.add_argument("--workload", default="")
+    p_suite.set_defaults(func=cmd_suite)
+
     p_clean = sub.add_parser("clean")
     p_clean.set_defaults(func=cmd_clean)
 